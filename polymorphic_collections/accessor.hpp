@@ -6,7 +6,10 @@
 #ifndef POLYMORPHIC_COLLECTIONS_ACCESSOR_HPP
 #define POLYMORPHIC_COLLECTIONS_ACCESSOR_HPP
 
+#include <algorithm>
+
 #include "policy.hpp"
+#include "detail/storage.hpp"
 #include "detail/accessor.hpp"
 
 namespace polymorphic_collections
@@ -23,78 +26,71 @@ namespace polymorphic_collections
     //          are to be immutable.
     //      [template] P1, ...
     //          Policies.
+    //      [template] S
+    //          Storage policy for the type-erased adapter (see policy.hpp).
     //
-    template <typename K, typename T, typename P1 = no_lock>
+    template <typename K, typename T, typename P1 = no_lock, typename S = default_storage>
     class accessor : public P1,
+                     private detail::adapter_storage<detail::accessor_adapter_vtable<K, T>, S>,
                      public boost::noncopyable
     {
     public:
         typedef K key_type;
         typedef T value_type;
-        typedef accessor<K, T, P1> this_type;
+        typedef accessor<K, T, P1, S> this_type;
+        typedef S storage_policy;
         typedef P1 lock_policy;
 
         //  Size, in bytes, of the internal storage buffer used to store the
         //  type-erased adapter object, thereby avoiding a heap allocation.
-        static const size_t internal_storage_size = 32 - sizeof(ptrdiff_t);
+        static const size_t internal_storage_size = S::size;
 
         accessor()
-        : m_adapter(nullptr)
         {
         }
 
         template <typename A>
         accessor(detail::accessor_adapter_proxy<K, T, A>&& adapter)
         {
-            size_t proxy_size = sizeof(adapter);
-            if (proxy_size <= internal_storage_size)
-            {
-                m_adapter = new (m_storage) detail::accessor_adapter_proxy<K, T, A>(std::move(adapter));
-            }
-            else
-            {
-                m_adapter = new detail::accessor_adapter_proxy<K, T, A>(std::move(adapter));
-            }
-        };
+            construct(std::move(adapter));
+        }
 
-        template <typename P1_>
-        accessor(accessor<K, T, P1_>&& rhs)
+        template <typename P1_, typename S_>
+        accessor(accessor<K, T, P1_, S_>&& rhs)
         {
-            if (reinterpret_cast<char*>(rhs.m_adapter) == rhs.m_storage)
-            {
-                m_adapter = rhs.m_adapter->move(m_storage);
-            }
-            else
-            {
-                m_adapter = rhs.m_adapter;
-            }
-            rhs.m_adapter = nullptr;
+            move_construct_from(rhs);
         }
 
         template <typename U>
         accessor(U&& param)
-        : m_adapter(nullptr)
         {
             *this = detail::make_accessor_adapter_proxy<K, T>(std::forward<U>(param));
         }
 
+        //
+        //  Constructs the accessor with a storage policy using a memory resource
+        //  (see resource_storage), which will provide the memory for the adapter
+        //  if it does not fit in the internal buffer, and for any collection
+        //  embedded in the adapter.
+        //
+        template <typename U>
+        accessor(U&& param, memory_resource* resource)
+        {
+            BOOST_STATIC_ASSERT_MSG(S::uses_resource, "The storage policy of the accessor does not use a memory resource.");
+            this->adopt_resource(resource);
+            construct(detail::make_accessor_adapter_proxy<K, T>(std::forward<U>(param), this->resource()));
+        }
+
         ~accessor()
         {
             dispose();
         }
 
-        template <typename P1_>
-        this_type& operator=(accessor<K, T, P1_>&& rhs)
+        template <typename P1_, typename S_>
+        this_type& operator=(accessor<K, T, P1_, S_>&& rhs)
         {
-            if (reinterpret_cast<char*>(rhs.m_adapter) == rhs.m_storage)
-            {
-                m_adapter = rhs.m_adapter->move(m_storage);
-            }
-            else
-            {
-                m_adapter = rhs.m_adapter;
-            }
-            rhs.m_adapter = nullptr;
+            dispose();
+            move_from(rhs);
             return *this;
         }
 
@@ -102,27 +98,22 @@ namespace polymorphic_collections
         this_type& operator=(detail::accessor_adapter_proxy<K, T, A>&& adapter)
         {
             dispose();
-
-            size_t proxy_size = sizeof(adapter);
-            if (proxy_size <= internal_storage_size)
-            {
-                m_adapter = new (m_storage) detail::accessor_adapter_proxy<K, T, A>(std::move(adapter));
-            }
-            else
-            {
-                m_adapter = new detail::accessor_adapter_proxy<K, T, A>(std::move(adapter));
-            }
-
+            construct(std::move(adapter));
             return *this;
         }
         
         template <typename U>
         this_type& operator=(U&& param)
         {
-            *this = detail::make_accessor_adapter_proxy<K, T>(std::forward<U>(param));
+            *this = detail::make_accessor_adapter_proxy<K, T>(std::forward<U>(param), this->resource());
             return *this;
         }
 
+        //
+        //  Looks up the value for the given key. Adapters over collections with
+        //  a find() method only take the shared side of the lock (see
+        //  reader_writer_lock), so that lookups do not serialize.
+        //
         boost::optional<T&> get(const K& key)
         {
             if (!m_adapter)
@@ -131,17 +122,17 @@ namespace polymorphic_collections
             }
             else
             {
-                if (lock_policy::lock())
+                if (lock_for_get())
                 {
                     try
                     {
-                        boost::optional<T&> value = m_adapter->get(key);
-                        lock_policy::unlock();
+                        boost::optional<T&> value = m_vtable->get(m_adapter, key);
+                        unlock_for_get();
                         return value;
                     }
                     catch (...)
                     {
-                        lock_policy::unlock();
+                        unlock_for_get();
                         throw;
                     }
                 }
@@ -157,29 +148,297 @@ namespace polymorphic_collections
             return get(key);
         }
 
-    private:
-        template <typename K_, typename T_, typename P1_>
-        friend class accessor;
-
-        void dispose()
+        //
+        //  Looks up a batch of keys in a single call, storing pointers to their
+        //  values in the caller-provided buffer. The lock is only taken once for
+        //  the whole batch, and adapters over hash maps overlap the cache misses
+        //  of the lookups (see detail::find_many()).
+        //
+        //  Parameters:
+        //      [in] keys
+        //          Keys to look up.
+        //      [in] count
+        //          Number of keys.
+        //      [out] out
+        //          Buffer which will receive a pointer to the value of each key,
+        //          or nullptr if the key is not present. Must have room for at
+        //          least count pointers.
+        //
+        //  Returns:
+        //      The number of keys looked up, starting with the first one. This
+        //      is count unless the adapter reuses the storage of its values
+        //      (e.g. functional accessors), in which case it looks up one key
+        //      per call. The pointers remain valid for as long as a reference
+        //      returned by get() would. If the lock could not be acquired (see
+        //      atomic_nonblocking), 0 is returned and all count pointers are
+        //      nullptr.
+        //
+        size_t get_many(const K* keys, size_t count, T** out)
         {
-            if (m_adapter)
+            if (!m_adapter)
             {
-                if (reinterpret_cast<char*>(m_adapter) == m_storage)
+                std::fill(out, out + count, nullptr);
+                return count;
+            }
+            if (lock_for_get())
+            {
+                try
                 {
-                    m_adapter->~accessor_adapter_interface();
+                    size_t result = m_vtable->get_many(m_adapter, keys, count, out);
+                    unlock_for_get();
+                    return result;
                 }
-                else
+                catch (...)
                 {
-                    delete m_adapter;
+                    unlock_for_get();
+                    throw;
                 }
-                m_adapter = nullptr;
             }
+            std::fill(out, out + count, nullptr);
+            return 0;
+        }
+
+        //  Memory resource used for heap allocations, or nullptr for the
+        //  global heap.
+        memory_resource* resource() const
+        {
+            return storage_type::resource();
+        }
+
+    private:
+        template <typename K_, typename T_, typename P1_, typename S_>
+        friend class accessor;
+
+        bool lock_for_get()
+        {
+            return m_vtable->shared_get ? lock_policy::lock_shared() : lock_policy::lock();
+        }
+
+        void unlock_for_get()
+        {
+            if (m_vtable->shared_get)
+            {
+                lock_policy::unlock_shared();
+            }
+            else
+            {
+                lock_policy::unlock();
+            }
+        }
+
+        typedef detail::adapter_storage<detail::accessor_adapter_vtable<K, T>, S> storage_type;
+        using storage_type::allocate;
+        using storage_type::deallocate;
+        using storage_type::construct;
+        using storage_type::move_from;
+        using storage_type::move_construct_from;
+        using storage_type::dispose;
+        using storage_type::m_vtable;
+        using storage_type::m_adapter;
+    };
+
+    //
+    //  Accessor which holds its adapter by value rather than type-erased, so
+    //  that calls go directly to the adapter and can be inlined (see
+    //  static_enumerator). It can be moved into an accessor, after which it must
+    //  not be used anymore.
+    //
+    //  Parameters:
+    //      [template] K
+    //          Key type.
+    //      [template] T
+    //          Value type.
+    //      [template] A
+    //          Adapter type (see make_accessor_adapter()).
+    //
+    template <typename K, typename T, typename A>
+    class static_accessor : public boost::noncopyable
+    {
+    public:
+        typedef K key_type;
+        typedef T value_type;
+        typedef A adapter_type;
+        typedef static_accessor<K, T, A> this_type;
+
+        explicit static_accessor(adapter_type&& adapter)
+        : m_adapter(std::move(adapter))
+        {
+        }
+
+        static_accessor(this_type&& rhs)
+        : m_adapter(std::move(rhs.m_adapter))
+        {
+        }
+
+        boost::optional<T&> get(const K& key)
+        {
+            auto value = m_adapter.get(key);
+            if (value)
+            {
+                return boost::optional<T&>(*value);
+            }
+            return boost::none;
         }
-        detail::accessor_adapter_interface<K, T>* m_adapter;
-        char m_storage[internal_storage_size];
+
+        boost::optional<T&> operator[](const K& key)
+        {
+            return get(key);
+        }
+
+        //  See accessor::get_many().
+        size_t get_many(const K* keys, size_t count, T** out)
+        {
+            return detail::get_many_from(m_adapter, keys, count, out);
+        }
+
+        adapter_type& adapter()
+        {
+            return m_adapter;
+        }
+
+    private:
+        adapter_type m_adapter;
     };
 
+    //
+    //  Makes a static_accessor out of the source object, which may be anything
+    //  an accessor can be constructed from.
+    //
+    template <typename K, typename T, typename U>
+    inline auto make_static_accessor(U&& param)
+        -> static_accessor<K, T, typename detail::get_accessor_adapter_type<K, T, U>::type>
+    {
+        return static_accessor<K, T, typename detail::get_accessor_adapter_type<K, T, U>::type>
+            (detail::make_accessor_adapter<K, T>(std::forward<U>(param)));
+    }
+
+    //
+    //  Makes an accessor which caches the values found in the source object,
+    //  for sources where lookups are expensive (e.g. functions decompressing or
+    //  loading the values). The cache keeps the capacity most recently used
+    //  values; keys which are not found are looked up again every time.
+    //
+    //  The value returned by a lookup remains valid until the next lookup of
+    //  the same thread through the accessor, even if lookups of other threads
+    //  evict it from the cache in the meantime, and even if the source only
+    //  keeps the last value it returned. The values held for threads which
+    //  have exited are released when a new thread starts using the accessor.
+    //  Lookups reorder the cache, so an accessor shared between threads needs
+    //  a lock policy other than no_lock; they always take the exclusive side
+    //  of the lock.
+    //
+    //  Example:
+    //      cache_statistics stats;
+    //      auto a = make_caching_accessor<int, image>(&load_image, 64, &stats);
+    //      auto i = a[42];     // loaded
+    //      auto j = a[42];     // cached; stats.hits == 1
+    //
+    //      auto shared = make_caching_accessor<int, image, atomic>(&load_image, 64);
+    //
+    //  Parameters:
+    //      [template] K
+    //          Key type.
+    //      [template] T
+    //          Value type; it must be copy constructible.
+    //      [template] P1
+    //          Lock policy of the accessor (see policy.hpp).
+    //      [in] param
+    //          Source object, which may be anything an accessor can be
+    //          constructed from.
+    //      [in] capacity
+    //          Maximum number of values held by the cache.
+    //      [out] statistics
+    //          If not null, counts the hits, misses and evictions of the cache;
+    //          it must outlive the accessor.
+    //
+    template <typename K, typename T, typename P1 = no_lock, typename U>
+    inline accessor<K, T, P1> make_caching_accessor(U&& param, size_t capacity, cache_statistics* statistics = nullptr)
+    {
+        typedef detail::caching_accessor_adapter<K, T, typename detail::get_accessor_adapter_type<K, T, U>::type> adapter_type;
+        return accessor<K, T, P1>(detail::accessor_adapter_proxy<K, T, adapter_type>
+            (adapter_type(detail::make_accessor_adapter<K, T>(std::forward<U>(param)), capacity, statistics)));
+    }
+
+    //
+    //  Makes an accessor which calls a function once per key and remembers the
+    //  result, for functions which are expensive and which several threads
+    //  may call at once for the same keys. A thread looking up a key which is
+    //  being computed by another thread waits for that result instead of
+    //  computing it again; lookups of other keys proceed in parallel, and
+    //  lookups of keys already computed take no lock at all. The accessor
+    //  should therefore use the no_lock policy (or reader_writer_lock, whose
+    //  shared side it takes).
+    //
+    //  Example:
+    //      auto a = make_memoizing_accessor<std::string, int>(&parse);
+    //      // on any thread:
+    //      auto value = a["42"];
+    //
+    //  Parameters:
+    //      [template] K
+    //          Key type.
+    //      [template] T
+    //          Value type.
+    //      [in] func
+    //          Function called as func(key) and returning a boost::optional;
+    //          it must be safe to call from several threads at once. Its
+    //          results are kept, whether or not the key was found, for as long
+    //          as the accessor exists.
+    //      [in] expected_keys
+    //          Number of keys the accessor is expected to hold; the size of its
+    //          table is fixed, so lookups slow down past this number.
+    //
+    template <typename K, typename T, typename F>
+    inline accessor<K, T> make_memoizing_accessor(F&& func, size_t expected_keys = 1024)
+    {
+        typedef detail::memoizing_accessor_adapter<typename boost::decay<F>::type, K> adapter_type;
+        return accessor<K, T>(detail::accessor_adapter_proxy<K, T, adapter_type>
+            (adapter_type(typename boost::decay<F>::type(std::forward<F>(func)), expected_keys)));
+    }
+
+    //
+    //  Makes an accessor which looks keys up in the source object only if a
+    //  filter over its keys says that they may be present, so that lookups of
+    //  missing keys cost a query of the filter instead of a search of the
+    //  collection (e.g. a walk down a large tree). The filter is usually a
+    //  bloom_filter, kept up to date by the aggregators adding to the
+    //  collection (see make_filtered_aggregator); keys added by other means
+    //  must be inserted into it as well, or they will not be found.
+    //
+    //  Parameters:
+    //      [template] K
+    //          Key type.
+    //      [template] T
+    //          Value type.
+    //      [in] param
+    //          Source object, which may be anything an accessor can be
+    //          constructed from.
+    //      [in] filter
+    //          Filter implementing may_contain(key); it must outlive the
+    //          accessor.
+    //
+    template <typename K, typename T, typename U, typename B>
+    inline accessor<K, T> make_filtered_accessor(U&& param, const B& filter)
+    {
+        typedef detail::filtered_accessor_adapter<typename detail::get_accessor_adapter_type<K, T, U>::type, B> adapter_type;
+        return accessor<K, T>(detail::accessor_adapter_proxy<K, T, adapter_type>
+            (adapter_type(detail::make_accessor_adapter<K, T>(std::forward<U>(param)), filter)));
+    }
+
+    //
+    //  Makes an accessor whose allocations, including any map moved into it,
+    //  come from the given memory resource.
+    //
+    //  Example:
+    //      std::pmr::monotonic_buffer_resource arena;
+    //      auto a = make_accessor<std::string, int>(std::move(m), &arena);
+    //
+    template <typename K, typename T, typename U>
+    inline auto make_accessor(U&& param, memory_resource* resource) -> accessor<K, T, no_lock, pmr_storage>
+    {
+        return accessor<K, T, no_lock, pmr_storage>(std::forward<U>(param), resource);
+    }
+
     //
     //  Makes an implicitly-typed accessor out of the source object.
     //
@@ -11,7 +11,9 @@
 #include <boost/mpl/front.hpp>
 #include <boost/type_traits.hpp>
 
+#include "enumerator.hpp"
 #include "policy.hpp"
+#include "detail/storage.hpp"
 #include "detail/accumulator.hpp"
 
 namespace polymorphic_collections
@@ -24,79 +26,69 @@ namespace polymorphic_collections
     //          Value type held by the collection.
     //      [template] P1, ...
     //          Policies (see policy.hpp)
+    //      [template] S
+    //          Storage policy for the type-erased adapter (see policy.hpp).
     //
-    template <typename T, typename P1 = no_lock>
-    class accumulator : public P1, 
+    template <typename T, typename P1 = no_lock, typename S = default_storage>
+    class accumulator : public P1,
+                        private detail::adapter_storage<detail::accumulator_adapter_vtable<T>, S>,
                         public boost::noncopyable
     {
     public:
         typedef T value_type;
-        typedef accumulator<T, P1> this_type;
+        typedef accumulator<T, P1, S> this_type;
+        typedef S storage_policy;
         typedef P1 lock_policy;
 
         //  Size, in bytes, of the internal storage buffer used to store the
         //  type-erased adapter object, thereby avoiding a heap allocation.
-        static const size_t internal_storage_size = 32 - sizeof(ptrdiff_t);
+        static const size_t internal_storage_size = S::size;
 
         accumulator()
-        : m_adapter(nullptr)
         {
         }
 
         template <typename U>
         accumulator(detail::accumulator_adapter_proxy<T, U>&& adapter)
         {
-            size_t proxy_size = sizeof(adapter);
-            if (proxy_size <= internal_storage_size)
-            {
-                m_adapter = new (m_storage) detail::accumulator_adapter_proxy<T, U>(std::move(adapter));
-            }
-            else
-            {
-                m_adapter = new detail::accumulator_adapter_proxy<T, U>(std::move(adapter));
-            }
+            construct(std::move(adapter));
         }
 
-        template <typename _P1>
-        accumulator(accumulator<T, _P1>&& rhs)
+        template <typename _P1, typename _S>
+        accumulator(accumulator<T, _P1, _S>&& rhs)
         {
-            if (reinterpret_cast<char*>(rhs.m_adapter) == rhs.m_storage)
-            {
-                m_adapter = rhs.m_adapter->move(m_storage);
-            }
-            else
-            {
-                m_adapter = rhs.m_adapter;
-            }
-            rhs.m_adapter = nullptr;
+            move_construct_from(rhs);
         }
 
         template <typename U>
         accumulator(U&& param)
-        : m_adapter(nullptr)
         {
             *this = detail::make_accumulator_adapter_proxy<T>(std::forward<U>(param));
         }
 
+        //
+        //  Constructs the accumulator with a storage policy using a memory resource
+        //  (see resource_storage), which will provide the memory for the adapter
+        //  if it does not fit in the internal buffer.
+        //
+        template <typename U>
+        accumulator(U&& param, memory_resource* resource)
+        {
+            BOOST_STATIC_ASSERT_MSG(S::uses_resource, "The storage policy of the accumulator does not use a memory resource.");
+            this->adopt_resource(resource);
+            construct(detail::make_accumulator_adapter_proxy<T>(std::forward<U>(param)));
+        }
+
         ~accumulator()
         {
             dispose();
         }
 
-        template <typename _P1>
-        this_type& operator=(accumulator<T, _P1>&& rhs)
+        template <typename _P1, typename _S>
+        this_type& operator=(accumulator<T, _P1, _S>&& rhs)
         {
             dispose();
-
-            if (reinterpret_cast<char*>(rhs.m_adapter) == rhs.m_storage)
-            {
-                m_adapter = rhs.m_adapter->move(m_storage);
-            }
-            else
-            {
-                m_adapter = rhs.m_adapter;
-            }
-            rhs.m_adapter = nullptr;
+            move_from(rhs);
             return *this;
         }
 
@@ -104,17 +96,7 @@ namespace polymorphic_collections
         this_type& operator=(detail::accumulator_adapter_proxy<T, U>&& adapter)
         {
             dispose();
-
-            size_t proxy_size = sizeof(adapter);
-            if (proxy_size <= internal_storage_size)
-            {
-                m_adapter = new (m_storage) detail::accumulator_adapter_proxy<T, U>(std::move(adapter));
-            }
-            else
-            {
-                m_adapter = new detail::accumulator_adapter_proxy<T, U>(std::move(adapter));
-            }
-
+            construct(std::move(adapter));
             return *this;
         }
 
@@ -125,7 +107,66 @@ namespace polymorphic_collections
             return *this;
         }
 
-        accumulator<T>& add(const T& value)
+        //  The item is copied directly into the collection if the adapter
+        //  supports it (see emplace()). Items which can be copied byte-wise are
+        //  copied and moved in instead, which costs as much and saves the
+        //  indirect call through the emplacer.
+        this_type& add(const T& value)
+        {
+            return add_copy(value, typename detail::is_bitwise_copyable<T>::type());
+        }
+        
+        this_type& add(T&& value)
+        {
+            add(std::move(value), typename detail::is_combining_policy<lock_policy>::type());
+            return *this;
+        }
+
+        //
+        //  Adds an item constructed from the given arguments. Adapters over
+        //  collections with an emplace_back (or push_back) method construct it
+        //  directly in the collection; other adapters receive an item that was
+        //  constructed once, beforehand.
+        //
+        //  Parameters:
+        //      [in] args
+        //          Arguments of the constructor of T.
+        //
+        template <typename... Args>
+        this_type& emplace(Args&&... args)
+        {
+            auto make = [&]() { return T(std::forward<Args>(args)...); };
+            emplace_impl(detail::emplacer<T>(make), typename detail::is_combining_policy<lock_policy>::type());
+            return *this;
+        }
+
+        this_type& operator+=(const T& value)
+        {
+            return add(value);
+        }
+
+        this_type& operator+=(T&& value)
+        {
+            return add(std::move(value));
+        }
+
+        //
+        //  Adds a range of items, taking the lock only once. Contiguous ranges
+        //  of T (pointers, vector iterators) are handed to the adapter in a
+        //  single call, which for vectors and deques is a range insert; for
+        //  other forward iterators the collection reserves room for the whole
+        //  range first, if it supports it.
+        //
+        //  Parameters:
+        //      [in] begin, end
+        //          Range of items to copy to the collection. It may come from
+        //          the collection itself only if that is a vector and the range
+        //          is contiguous; adding other collections to themselves is
+        //          undefined, as their iterators may be invalidated (or never
+        //          reach end) as items are added.
+        //
+        template <typename I>
+        this_type& add_range(I begin, I end)
         {
             if (lock_policy::lock())
             {
@@ -133,22 +174,109 @@ namespace polymorphic_collections
                 {
                     if (!m_adapter)
                     {
-                        throw std::overflow_error("accumulator::add()");
+                        throw std::overflow_error("accumulator::add_range()");
                     }
-                    T new_value = value;
-                    m_adapter->add(std::move(new_value));
+                    add_range_impl(begin, end, typename detail::is_contiguous_iterator<I, T>::type());
+                }
+                catch (...)
+                {
                     lock_policy::unlock();
+                    throw;
+                }
+                lock_policy::unlock();
+            }
+            return *this;
+        }
+
+        //
+        //  Adds all of the remaining items of an enumerator, taking the lock
+        //  only once. Enumerators over contiguous items are added as a single
+        //  range (see try_contiguous()), other ones by blocks (see next_n()).
+        //
+        //  Parameters:
+        //      [in] items
+        //          Enumerator (or static_enumerator) providing the items; it is
+        //          exhausted on return.
+        //
+        template <typename E>
+        typename boost::enable_if<detail::is_enumerator<E>, this_type&>::type add_range(E& items)
+        {
+            typedef typename E::value_type item_type;
+
+            if (lock_policy::lock())
+            {
+                try
+                {
+                    if (!m_adapter)
+                    {
+                        throw std::overflow_error("accumulator::add_range()");
+                    }
+                    auto range = items.try_contiguous();
+                    if (range)
+                    {
+                        add_range_impl(range->first, range->second,
+                                       typename detail::is_contiguous_iterator<item_type*, T>::type());
+                    }
+                    else
+                    {
+                        item_type* block[64];
+                        size_t count;
+                        while ((count = items.next_n(block, 64)) != 0)
+                        {
+                            for (size_t i = 0; i < count; ++i)
+                            {
+                                T value = *block[i];
+                                m_vtable->add(m_adapter, std::move(value));
+                            }
+                        }
+                    }
                 }
                 catch (...)
                 {
                     lock_policy::unlock();
                     throw;
                 }
+                lock_policy::unlock();
             }
             return *this;
         }
-        
-        accumulator<T>& add(T&& value)
+
+        //
+        //  Moves the items buffered by the adapter, if it buffers them (see
+        //  make_buffered_accumulator), to the underlying collection.
+        //
+        void flush()
+        {
+            if (m_adapter && m_vtable->flush)
+            {
+                if (lock_policy::lock())
+                {
+                    try
+                    {
+                        m_vtable->flush(m_adapter);
+                    }
+                    catch (...)
+                    {
+                        lock_policy::unlock();
+                        throw;
+                    }
+                    lock_policy::unlock();
+                }
+            }
+        }
+
+        //  Memory resource used for heap allocations, or nullptr for the
+        //  global heap.
+        memory_resource* resource() const
+        {
+            return storage_type::resource();
+        }
+
+    private:
+        template <typename U, typename _P1, typename _S>
+        friend class accumulator;
+
+        void add(T&& value, boost::false_type)
         {
             if (lock_policy::lock())
             {
@@ -158,7 +286,7 @@ namespace polymorphic_collections
                     {
                         throw std::overflow_error("accumulator::add()");
                     }
-                    m_adapter->add(std::move(value));
+                    m_vtable->add(m_adapter, std::move(value));
                     lock_policy::unlock();
                 }
                 catch (...)
@@ -167,39 +295,254 @@ namespace polymorphic_collections
                     throw;
                 }
             }
+        }
+
+        template <typename I>
+        void add_range_impl(I begin, I end, boost::true_type)
+        {
+            if (begin != end)
+            {
+                const T* first = &*begin;
+                m_vtable->add_range(m_adapter, first, first + (end - begin));
+            }
+        }
+
+        template <typename I>
+        void add_range_impl(I begin, I end, boost::false_type)
+        {
+            add_items(begin, end, typename std::iterator_traits<I>::iterator_category());
+        }
+
+        template <typename I>
+        void add_items(I begin, I end, std::input_iterator_tag)
+        {
+            for (; begin != end; ++begin)
+            {
+                T value = *begin;
+                m_vtable->add(m_adapter, std::move(value));
+            }
+        }
+
+        template <typename I>
+        void add_items(I begin, I end, std::forward_iterator_tag)
+        {
+            if (m_vtable->reserve)
+            {
+                m_vtable->reserve(m_adapter, std::distance(begin, end));
+            }
+            add_items(begin, end, std::input_iterator_tag());
+        }
+
+        this_type& add_copy(const T& value, boost::true_type)
+        {
+            T copy(value);
+            return add(std::move(copy));
+        }
+
+        this_type& add_copy(const T& value, boost::false_type)
+        {
+            return emplace(value);
+        }
+
+        void emplace_impl(const detail::emplacer<T>& make, boost::false_type)
+        {
+            if (lock_policy::lock())
+            {
+                try
+                {
+                    if (!m_adapter)
+                    {
+                        throw std::overflow_error("accumulator::emplace()");
+                    }
+                    m_vtable->emplace(m_adapter, make);
+                }
+                catch (...)
+                {
+                    lock_policy::unlock();
+                    throw;
+                }
+                lock_policy::unlock();
+            }
+        }
+
+        struct emplace_request
+        {
+            this_type* self;
+            const detail::emplacer<T>* make;
+
+            static void run(void* context)
+            {
+                emplace_request* request = static_cast<emplace_request*>(context);
+                if (!request->self->m_adapter)
+                {
+                    throw std::overflow_error("accumulator::emplace()");
+                }
+                request->self->m_vtable->emplace(request->self->m_adapter, *request->make);
+            }
+        };
+
+        void emplace_impl(const detail::emplacer<T>& make, boost::true_type)
+        {
+            emplace_request request = { this, &make };
+            lock_policy::combine(&emplace_request::run, &request);
+        }
+
+        //  Operation published to a flat_combining policy, which may execute it
+        //  on another thread.
+        struct add_request
+        {
+            this_type* self;
+            T* value;
+
+            static void run(void* context)
+            {
+                add_request* request = static_cast<add_request*>(context);
+                if (!request->self->m_adapter)
+                {
+                    throw std::overflow_error("accumulator::add()");
+                }
+                request->self->m_vtable->add(request->self->m_adapter, std::move(*request->value));
+            }
+        };
+
+        void add(T&& value, boost::true_type)
+        {
+            add_request request = { this, &value };
+            lock_policy::combine(&add_request::run, &request);
+        }
+
+        typedef detail::adapter_storage<detail::accumulator_adapter_vtable<T>, S> storage_type;
+        using storage_type::allocate;
+        using storage_type::deallocate;
+        using storage_type::construct;
+        using storage_type::move_from;
+        using storage_type::move_construct_from;
+        using storage_type::dispose;
+        using storage_type::m_vtable;
+        using storage_type::m_adapter;
+    };
+
+    //
+    //  Accumulator which holds its adapter by value rather than type-erased, so
+    //  that calls go directly to the adapter and can be inlined (see
+    //  static_enumerator). It can be moved into an accumulator, after which it
+    //  must not be used anymore.
+    //
+    //  Parameters:
+    //      [template] T
+    //          Value type.
+    //      [template] A
+    //          Adapter type (see make_accumulator_adapter()).
+    //
+    template <typename T, typename A>
+    class static_accumulator : public boost::noncopyable
+    {
+    public:
+        typedef T value_type;
+        typedef A adapter_type;
+        typedef static_accumulator<T, A> this_type;
+
+        explicit static_accumulator(adapter_type&& adapter)
+        : m_adapter(std::move(adapter))
+        {
+        }
+
+        static_accumulator(this_type&& rhs)
+        : m_adapter(std::move(rhs.m_adapter))
+        {
+        }
+
+        this_type& add(const T& value)
+        {
+            return emplace(value);
+        }
+
+        this_type& add(T&& value)
+        {
+            m_adapter.add(std::move(value));
             return *this;
         }
 
-        accumulator<T>& operator+=(const T& value)
+        //  See accumulator::emplace().
+        template <typename... Args>
+        this_type& emplace(Args&&... args)
+        {
+            auto make = [&]() { return T(std::forward<Args>(args)...); };
+            detail::emplace_item(m_adapter, detail::emplacer<T>(make));
+            return *this;
+        }
+
+        this_type& operator+=(const T& value)
         {
             return add(value);
         }
 
-        accumulator<T>& operator+=(T&& value)
+        this_type& operator+=(T&& value)
         {
             return add(std::move(value));
         }
 
-    private:
-        void dispose()
+        //  See accumulator::add_range().
+        template <typename I>
+        this_type& add_range(I begin, I end)
         {
-            if (m_adapter)
+            detail::add_range_to<T>(m_adapter, begin, end);
+            return *this;
+        }
+
+        template <typename E>
+        typename boost::enable_if<detail::is_enumerator<E>, this_type&>::type add_range(E& items)
+        {
+            typedef typename E::value_type item_type;
+
+            auto range = items.try_contiguous();
+            if (range)
             {
-                if (reinterpret_cast<char*>(m_adapter) == m_storage)
-                {
-                    m_adapter->~accumulator_adapter_interface();
-                }
-                else
+                detail::add_range_to<T>(m_adapter, range->first, range->second);
+            }
+            else
+            {
+                item_type* block[64];
+                size_t count;
+                while ((count = items.next_n(block, 64)) != 0)
                 {
-                    delete m_adapter;
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        T value = *block[i];
+                        m_adapter.add(std::move(value));
+                    }
                 }
-                m_adapter = nullptr;
             }
+            return *this;
         }
-        detail::accumulator_adapter_interface<T>* m_adapter;
-        char m_storage[internal_storage_size];
+
+        //  See accumulator::flush().
+        void flush()
+        {
+            detail::flush_adapter(m_adapter);
+        }
+
+        adapter_type& adapter()
+        {
+            return m_adapter;
+        }
+
+    private:
+        adapter_type m_adapter;
     };
 
+    //
+    //  Makes a static_accumulator out of the source object, which may be
+    //  anything an accumulator can be constructed from.
+    //
+    template <typename T, typename U>
+    inline auto make_static_accumulator(U&& param)
+        -> static_accumulator<T, typename detail::get_accumulator_adapter_type<T, U>::type>
+    {
+        return static_accumulator<T, typename detail::get_accumulator_adapter_type<T, U>::type>
+            (detail::make_accumulator_adapter<T>(std::forward<U>(param)));
+    }
+
     template <typename T, typename U>
     inline auto make_accumulator(U&& param)
         -> accumulator<T>
@@ -207,6 +550,47 @@ namespace polymorphic_collections
         return accumulator<T>(detail::make_accumulator_adapter_proxy<T>(detail::make_accumulator_adapter<T>(std::forward<U>(param))));
     }
 
+    //  Makes an accumulator whose adapter, if it does not fit in the internal
+    //  buffer, is allocated from the given memory resource.
+    template <typename T, typename U>
+    inline auto make_accumulator(U&& param, memory_resource* resource)
+        -> accumulator<T, no_lock, pmr_storage>
+    {
+        return accumulator<T, no_lock, pmr_storage>(std::forward<U>(param), resource);
+    }
+
+    //
+    //  Makes an accumulator which can be shared by several producer threads:
+    //  each thread adds to a buffer of its own, which is moved to the collection
+    //  in one batch when it holds threshold items, when flush() is called, and
+    //  when the accumulator is destroyed. The items of a thread reach the
+    //  collection in the order in which they were added.
+    //
+    //  Example:
+    //      std::vector<Event> events;
+    //      {
+    //          auto sink = make_buffered_accumulator<Event>(events);
+    //          // on each producer thread:
+    //          sink.add(event);
+    //      }
+    //      // all of the events are now in the vector
+    //
+    //  Parameters:
+    //      [template] T
+    //          Accumulator type.
+    //      [in] collection
+    //          Collection implementing a push_back method; vectors and deques
+    //          receive each batch with a single range insert.
+    //      [in] threshold
+    //          Number of items a buffer holds before it is moved.
+    //
+    template <typename T, typename C>
+    inline accumulator<T> make_buffered_accumulator(C& collection, size_t threshold = 256)
+    {
+        return accumulator<T>(detail::accumulator_adapter_proxy<T, detail::buffered_accumulator_adapter<C>>
+            (detail::buffered_accumulator_adapter<C>(collection, threshold)));
+    }
+
     template <typename T>
     inline accumulator<typename std::iterator_traits<T>::value_type> make_accumulator(const T& begin, const T& end)
     {
@@ -6,7 +6,9 @@
 #ifndef POLYMORPHIC_COLLECTIONS_AGGREGATOR_HPP
 #define POLYMORPHIC_COLLECTIONS_AGGREGATOR_HPP
 
+#include "enumerator.hpp"
 #include "policy.hpp"
+#include "detail/storage.hpp"
 #include "detail/aggregator.hpp"
 
 namespace polymorphic_collections
@@ -21,80 +23,70 @@ namespace polymorphic_collections
     //          Value type.
     //      [template] P1, ...
     //          Policies (see policy.hpp)
+    //      [template] S
+    //          Storage policy for the type-erased adapter (see policy.hpp).
     //
-    template <typename K, typename T, typename P1 = no_lock>
+    template <typename K, typename T, typename P1 = no_lock, typename S = default_storage>
     class aggregator : public P1,
+                       private detail::adapter_storage<detail::aggregator_adapter_vtable<K, T>, S>,
                        public boost::noncopyable
     {
     public:
         typedef K key_type;
         typedef T value_type;
-        typedef aggregator<K, T, P1> this_type;
+        typedef aggregator<K, T, P1, S> this_type;
+        typedef S storage_policy;
         typedef P1 lock_policy;
 
         //  Size, in bytes, of the internal storage buffer used to store the
         //  type-erased adapter object, thereby avoiding a heap allocation.
-        static const size_t internal_storage_size = 32 - sizeof(ptrdiff_t);
+        static const size_t internal_storage_size = S::size;
 
         aggregator()
-        : m_adapter(nullptr)
         {
         }
 
         template <typename A>
         aggregator(detail::aggregator_adapter_proxy<K, T, A>&& adapter)
         {
-            size_t proxy_size = sizeof(adapter);
-            if (proxy_size <= internal_storage_size)
-            {
-                m_adapter = new (m_storage) detail::aggregator_adapter_proxy<K, T, A>(std::move(adapter));
-            }
-            else
-            {
-                m_adapter = new detail::aggregator_adapter_proxy<K, T, A>(std::move(adapter));
-            }
+            construct(std::move(adapter));
         }
 
-        template <typename P1_>
-        aggregator(aggregator<K, T, P1_>&& rhs)
+        template <typename P1_, typename S_>
+        aggregator(aggregator<K, T, P1_, S_>&& rhs)
         {
-            if (reinterpret_cast<char*>(rhs.m_adapter) == rhs.m_storage)
-            {
-                m_adapter = rhs.m_adapter->move(m_storage);
-            }
-            else
-            {
-                m_adapter = rhs.m_adapter;
-            }
-            rhs.m_adapter = nullptr;
+            move_construct_from(rhs);
         }
 
         template <typename U>
         aggregator(U&& param)
-        : m_adapter(nullptr)
         {
             *this = detail::make_aggregator_adapter_proxy<K, T>(std::forward<U>(param));
         }
 
+        //
+        //  Constructs the aggregator with a storage policy using a memory resource
+        //  (see resource_storage), which will provide the memory for the adapter
+        //  if it does not fit in the internal buffer.
+        //
+        template <typename U>
+        aggregator(U&& param, memory_resource* resource)
+        {
+            BOOST_STATIC_ASSERT_MSG(S::uses_resource, "The storage policy of the aggregator does not use a memory resource.");
+            this->adopt_resource(resource);
+            construct(detail::make_aggregator_adapter_proxy<K, T>(std::forward<U>(param)));
+        }
+
         ~aggregator()
         {
             dispose();
         }
 
-        template <typename P1_>
-        this_type& operator=(aggregator<K, T, P1_>&& rhs)
+        template <typename P1_, typename S_>
+        this_type& operator=(aggregator<K, T, P1_, S_>&& rhs)
         {
             dispose();
-
-            if (reinterpret_cast<char*>(rhs.m_adapter) == rhs.m_storage)
-            {
-                m_adapter = rhs.m_adapter->move(m_storage);
-            }
-            else
-            {
-                m_adapter = rhs.m_adapter;
-            }
-            rhs.m_adapter = nullptr;
+            move_from(rhs);
             return *this;
         }
 
@@ -102,17 +94,7 @@ namespace polymorphic_collections
         this_type& operator=(detail::aggregator_adapter_proxy<K, T, A>&& adapter)
         {
             dispose();
-
-            size_t proxy_size = sizeof(adapter);
-            if (proxy_size <= internal_storage_size)
-            {
-                m_adapter = new (m_storage) detail::aggregator_adapter_proxy<K, T, A>(std::move(adapter));
-            }
-            else
-            {
-                m_adapter = new detail::aggregator_adapter_proxy<K, T, A>(std::move(adapter));
-            }
-
+            construct(std::move(adapter));
             return *this;
         }
 
@@ -123,31 +105,129 @@ namespace polymorphic_collections
             return *this;
         }
         
-        aggregator<K, T>& add(const K& key, const T& value)
+        //  Values passed as lvalues are copied directly into the collection if
+        //  the adapter supports it (see try_emplace()).
+        this_type& add(const K& key, const T& value)
         {
-            if (lock_policy::lock())
+            return try_emplace(key, value);
+        }
+
+        this_type& add(const K& key, T&& value)
+        {
+            return try_emplace(key, std::move(value));
+        }
+
+        this_type& add(K&& key, const T& value)
+        {
+            return try_emplace(std::move(key), value);
+        }
+
+        this_type& add(K&& key, T&& value)
+        {
+            add(std::move(key), std::move(value), typename detail::is_combining_policy<lock_policy>::type());
+            return *this;
+        }
+
+        //
+        //  Adds an item whose value is constructed from the given arguments.
+        //  Adapters over maps with a try_emplace method construct the value in
+        //  the map, and only if the key is not present yet (in which case the
+        //  item is not added, as with add()); other adapters receive a value
+        //  that was constructed once, beforehand.
+        //
+        //  Parameters:
+        //      [in] key
+        //          Key of the item; copied if it is an lvalue.
+        //      [in] args
+        //          Arguments of the constructor of T.
+        //
+        template <typename K_, typename... Args>
+        this_type& try_emplace(K_&& key, Args&&... args)
+        {
+            K new_key(std::forward<K_>(key));
+            auto make = [&]() { return T(std::forward<Args>(args)...); };
+            try_emplace_impl(std::move(new_key), detail::emplacer<T>(make), typename detail::is_combining_policy<lock_policy>::type());
+            return *this;
+        }
+
+        //
+        //  Adds a batch of key-value pairs, taking the lock only once. Maps
+        //  insert pairs whose keys ascend (e.g. sorted input) with a hint, in
+        //  amortized constant time instead of a full search; hash maps reserve
+        //  room for the whole batch when its size is known (forward iterators).
+        //  Keys which are already present are left untouched, as with add().
+        //
+        //  Parameters:
+        //      [in] begin, end
+        //          Range of pairs (e.g. std::pair<K, T>) whose first and second
+        //          members are of types K and T.
+        //
+        template <typename I>
+        this_type& add_many(I begin, I end)
+        {
+            detail::iterator_pair_reader<K, T, I> reader(begin, end);
+            add_many_impl(detail::pair_source<K, T>(reader, detail::range_size(begin, end)));
+            return *this;
+        }
+
+        //
+        //  Adds all of the remaining pairs of an enumerator, taking the lock
+        //  only once (see add_many(begin, end)).
+        //
+        //  Parameters:
+        //      [in] items
+        //          Enumerator (or static_enumerator) of pairs; it is exhausted on
+        //          return.
+        //
+        template <typename E>
+        typename boost::enable_if<detail::is_enumerator<E>, this_type&>::type add_many(E& items)
+        {
+            auto range = items.try_contiguous();
+            if (range)
             {
-                try
+                return add_many(range->first, range->second);
+            }
+            detail::enumerator_pair_reader<K, T, E> reader(items);
+            add_many_impl(detail::pair_source<K, T>(reader, 0));
+            return *this;
+        }
+
+        //
+        //  Moves the items buffered by the adapter, if it buffers them (see
+        //  make_buffered_aggregator), to the underlying collection.
+        //
+        void flush()
+        {
+            if (m_adapter && m_vtable->flush)
+            {
+                if (lock_policy::lock())
                 {
-                    if (!m_adapter)
+                    try
                     {
-                        throw std::overflow_error("aggregator::add()");
+                        m_vtable->flush(m_adapter);
+                    }
+                    catch (...)
+                    {
+                        lock_policy::unlock();
+                        throw;
                     }
-                    key_type new_key = key;
-                    value_type new_value = value;
-                    m_adapter->add(std::move(new_key), std::move(new_value));
-                }
-                catch (...)
-                {
                     lock_policy::unlock();
-                    throw;
                 }
-                lock_policy::unlock();                
             }
-            return *this;
         }
 
-        aggregator<K, T>& add(const K&  key, T&& value)
+        //  Memory resource used for heap allocations, or nullptr for the
+        //  global heap.
+        memory_resource* resource() const
+        {
+            return storage_type::resource();
+        }
+
+    private:
+        template <typename K_, typename T_, typename P1_, typename S_>
+        friend class aggregator;
+
+        void add(K&& key, T&& value, boost::false_type)
         {
             if (lock_policy::lock())
             {
@@ -157,20 +237,18 @@ namespace polymorphic_collections
                     {
                         throw std::overflow_error("aggregator::add()");
                     }
-                    key_type new_key = key;
-                    m_adapter->add(std::move(new_key), std::move(value));
+                    m_vtable->add(m_adapter, std::move(key), std::move(value));
                 }
                 catch (...)
                 {
                     lock_policy::unlock();
                     throw;
                 }
-                lock_policy::unlock();                
+                lock_policy::unlock();
             }
-            return *this;
         }
 
-        aggregator<K, T>& add(K&& key, const T& value)
+        void add_many_impl(const detail::pair_source<K, T>& items)
         {
             if (lock_policy::lock())
             {
@@ -178,22 +256,20 @@ namespace polymorphic_collections
                 {
                     if (!m_adapter)
                     {
-                        throw std::overflow_error("aggregator::add()");
+                        throw std::overflow_error("aggregator::add_many()");
                     }
-                    value_type new_value = value;
-                    m_adapter->add(std::move(key), std::move(new_value));
+                    m_vtable->add_many(m_adapter, items);
                 }
                 catch (...)
                 {
                     lock_policy::unlock();
                     throw;
                 }
-                lock_policy::unlock();                
+                lock_policy::unlock();
             }
-            return *this;
         }
 
-        aggregator<K, T>& add(K&& key, T&& value)
+        void try_emplace_impl(K&& key, const detail::emplacer<T>& make, boost::false_type)
         {
             if (lock_policy::lock())
             {
@@ -201,39 +277,282 @@ namespace polymorphic_collections
                 {
                     if (!m_adapter)
                     {
-                        throw std::overflow_error("aggregator::add()");
+                        throw std::overflow_error("aggregator::try_emplace()");
                     }
-                    m_adapter->add(std::move(key), std::move(value));
+                    m_vtable->try_emplace(m_adapter, std::move(key), make);
                 }
                 catch (...)
                 {
                     lock_policy::unlock();
                     throw;
                 }
-                lock_policy::unlock(); 
+                lock_policy::unlock();
             }
-            return *this;
         }
 
-    private:
-        void dispose()
+        struct try_emplace_request
         {
-            if (m_adapter)
+            this_type* self;
+            K* key;
+            const detail::emplacer<T>* make;
+
+            static void run(void* context)
             {
-                if (reinterpret_cast<char*>(m_adapter) == m_storage)
+                try_emplace_request* request = static_cast<try_emplace_request*>(context);
+                if (!request->self->m_adapter)
                 {
-                    m_adapter->~aggregator_adapter_interface();
+                    throw std::overflow_error("aggregator::try_emplace()");
                 }
-                else
+                request->self->m_vtable->try_emplace(request->self->m_adapter, std::move(*request->key), *request->make);
+            }
+        };
+
+        void try_emplace_impl(K&& key, const detail::emplacer<T>& make, boost::true_type)
+        {
+            try_emplace_request request = { this, &key, &make };
+            lock_policy::combine(&try_emplace_request::run, &request);
+        }
+
+        //  Operation published to a flat_combining policy, which may execute it
+        //  on another thread.
+        struct add_request
+        {
+            this_type* self;
+            K* key;
+            T* value;
+
+            static void run(void* context)
+            {
+                add_request* request = static_cast<add_request*>(context);
+                if (!request->self->m_adapter)
                 {
-                    delete m_adapter;
+                    throw std::overflow_error("aggregator::add()");
                 }
-                m_adapter = nullptr;
+                request->self->m_vtable->add(request->self->m_adapter, std::move(*request->key), std::move(*request->value));
+            }
+        };
+
+        void add(K&& key, T&& value, boost::true_type)
+        {
+            add_request request = { this, &key, &value };
+            lock_policy::combine(&add_request::run, &request);
+        }
+
+        typedef detail::adapter_storage<detail::aggregator_adapter_vtable<K, T>, S> storage_type;
+        using storage_type::allocate;
+        using storage_type::deallocate;
+        using storage_type::construct;
+        using storage_type::move_from;
+        using storage_type::move_construct_from;
+        using storage_type::dispose;
+        using storage_type::m_vtable;
+        using storage_type::m_adapter;
+    };
+
+    //
+    //  Aggregator which holds its adapter by value rather than type-erased, so
+    //  that calls go directly to the adapter and can be inlined (see
+    //  static_enumerator). It can be moved into an aggregator, after which it
+    //  must not be used anymore.
+    //
+    //  Parameters:
+    //      [template] K
+    //          Key type.
+    //      [template] T
+    //          Value type.
+    //      [template] A
+    //          Adapter type (see make_aggregator_adapter()).
+    //
+    template <typename K, typename T, typename A>
+    class static_aggregator : public boost::noncopyable
+    {
+    public:
+        typedef K key_type;
+        typedef T value_type;
+        typedef A adapter_type;
+        typedef static_aggregator<K, T, A> this_type;
+
+        explicit static_aggregator(adapter_type&& adapter)
+        : m_adapter(std::move(adapter))
+        {
+        }
+
+        static_aggregator(this_type&& rhs)
+        : m_adapter(std::move(rhs.m_adapter))
+        {
+        }
+
+        //  Keys and values passed as lvalues are copied, rvalues are moved.
+        template <typename K_, typename T_>
+        this_type& add(K_&& key, T_&& value)
+        {
+            return try_emplace(std::forward<K_>(key), std::forward<T_>(value));
+        }
+
+        //  See aggregator::try_emplace().
+        template <typename K_, typename... Args>
+        this_type& try_emplace(K_&& key, Args&&... args)
+        {
+            K new_key(std::forward<K_>(key));
+            auto make = [&]() { return T(std::forward<Args>(args)...); };
+            detail::emplace_value(m_adapter, std::move(new_key), detail::emplacer<T>(make));
+            return *this;
+        }
+
+        //  See aggregator::add_many().
+        template <typename I>
+        this_type& add_many(I begin, I end)
+        {
+            detail::iterator_pair_reader<K, T, I> reader(begin, end);
+            detail::add_pairs(m_adapter, detail::pair_source<K, T>(reader, detail::range_size(begin, end)));
+            return *this;
+        }
+
+        template <typename E>
+        typename boost::enable_if<detail::is_enumerator<E>, this_type&>::type add_many(E& items)
+        {
+            auto range = items.try_contiguous();
+            if (range)
+            {
+                return add_many(range->first, range->second);
             }
+            detail::enumerator_pair_reader<K, T, E> reader(items);
+            detail::add_pairs(m_adapter, detail::pair_source<K, T>(reader, 0));
+            return *this;
+        }
+
+        //  See aggregator::flush().
+        void flush()
+        {
+            detail::flush_adapter(m_adapter);
+        }
+
+        adapter_type& adapter()
+        {
+            return m_adapter;
         }
-        detail::aggregator_adapter_interface<K, T>* m_adapter;
-        char m_storage[internal_storage_size];
+
+    private:
+        adapter_type m_adapter;
     };
+
+    //
+    //  Makes an aggregator which merges the values of duplicate keys instead
+    //  of keeping the first one, with a single lookup per item. This turns an
+    //  aggregator into a group-by sink, e.g. for counters:
+    //      std::map<std::string, int> counts;
+    //      auto a = make_merging_aggregator<std::string, int>(counts, std::plus<int>());
+    //      a.add("a", 1).add("b", 1).add("a", 1);   // counts: a = 2, b = 1
+    //
+    //  Parameters:
+    //      [template] K
+    //          Key type.
+    //      [template] T
+    //          Value type.
+    //      [in] collection
+    //          Map (e.g. std::map and std::unordered_map). Maps which also
+    //          implement a locked merge(key, value, merge), such as
+    //          sharded_map, can be shared by several threads.
+    //      [in] merge
+    //          Function called as merge(existing, value) when a key is already
+    //          present; the existing value is replaced by its result.
+    //
+    template <typename K, typename T, typename C, typename F>
+    inline aggregator<K, T> make_merging_aggregator(C& collection, const F& merge)
+    {
+        BOOST_STATIC_ASSERT_MSG((detail::has_key_type<C>::value && detail::has_mapped_type<C>::value),
+                                "Merging aggregators require a map.");
+        return aggregator<K, T>(detail::aggregator_adapter_proxy<K, T, detail::merge_aggregator_adapter<C, F>>
+            (detail::merge_aggregator_adapter<C, F>(collection, merge)));
+    }
+
+    //
+    //  Makes an aggregator which can be shared by many producer threads, and
+    //  which merges the values of duplicate keys (see make_merging_aggregator).
+    //  Each thread adds to a hash table of its own, where duplicate keys are
+    //  combined right away; a table is merged into the map in one batch when it
+    //  holds threshold distinct keys, when flush() is called, and when the
+    //  aggregator is destroyed. This replaces a locked insertion per item by a
+    //  few large merges.
+    //
+    //  Example:
+    //      std::unordered_map<std::string, long> totals;
+    //      {
+    //          auto sink = make_buffered_aggregator<std::string, long>(totals, std::plus<long>());
+    //          // on each producer thread:
+    //          sink.add(metric, 1);
+    //      }
+    //      // all of the counts are now in the map
+    //
+    //  Parameters:
+    //      [template] K
+    //          Key type.
+    //      [template] T
+    //          Value type.
+    //      [in] collection
+    //          Map (e.g. std::map and std::unordered_map).
+    //      [in] merge
+    //          Function called as merge(existing, value) to combine the values
+    //          of a key, both in the tables of the threads and in the map.
+    //      [in] threshold
+    //          Number of distinct keys a table holds before it is merged.
+    //
+    template <typename K, typename T, typename C, typename F>
+    inline aggregator<K, T> make_buffered_aggregator(C& collection, const F& merge, size_t threshold = 4096)
+    {
+        BOOST_STATIC_ASSERT_MSG((detail::has_key_type<C>::value && detail::has_mapped_type<C>::value),
+                                "Buffered aggregators require a map.");
+        return aggregator<K, T>(detail::aggregator_adapter_proxy<K, T, detail::buffered_aggregator_adapter<C, F>>
+            (detail::buffered_aggregator_adapter<C, F>(collection, merge, threshold)));
+    }
+
+    //
+    //  Makes an aggregator which inserts the keys it adds into a filter (e.g. a
+    //  bloom_filter), which accessors made with make_filtered_accessor consult
+    //  before searching the collection. Keys are inserted into the filter
+    //  before the items reach the collection, so a key present in the
+    //  collection is never rejected by the filter.
+    //
+    //  Parameters:
+    //      [template] K
+    //          Key type.
+    //      [template] T
+    //          Value type.
+    //      [in] param
+    //          Source object, which may be anything an aggregator can be
+    //          constructed from.
+    //      [in] filter
+    //          Filter implementing insert(key); it must outlive the aggregator.
+    //
+    template <typename K, typename T, typename U, typename B>
+    inline aggregator<K, T> make_filtered_aggregator(U&& param, B& filter)
+    {
+        typedef detail::filtered_aggregator_adapter<typename detail::get_aggregator_adapter_type<K, T, U>::type, B> adapter_type;
+        return aggregator<K, T>(detail::aggregator_adapter_proxy<K, T, adapter_type>
+            (adapter_type(detail::make_aggregator_adapter<K, T>(std::forward<U>(param)), filter)));
+    }
+
+    //
+    //  Makes an aggregator whose adapter, if it does not fit in the internal
+    //  buffer, is allocated from the given memory resource.
+    //
+    template <typename K, typename T, typename U>
+    inline auto make_aggregator(U&& param, memory_resource* resource) -> aggregator<K, T, no_lock, pmr_storage>
+    {
+        return aggregator<K, T, no_lock, pmr_storage>(std::forward<U>(param), resource);
+    }
+
+    //
+    //  Makes a static_aggregator out of the source object, which may be
+    //  anything an aggregator can be constructed from.
+    //
+    template <typename K, typename T, typename U>
+    inline auto make_static_aggregator(U&& param)
+        -> static_aggregator<K, T, typename detail::get_aggregator_adapter_type<K, T, U>::type>
+    {
+        return static_aggregator<K, T, typename detail::get_aggregator_adapter_type<K, T, U>::type>
+            (detail::make_aggregator_adapter<K, T>(std::forward<U>(param)));
+    }
 }
 
 #endif  // POLYMORPHIC_COLLECTIONS_AGGREGATOR_HPP
@@ -6,87 +6,978 @@
 #ifndef POLYMORPHIC_COLLECTIONS_ALGORITHMS_HPP
 #define POLYMORPHIC_COLLECTIONS_ALGORITHMS_HPP
 
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <numeric>
+
 #include "enumerator.hpp"
+#include "executor.hpp"
+#include "detail/simd.hpp"
 
+//
+//  Algorithms operating on enumerators. They accept both enumerator and
+//  static_enumerator.
+//
+//  When the enumerator exposes contiguous storage (see enumerator::try_contiguous)
+//  the algorithms run directly over the raw range; otherwise items are fetched
+//  in blocks via enumerator::next_n. Either way, algorithms which stop early
+//  (find, find_if) leave the enumerator right after the item they return.
+//
+//  The parallel_* variants split the enumerator (see enumerator::split) into
+//  chunks which are processed on an executor, and combine the per-chunk
+//  results in chunk order so that the outcome does not depend on scheduling.
+//  They always consume the whole enumerator. Enumerators which cannot be
+//  split are processed sequentially on the calling thread.
+//
 namespace polymorphic_collections
 {
-    template <typename T, typename F>
-    inline F for_each(enumerator<T>& e, F func)
+    namespace detail
     {
-        while (e.is_valid())
+        //  Number of items fetched per call to enumerator::next_n.
+        static const size_t algorithm_block_size = 64;
+
+        //  Number of chunks the parallel algorithms aim for per executor thread,
+        //  leaving room for the work-stealing scheduler to balance the load.
+        static const size_t chunks_per_thread = 4;
+
+        //
+        //  Recursively splits an enumerator into consecutive chunks, preserving
+        //  the order of the items.
+        //
+        //  Parameters:
+        //      [in, out] e
+        //          Enumerator to partition. Moved into parts on success and left
+        //          untouched otherwise.
+        //      [out] parts
+        //          Array of at least max_parts enumerators.
+        //      [in] max_parts
+        //          Maximum number of chunks.
+        //
+        //  Returns:
+        //      The number of chunks, or zero if the enumerator cannot be split.
+        //
+        template <typename E, typename T>
+        inline size_t partition(E& e, enumerator<T>* parts, size_t max_parts)
         {
-            func(e.next());
+            enumerator<T> tail;
+            if (max_parts < 2 || !e.split(tail))
+            {
+                return 0;
+            }
+            parts[0] = std::move(e);
+            parts[1] = std::move(tail);
+
+            size_t count = 2;
+            while (count * 2 <= max_parts)
+            {
+                //  Chunk i becomes chunks 2i and 2i + 1; walking backwards ensures
+                //  that a slot is vacated before it is overwritten.
+                for (size_t i = count; i-- > 0; )
+                {
+                    if (i != 0)
+                    {
+                        parts[2 * i] = std::move(parts[i]);
+                    }
+                    parts[2 * i].split(parts[2 * i + 1]);
+                }
+                count *= 2;
+            }
+            return count;
         }
-        return func;
+
+        inline size_t max_chunks(const executor& ex)
+        {
+            return ex.concurrency() * chunks_per_thread;
+        }
+
+        //
+        //  Splits an enumerator into chunks (see partition) and calls
+        //  func(chunk, index) for each of them on the executor, waiting for all
+        //  of the calls to complete.
+        //
+        //  Parameters:
+        //      [in, out] e
+        //          Enumerator to process; left untouched if it cannot be split.
+        //      [in] ex
+        //          Executor running the calls.
+        //      [in] func
+        //          Function called for each chunk, which typically stores its
+        //          result in slot index of an array of max_chunks(ex) results.
+        //
+        //  Returns:
+        //      The number of chunks, or zero if the enumerator cannot be split,
+        //      in which case the caller falls back to the sequential algorithm.
+        //
+        template <typename E, typename F>
+        inline size_t for_each_chunk(E& e, executor& ex, F func)
+        {
+            typedef typename E::value_type T;
+
+            size_t max_parts = max_chunks(ex);
+            std::unique_ptr<enumerator<T>[]> parts(new enumerator<T>[max_parts]);
+            size_t count = partition(e, parts.get(), max_parts);
+            if (count != 0)
+            {
+                ex.for_each_index(count, [&] (size_t i)
+                {
+                    func(parts[i], i);
+                });
+            }
+            return count;
+        }
+
+        //  Return types of the algorithms, which accept both enumerator and
+        //  static_enumerator.
+        template <typename E, typename R>
+        struct enumerator_result : boost::enable_if<is_enumerator<E>, R>
+        {
+        };
+
+        template <typename E, bool = is_enumerator<E>::value>
+        struct enumerator_item
+        {
+        };
+
+        template <typename E>
+        struct enumerator_item<E, true>
+        {
+            typedef boost::optional<typename E::value_type&> type;
+        };
+
+        template <typename E, bool = is_enumerator<E>::value>
+        struct enumerator_item_pair
+        {
+        };
+
+        template <typename E>
+        struct enumerator_item_pair<E, true>
+        {
+            typedef std::pair<boost::optional<typename E::value_type&>,
+                              boost::optional<typename E::value_type&>> type;
+        };
+
+        //  Advances an enumerator whose contiguous range was looked at by find
+        //  past the item found (or to the end).
+        template <typename E, typename T>
+        inline boost::optional<T&> consume_found(E& e, T* begin, T* it, T* end)
+        {
+            if (it != end)
+            {
+                e.try_contiguous(it - begin + 1);
+                return boost::optional<T&>(*it);
+            }
+            e.try_contiguous();
+            return boost::none;
+        }
+
+        //
+        //  Comparisons of raw ranges against a value of type U (or a range of U).
+        //  They use the vectorized kernels when both sides are the same arithmetic
+        //  type, and the standard algorithms otherwise.
+        //
+        template <typename T, typename U>
+        struct use_simd
+            : boost::integral_constant<bool, boost::is_same<typename boost::remove_cv<T>::type,
+                                                            typename boost::remove_cv<U>::type>::value &&
+                                             simd::is_supported<typename boost::remove_cv<T>::type>::value>
+        {
+        };
+
+        template <typename T, typename U>
+        inline size_t count_range(T* first, T* last, const U& value, boost::false_type)
+        {
+            return std::count(first, last, value);
+        }
+
+        template <typename T, typename U>
+        inline T* find_range(T* first, T* last, const U& value, boost::false_type)
+        {
+            return std::find(first, last, value);
+        }
+
+        template <typename T, typename U>
+        inline bool equal_range(T* first, T* last, U* other, boost::false_type)
+        {
+            return std::equal(first, last, other);
+        }
+
+#ifdef POLYMORPHIC_COLLECTIONS_SIMD
+        template <typename T, typename U>
+        inline size_t count_range(T* first, T* last, const U& value, boost::true_type)
+        {
+            return simd::count<U>(first, last, value);
+        }
+
+        template <typename T, typename U>
+        inline T* find_range(T* first, T* last, const U& value, boost::true_type)
+        {
+            return first + (simd::find<U>(first, last, value) - first);
+        }
+
+        template <typename T, typename U>
+        inline bool equal_range(T* first, T* last, U* other, boost::true_type)
+        {
+            return simd::equal<typename boost::remove_cv<T>::type>(first, last, other);
+        }
+#endif
+
+        //
+        //  Folds a raw range into init. For arithmetic types the range is folded
+        //  into four independent accumulators, which breaks the dependency chain
+        //  so that the loop can be pipelined and vectorized (the compiler may not
+        //  reorder floating point operations by itself). This relies on op being
+        //  associative and commutative, as documented for reduce().
+        //
+        template <typename T, typename V, typename F, typename G>
+        inline V reduce_range(T* first, T* last, V init, F op, G transform, boost::true_type)
+        {
+            if (last - first >= 8)
+            {
+                V a0 = transform(first[0]);
+                V a1 = transform(first[1]);
+                V a2 = transform(first[2]);
+                V a3 = transform(first[3]);
+                for (first += 4; last - first >= 4; first += 4)
+                {
+                    a0 = op(a0, transform(first[0]));
+                    a1 = op(a1, transform(first[1]));
+                    a2 = op(a2, transform(first[2]));
+                    a3 = op(a3, transform(first[3]));
+                }
+                init = op(init, op(op(a0, a1), op(a2, a3)));
+            }
+            for (; first != last; ++first)
+            {
+                init = op(init, transform(*first));
+            }
+            return init;
+        }
+
+        template <typename T, typename V, typename F, typename G>
+        inline V reduce_range(T* first, T* last, V init, F op, G transform, boost::false_type)
+        {
+            for (; first != last; ++first)
+            {
+                init = op(init, transform(*first));
+            }
+            return init;
+        }
+
+        struct identity
+        {
+            template <typename T>
+            T& operator()(T& value) const
+            {
+                return value;
+            }
+        };
+
+        template <typename T, typename C>
+        inline T* min_element_range(T* first, T* last, C comp)
+        {
+            return first == last ? nullptr : std::min_element(first, last, comp);
+        }
+
+        template <typename T, typename C>
+        inline T* max_element_range(T* first, T* last, C comp)
+        {
+            return first == last ? nullptr : std::max_element(first, last, comp);
+        }
+
+        struct less
+        {
+            template <typename T, typename U>
+            bool operator()(const T& lhs, const U& rhs) const
+            {
+                return lhs < rhs;
+            }
+        };
     }
 
-    template <typename T>
-    inline boost::optional<T&> find(enumerator<T>& e, const T& value)
+    template <typename E, typename F>
+    inline auto for_each(E& e, F func)
+        -> typename detail::enumerator_result<E, F>::type
     {
-        while (e.is_valid())
+        typedef typename E::value_type T;
+
+        if (auto range = e.try_contiguous())
         {
-            T& ref = e.next();
-            if (ref == value)
+            return std::for_each(range->first, range->second, func);
+        }
+
+        T* block[detail::algorithm_block_size];
+        while (size_t count = e.next_n(block, detail::algorithm_block_size))
+        {
+            for (size_t i = 0; i < count; ++i)
             {
-                return boost::optional<T&>(ref);
+                func(*block[i]);
             }
         }
-        return boost::none;
+        return func;
     }
 
-    template <typename T, typename F>
-    inline boost::optional<T&> find_if(enumerator<T>& e, F pred)
+    template <typename E, typename F>
+    inline auto find_if(E& e, F pred)
+        -> typename detail::enumerator_item<E>::type
     {
-        while (e.is_valid())
+        typedef typename E::value_type T;
+
+        if (auto range = e.try_contiguous(0))
+        {
+            T* it = std::find_if(range->first, range->second, pred);
+            return detail::consume_found(e, range->first, it, range->second);
+        }
+
+        while (auto value = e.next())
         {
-            T& ref = e.next();
-            if (pred(ref))
+            if (pred(*value))
             {
-                return boost::optional<T&>(ref);
+                return value;
             }
         }
         return boost::none;
     }
 
-    template <typename T>
-    inline size_t count(enumerator<T>& e, const T& value)
+    template <typename E, typename U>
+    inline auto find(E& e, const U& value)
+        -> typename detail::enumerator_item<E>::type
     {
+        typedef typename E::value_type T;
+
+        if (auto range = e.try_contiguous(0))
+        {
+            T* it = detail::find_range(range->first, range->second, value, typename detail::use_simd<T, U>::type());
+            return detail::consume_found(e, range->first, it, range->second);
+        }
+
+        return find_if(e, [&] (const T& item) -> bool
+        {
+            return item == value;
+        });
+    }
+
+    template <typename E, typename F>
+    inline auto count_if(E& e, F pred)
+        -> typename detail::enumerator_result<E, size_t>::type
+    {
+        typedef typename E::value_type T;
+
+        if (auto range = e.try_contiguous())
+        {
+            return std::count_if(range->first, range->second, pred);
+        }
+
         size_t result = 0;
-        while (e.is_valid())
+        T* block[detail::algorithm_block_size];
+        while (size_t count = e.next_n(block, detail::algorithm_block_size))
         {
-            if (e.next() == value)
+            for (size_t i = 0; i < count; ++i)
             {
-                ++result;
+                if (pred(*block[i]))
+                {
+                    ++result;
+                }
             }
         }
         return result;
     }
-    
-    template <typename T, typename F>
-    inline size_t count_if(enumerator<T>& e, F pred)
+
+    template <typename E, typename U>
+    inline auto count(E& e, const U& value)
+        -> typename detail::enumerator_result<E, size_t>::type
     {
-        size_t result = 0;
-        while (e.is_valid())
+        typedef typename E::value_type T;
+
+        if (auto range = e.try_contiguous())
+        {
+            return detail::count_range(range->first, range->second, value, typename detail::use_simd<T, U>::type());
+        }
+
+        return count_if(e, [&] (const T& item) -> bool
+        {
+            return item == value;
+        });
+    }
+
+    template <typename E1, typename E2>
+    inline auto equal(E1& lhs, E2& rhs)
+        -> typename boost::enable_if_c<detail::is_enumerator<E1>::value && detail::is_enumerator<E2>::value, bool>::type
+    {
+        typedef typename E1::value_type T;
+        typedef typename E2::value_type U;
+
+        auto lhs_range = lhs.try_contiguous();
+        auto rhs_range = rhs.try_contiguous();
+        if (lhs_range && rhs_range)
         {
-            if (pred(e.next())
+            return lhs_range->second - lhs_range->first == rhs_range->second - rhs_range->first &&
+                   detail::equal_range(lhs_range->first, lhs_range->second, rhs_range->first,
+                                       typename detail::use_simd<T, U>::type());
+        }
+        else if (lhs_range)
+        {
+            for (T* it = lhs_range->first; it != lhs_range->second; ++it)
             {
-                ++result;
+                auto value = rhs.next();
+                if (!value || !(*it == *value))
+                {
+                    return false;
+                }
+            }
+            return !rhs.next();
+        }
+        else if (rhs_range)
+        {
+            for (U* it = rhs_range->first; it != rhs_range->second; ++it)
+            {
+                auto value = lhs.next();
+                if (!value || !(*value == *it))
+                {
+                    return false;
+                }
+            }
+            return !lhs.next();
+        }
+
+        while (true)
+        {
+            auto lhs_value = lhs.next();
+            auto rhs_value = rhs.next();
+            if (!lhs_value || !rhs_value)
+            {
+                return !lhs_value && !rhs_value;
+            }
+            if (!(*lhs_value == *rhs_value))
+            {
+                return false;
             }
         }
-        return result;
     }
 
-    template <typename T>
-    inline bool equal(enumerator<T>& lhs, enumerator<T>& rhs)
+    //
+    //  Parallel algorithms.
+    //
+
+    template <typename E, typename F>
+    inline auto parallel_for_each(E& e, F func, executor& ex)
+        -> typename detail::enumerator_result<E, void>::type
     {
-        while (lhs.is_valid() && rhs.is_valid())
+        typedef typename E::value_type T;
+
+        size_t count = detail::for_each_chunk(e, ex, [&] (enumerator<T>& chunk, size_t)
+        {
+            for_each(chunk, func);
+        });
+        if (count == 0)
         {
-            if (lhs.next() != rhs.next())
+            for_each(e, func);
+        }
+    }
+
+    template <typename E, typename F>
+    inline auto parallel_find_if(E& e, F pred, executor& ex)
+        -> typename detail::enumerator_item<E>::type
+    {
+        typedef typename E::value_type T;
+
+        //  Chunks after the earliest one known to contain a match are skipped.
+        std::vector<T*> results(detail::max_chunks(ex), nullptr);
+        boost::atomic<size_t> first_match(results.size());
+        size_t count = detail::for_each_chunk(e, ex, [&] (enumerator<T>& chunk, size_t i)
+        {
+            if (i > first_match.load(boost::memory_order_relaxed))
             {
-                return false;
+                return;
             }
+            if (auto result = find_if(chunk, pred))
+            {
+                results[i] = boost::addressof(*result);
+                size_t current = first_match.load();
+                while (i < current && !first_match.compare_exchange_weak(current, i))
+                {
+                }
+            }
+        });
+        if (count == 0)
+        {
+            return find_if(e, pred);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (results[i])
+            {
+                return boost::optional<T&>(*results[i]);
+            }
+        }
+        return boost::none;
+    }
+
+    template <typename E, typename U>
+    inline auto parallel_find(E& e, const U& value, executor& ex)
+        -> typename detail::enumerator_item<E>::type
+    {
+        typedef typename E::value_type T;
+
+        return parallel_find_if(e, [&] (const T& item) -> bool
+        {
+            return item == value;
+        }, ex);
+    }
+
+    template <typename E, typename F>
+    inline auto parallel_count_if(E& e, F pred, executor& ex)
+        -> typename detail::enumerator_result<E, size_t>::type
+    {
+        typedef typename E::value_type T;
+
+        std::vector<size_t> results(detail::max_chunks(ex), 0);
+        size_t count = detail::for_each_chunk(e, ex, [&] (enumerator<T>& chunk, size_t i)
+        {
+            results[i] = count_if(chunk, pred);
+        });
+        if (count == 0)
+        {
+            return count_if(e, pred);
         }
-        return !lhs.is_valid() && !rhs.is_valid();
+        return std::accumulate(results.begin(), results.begin() + count, size_t(0));
+    }
+
+    template <typename E, typename U>
+    inline auto parallel_count(E& e, const U& value, executor& ex)
+        -> typename detail::enumerator_result<E, size_t>::type
+    {
+        typedef typename E::value_type T;
+
+        std::vector<size_t> results(detail::max_chunks(ex), 0);
+        size_t count = detail::for_each_chunk(e, ex, [&] (enumerator<T>& chunk, size_t i)
+        {
+            results[i] = polymorphic_collections::count(chunk, value);
+        });
+        if (count == 0)
+        {
+            return polymorphic_collections::count(e, value);
+        }
+        return std::accumulate(results.begin(), results.begin() + count, size_t(0));
+    }
+
+    template <typename E1, typename E2>
+    inline auto parallel_equal(E1& lhs, E2& rhs, executor& ex)
+        -> typename boost::enable_if_c<detail::is_enumerator<E1>::value && detail::is_enumerator<E2>::value, bool>::type
+    {
+        typedef typename E1::value_type T;
+        typedef typename E2::value_type U;
+
+        //  Splitting is deterministic, so two sequences of the same length are
+        //  partitioned at the same positions; if the lengths differ, at least one
+        //  pair of chunks differs in length as well.
+        size_t max_parts = detail::max_chunks(ex);
+        std::unique_ptr<enumerator<T>[]> lhs_parts(new enumerator<T>[max_parts]);
+        size_t count = detail::partition(lhs, lhs_parts.get(), max_parts);
+        if (count == 0)
+        {
+            return equal(lhs, rhs);
+        }
+
+        std::unique_ptr<enumerator<U>[]> rhs_parts(new enumerator<U>[max_parts]);
+        if (detail::partition(rhs, rhs_parts.get(), count) != count)
+        {
+            //  Only the left-hand side could be split; compare its chunks in turn.
+            for (size_t i = 0; i < count; ++i)
+            {
+                while (auto value = lhs_parts[i].next())
+                {
+                    auto other = rhs.next();
+                    if (!other || !(*value == *other))
+                    {
+                        return false;
+                    }
+                }
+            }
+            return !rhs.next();
+        }
+
+        boost::atomic<bool> result(true);
+        ex.for_each_index(count, [&] (size_t i)
+        {
+            if (result.load(boost::memory_order_relaxed) && !equal(lhs_parts[i], rhs_parts[i]))
+            {
+                result.store(false, boost::memory_order_relaxed);
+            }
+        });
+        return result.load();
+    }
+
+    //
+    //  Reductions.
+    //
+    //  As with std::reduce, op must be associative and commutative: items may
+    //  be combined in any grouping, which allows the contiguous fast path and
+    //  the parallel variants to keep several partial results.
+    //
+
+    template <typename E, typename V, typename F, typename G>
+    inline auto transform_reduce(E& e, V init, F op, G transform)
+        -> typename detail::enumerator_result<E, V>::type
+    {
+        typedef typename E::value_type T;
+
+        if (auto range = e.try_contiguous())
+        {
+            typedef boost::integral_constant<bool, boost::is_arithmetic<T>::value &&
+                                                   boost::is_arithmetic<V>::value> is_arithmetic;
+            return detail::reduce_range(range->first, range->second, init, op, transform, is_arithmetic());
+        }
+
+        T* block[detail::algorithm_block_size];
+        while (size_t count = e.next_n(block, detail::algorithm_block_size))
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                init = op(init, transform(*block[i]));
+            }
+        }
+        return init;
+    }
+
+    template <typename E, typename V, typename F>
+    inline auto reduce(E& e, V init, F op)
+        -> typename detail::enumerator_result<E, V>::type
+    {
+        return transform_reduce(e, init, op, detail::identity());
+    }
+
+    template <typename E, typename V>
+    inline auto reduce(E& e, V init)
+        -> typename detail::enumerator_result<E, V>::type
+    {
+        return reduce(e, init, std::plus<V>());
+    }
+
+    //  Returns the first smallest item.
+    template <typename E, typename C>
+    inline auto min_element(E& e, C comp)
+        -> typename detail::enumerator_item<E>::type
+    {
+        typedef typename E::value_type T;
+
+        T* result = nullptr;
+        if (auto range = e.try_contiguous())
+        {
+            result = detail::min_element_range(range->first, range->second, comp);
+        }
+        else
+        {
+            T* block[detail::algorithm_block_size];
+            while (size_t count = e.next_n(block, detail::algorithm_block_size))
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    if (!result || comp(*block[i], *result))
+                    {
+                        result = block[i];
+                    }
+                }
+            }
+        }
+
+        if (result)
+        {
+            return boost::optional<T&>(*result);
+        }
+        return boost::none;
+    }
+
+    template <typename E>
+    inline auto min_element(E& e)
+        -> typename detail::enumerator_item<E>::type
+    {
+        return min_element(e, detail::less());
+    }
+
+    //  Returns the first largest item.
+    template <typename E, typename C>
+    inline auto max_element(E& e, C comp)
+        -> typename detail::enumerator_item<E>::type
+    {
+        typedef typename E::value_type T;
+
+        T* result = nullptr;
+        if (auto range = e.try_contiguous())
+        {
+            result = detail::max_element_range(range->first, range->second, comp);
+        }
+        else
+        {
+            T* block[detail::algorithm_block_size];
+            while (size_t count = e.next_n(block, detail::algorithm_block_size))
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    if (!result || comp(*result, *block[i]))
+                    {
+                        result = block[i];
+                    }
+                }
+            }
+        }
+
+        if (result)
+        {
+            return boost::optional<T&>(*result);
+        }
+        return boost::none;
+    }
+
+    template <typename E>
+    inline auto max_element(E& e)
+        -> typename detail::enumerator_item<E>::type
+    {
+        return max_element(e, detail::less());
+    }
+
+    //  Returns the first smallest and the last largest item, like std::minmax_element.
+    template <typename E, typename C>
+    inline auto minmax(E& e, C comp)
+        -> typename detail::enumerator_item_pair<E>::type
+    {
+        typedef typename E::value_type T;
+
+        T* min = nullptr;
+        T* max = nullptr;
+        if (auto range = e.try_contiguous())
+        {
+            if (range->first != range->second)
+            {
+                auto result = std::minmax_element(range->first, range->second, comp);
+                min = result.first;
+                max = result.second;
+            }
+        }
+        else
+        {
+            T* block[detail::algorithm_block_size];
+            while (size_t count = e.next_n(block, detail::algorithm_block_size))
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    if (!min || comp(*block[i], *min))
+                    {
+                        min = block[i];
+                    }
+                    if (!max || !comp(*block[i], *max))
+                    {
+                        max = block[i];
+                    }
+                }
+            }
+        }
+
+        if (min)
+        {
+            return std::make_pair(boost::optional<T&>(*min), boost::optional<T&>(*max));
+        }
+        return std::make_pair(boost::optional<T&>(), boost::optional<T&>());
+    }
+
+    template <typename E>
+    inline auto minmax(E& e)
+        -> typename detail::enumerator_item_pair<E>::type
+    {
+        return minmax(e, detail::less());
+    }
+
+    namespace detail
+    {
+        //  Reduces a chunk using its first item as the initial value, so that no
+        //  identity element is required; returns nothing for an empty chunk.
+        template <typename V, typename T, typename F, typename G>
+        inline boost::optional<V> reduce_chunk(enumerator<T>& e, F op, G transform)
+        {
+            auto first = e.next();
+            if (!first)
+            {
+                return boost::none;
+            }
+            return transform_reduce(e, V(transform(*first)), op, transform);
+        }
+    }
+
+    template <typename E, typename V, typename F, typename G>
+    inline auto parallel_transform_reduce(E& e, V init, F op, G transform, executor& ex)
+        -> typename detail::enumerator_result<E, V>::type
+    {
+        typedef typename E::value_type T;
+
+        std::vector<boost::optional<V>> results(detail::max_chunks(ex));
+        size_t count = detail::for_each_chunk(e, ex, [&] (enumerator<T>& chunk, size_t i)
+        {
+            results[i] = detail::reduce_chunk<V>(chunk, op, transform);
+        });
+        if (count == 0)
+        {
+            return transform_reduce(e, init, op, transform);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (results[i])
+            {
+                init = op(init, *results[i]);
+            }
+        }
+        return init;
+    }
+
+    template <typename E, typename V, typename F>
+    inline auto parallel_reduce(E& e, V init, F op, executor& ex)
+        -> typename detail::enumerator_result<E, V>::type
+    {
+        return parallel_transform_reduce(e, init, op, detail::identity(), ex);
+    }
+
+    template <typename E, typename V>
+    inline auto parallel_reduce(E& e, V init, executor& ex)
+        -> typename detail::enumerator_result<E, V>::type
+    {
+        return parallel_reduce(e, init, std::plus<V>(), ex);
+    }
+
+    template <typename E, typename C>
+    inline auto parallel_minmax(E& e, C comp, executor& ex)
+        -> typename detail::enumerator_item_pair<E>::type
+    {
+        typedef typename E::value_type T;
+
+        std::vector<std::pair<T*, T*>> results(detail::max_chunks(ex), std::pair<T*, T*>(nullptr, nullptr));
+        size_t count = detail::for_each_chunk(e, ex, [&] (enumerator<T>& chunk, size_t i)
+        {
+            auto result = minmax(chunk, comp);
+            if (result.first)
+            {
+                results[i] = std::make_pair(boost::addressof(*result.first), boost::addressof(*result.second));
+            }
+        });
+        if (count == 0)
+        {
+            return minmax(e, comp);
+        }
+
+        //  Earlier chunks win ties for the minimum and later ones for the maximum.
+        T* min = nullptr;
+        T* max = nullptr;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (results[i].first)
+            {
+                if (!min || comp(*results[i].first, *min))
+                {
+                    min = results[i].first;
+                }
+                if (!max || !comp(*results[i].second, *max))
+                {
+                    max = results[i].second;
+                }
+            }
+        }
+
+        if (min)
+        {
+            return std::make_pair(boost::optional<T&>(*min), boost::optional<T&>(*max));
+        }
+        return std::make_pair(boost::optional<T&>(), boost::optional<T&>());
+    }
+
+    template <typename E>
+    inline auto parallel_minmax(E& e, executor& ex)
+        -> typename detail::enumerator_item_pair<E>::type
+    {
+        return parallel_minmax(e, detail::less(), ex);
+    }
+
+    template <typename E, typename C>
+    inline auto parallel_min_element(E& e, C comp, executor& ex)
+        -> typename detail::enumerator_item<E>::type
+    {
+        typedef typename E::value_type T;
+
+        std::vector<T*> results(detail::max_chunks(ex), nullptr);
+        size_t count = detail::for_each_chunk(e, ex, [&] (enumerator<T>& chunk, size_t i)
+        {
+            if (auto result = min_element(chunk, comp))
+            {
+                results[i] = boost::addressof(*result);
+            }
+        });
+        if (count == 0)
+        {
+            return min_element(e, comp);
+        }
+
+        T* min = nullptr;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (results[i] && (!min || comp(*results[i], *min)))
+            {
+                min = results[i];
+            }
+        }
+
+        if (min)
+        {
+            return boost::optional<T&>(*min);
+        }
+        return boost::none;
+    }
+
+    template <typename E>
+    inline auto parallel_min_element(E& e, executor& ex)
+        -> typename detail::enumerator_item<E>::type
+    {
+        return parallel_min_element(e, detail::less(), ex);
+    }
+
+    template <typename E, typename C>
+    inline auto parallel_max_element(E& e, C comp, executor& ex)
+        -> typename detail::enumerator_item<E>::type
+    {
+        typedef typename E::value_type T;
+
+        std::vector<T*> results(detail::max_chunks(ex), nullptr);
+        size_t count = detail::for_each_chunk(e, ex, [&] (enumerator<T>& chunk, size_t i)
+        {
+            if (auto result = max_element(chunk, comp))
+            {
+                results[i] = boost::addressof(*result);
+            }
+        });
+        if (count == 0)
+        {
+            return max_element(e, comp);
+        }
+
+        T* max = nullptr;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (results[i] && (!max || comp(*max, *results[i])))
+            {
+                max = results[i];
+            }
+        }
+
+        if (max)
+        {
+            return boost::optional<T&>(*max);
+        }
+        return boost::none;
+    }
+
+    template <typename E>
+    inline auto parallel_max_element(E& e, executor& ex)
+        -> typename detail::enumerator_item<E>::type
+    {
+        return parallel_max_element(e, detail::less(), ex);
     }
 }
 
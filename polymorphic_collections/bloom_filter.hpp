@@ -0,0 +1,201 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYMORPHIC_COLLECTIONS_BLOOM_FILTER_HPP
+#define POLYMORPHIC_COLLECTIONS_BLOOM_FILTER_HPP
+
+#include <memory>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/utility.hpp>
+
+#include "policy.hpp"
+#include "detail/common.hpp"
+
+namespace polymorphic_collections
+{
+    //
+    //  Blocked Bloom filter over a set of keys: may_contain() returns false for
+    //  keys which were never inserted, and true for inserted keys as well as
+    //  for a small fraction of the others (about 1% with the default of 12
+    //  bits per key, once expected_keys keys have been inserted).
+    //
+    //  Each key sets one bit in each of the 8 words of a single block, which
+    //  is the size of a cache line, so that a query reads one cache line only.
+    //  Keys cannot be removed; a filter whose keys have changed a lot must be
+    //  cleared and filled again.
+    //
+    //  It is used in front of accessors to answer lookups of missing keys
+    //  without searching the collection (see make_filtered_accessor), and kept
+    //  up to date by aggregators (see make_filtered_aggregator):
+    //      std::map<std::string, int> m;
+    //      bloom_filter<std::string> keys(1000000);
+    //      aggregator<std::string, int> sink = make_filtered_aggregator<std::string, int>(m, keys);
+    //      accessor<std::string, int> lookup = make_filtered_accessor<std::string, int>(m, keys);
+    //
+    //  Insertions and queries are thread-safe. A key is visible to queries
+    //  from other threads once they have synchronized with the inserting
+    //  thread (e.g. through the lock of the collection the key is added to).
+    //
+    //  Parameters:
+    //      [template] K
+    //          Key type.
+    //      [template] H
+    //          Hash function type.
+    //
+    template <typename K, typename H = boost::hash<K>>
+    class bloom_filter : public boost::noncopyable
+    {
+    public:
+        typedef K key_type;
+        typedef H hasher;
+        typedef bloom_filter<K, H> this_type;
+
+        static const size_t words_per_block = 8;
+
+        //
+        //  Parameters:
+        //      [in] expected_keys
+        //          Number of keys the filter is sized for; more keys may be
+        //          inserted, at the cost of more false positives.
+        //      [in] bits_per_key
+        //          Size of the filter per expected key.
+        //      [in] hash
+        //          Hash function.
+        //
+        explicit bloom_filter(size_t expected_keys, size_t bits_per_key = 12, const hasher& hash = hasher())
+        : m_hash(hash),
+          m_count(std::max<size_t>((expected_keys * bits_per_key + block_bits - 1) / block_bits, 1)),
+          m_blocks(allocate_blocks(m_count), block_deleter(m_count))
+        {
+            clear();
+        }
+
+        void insert(const key_type& key)
+        {
+            boost::uint64_t hash = mix(m_hash(key));
+            block& b = m_blocks[block_of(hash)];
+            for (size_t i = 0; i < words_per_block; ++i)
+            {
+                b.words[i].fetch_or(bit_of(hash, i), boost::memory_order_relaxed);
+            }
+        }
+
+        bool may_contain(const key_type& key) const
+        {
+            boost::uint64_t hash = mix(m_hash(key));
+            const block& b = m_blocks[block_of(hash)];
+            for (size_t i = 0; i < words_per_block; ++i)
+            {
+                boost::uint64_t bit = bit_of(hash, i);
+                if ((b.words[i].load(boost::memory_order_relaxed) & bit) != bit)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        //  Removes all of the keys; must not overlap with other calls.
+        void clear()
+        {
+            for (size_t i = 0; i < m_count; ++i)
+            {
+                for (size_t j = 0; j < words_per_block; ++j)
+                {
+                    m_blocks[i].words[j].store(0, boost::memory_order_relaxed);
+                }
+            }
+        }
+
+        //  Size of the filter, in blocks of cache_line_size bytes.
+        size_t block_count() const
+        {
+            return m_count;
+        }
+
+    private:
+        static const size_t block_bits = words_per_block * 64;
+
+        struct alignas(cache_line_size) block
+        {
+            boost::atomic<boost::uint64_t> words[words_per_block];
+        };
+
+        //  The blocks are allocated with detail::allocate_from(), as operator
+        //  new[] does not honour their alignment before C++17.
+        static block* allocate_blocks(size_t count)
+        {
+            block* blocks = static_cast<block*>(detail::allocate_from(nullptr, count * sizeof(block),
+                                                                      boost::alignment_of<block>::value));
+            for (size_t i = 0; i < count; ++i)
+            {
+                new (blocks + i) block;
+            }
+            return blocks;
+        }
+
+        class block_deleter
+        {
+        public:
+            explicit block_deleter(size_t count)
+            : m_count(count)
+            {
+            }
+
+            void operator()(block* blocks) const
+            {
+                for (size_t i = 0; i < m_count; ++i)
+                {
+                    blocks[i].~block();
+                }
+                detail::deallocate_to(nullptr, blocks, m_count * sizeof(block), boost::alignment_of<block>::value);
+            }
+
+        private:
+            size_t m_count;
+        };
+
+        //  Scrambles the hash, since the hashes of integers are the integers
+        //  themselves (finalizer of MurmurHash3).
+        static boost::uint64_t mix(size_t hash)
+        {
+            boost::uint64_t x = static_cast<boost::uint64_t>(hash);
+            x ^= x >> 33;
+            x *= 0xFF51AFD7ED558CCDull;
+            x ^= x >> 33;
+            x *= 0xC4CEB9FE1A85EC53ull;
+            x ^= x >> 33;
+            return x;
+        }
+
+        //  The upper half of the hash selects the block, by multiplication
+        //  rather than modulo.
+        size_t block_of(boost::uint64_t hash) const
+        {
+            return static_cast<size_t>(((hash >> 32) * static_cast<boost::uint64_t>(m_count)) >> 32);
+        }
+
+        //  The lower half of the hash, multiplied by a different odd constant
+        //  for each word, selects the bit of each word.
+        static boost::uint64_t bit_of(boost::uint64_t hash, size_t word)
+        {
+            static const boost::uint32_t salts[words_per_block] =
+            {
+                0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du,
+                0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u
+            };
+            boost::uint32_t x = static_cast<boost::uint32_t>(hash) * salts[word];
+            return static_cast<boost::uint64_t>(1) << (x >> 26);
+        }
+
+        hasher m_hash;
+        size_t m_count;
+        std::unique_ptr<block[], block_deleter> m_blocks;
+    };
+}
+
+#endif  // POLYMORPHIC_COLLECTIONS_BLOOM_FILTER_HPP
@@ -6,14 +6,147 @@
 #ifndef POLYMORPHIC_COLLECTIONS_DETAIL_ACCESSOR_HPP
 #define POLYMORPHIC_COLLECTIONS_DETAIL_ACCESSOR_HPP
 
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <boost/atomic.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "backoff.hpp"
 #include "common.hpp"
 
 namespace polymorphic_collections
 {
+    template <typename K, typename T, typename A>
+    class static_accessor;
+
+    //
+    //  Counters of a caching accessor (see make_caching_accessor). They may be
+    //  read from any thread while the accessor is in use.
+    //
+    struct cache_statistics : public boost::noncopyable
+    {
+        cache_statistics()
+        : hits(0), misses(0), evictions(0)
+        {
+        }
+
+        //  Lookups answered from the cache.
+        boost::atomic<size_t> hits;
+        //  Lookups forwarded to the source, whether or not it found the key.
+        boost::atomic<size_t> misses;
+        //  Values dropped from the cache to make room for another one.
+        boost::atomic<size_t> evictions;
+    };
+
     namespace detail
     {
+        BOOST_MPL_HAS_XXX_TRAIT_DEF(shared_get)
+
+        //
+        //  Identifies accessor adapters whose get() does not modify anything, so
+        //  that it can be called concurrently. Adapters opt in by defining a
+        //  shared_get typedef to boost::true_type.
+        //
+        template <typename A, bool = has_shared_get<A>::value>
+        struct supports_shared_get : boost::false_type
+        {
+        };
+
+        template <typename A>
+        struct supports_shared_get<A, true>
+            : boost::integral_constant<bool, A::shared_get::value>
+        {
+        };
+
+        BOOST_MPL_HAS_XXX_TRAIT_DEF(bulk_get)
+
+        //
+        //  Identifies accessor adapters which look up batches of keys natively,
+        //  through a get_many(const K*, size_t, V**) method. Adapters opt in by
+        //  defining a bulk_get typedef to boost::true_type.
+        //
+        template <typename A, bool = has_bulk_get<A>::value>
+        struct supports_bulk_get : boost::false_type
+        {
+        };
+
+        template <typename A>
+        struct supports_bulk_get<A, true>
+            : boost::integral_constant<bool, A::bulk_get::value>
+        {
+        };
+
+        //
+        //  Looks up a batch of keys in a collection implementing find(), storing
+        //  pointers to the values (or nullptr) in out.
+        //
+        //  For hash maps the keys are processed by groups: the buckets of the
+        //  whole group are computed, then the first node of each bucket is
+        //  prefetched, and only then are the buckets searched. The cache misses
+        //  of the lookups of a group thus overlap instead of following one
+        //  another.
+        //
+        template <typename C, typename K, typename V>
+        inline void find_many(C& collection, const K* keys, size_t count, V** out, boost::true_type)
+        {
+            static const size_t group_size = 16;
+            size_t buckets[group_size];
+            auto equal = collection.key_eq();
+            for (size_t first = 0; first < count; first += group_size)
+            {
+                size_t size = std::min(group_size, count - first);
+                for (size_t i = 0; i < size; ++i)
+                {
+                    buckets[i] = collection.bucket(keys[first + i]);
+                }
+                for (size_t i = 0; i < size; ++i)
+                {
+                    auto it = collection.begin(buckets[i]);
+                    if (it != collection.end(buckets[i]))
+                    {
+                        prefetch(boost::addressof(*it));
+                    }
+                }
+                for (size_t i = 0; i < size; ++i)
+                {
+                    out[first + i] = nullptr;
+                    for (auto it = collection.begin(buckets[i]); it != collection.end(buckets[i]); ++it)
+                    {
+                        if (equal(it->first, keys[first + i]))
+                        {
+                            out[first + i] = boost::addressof(it->second);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        template <typename C, typename K, typename V>
+        inline void find_many(C& collection, const K* keys, size_t count, V** out, boost::false_type)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto it = collection.find(keys[i]);
+                out[i] = it != collection.end() ? boost::addressof(it->second) : nullptr;
+            }
+        }
+
+        template <typename C, typename K, typename V>
+        inline void find_many(C& collection, const K* keys, size_t count, V** out)
+        {
+            find_many(collection, keys, count, out,
+                      boost::integral_constant<bool, has_bucket<C, K>::value && has_hasher<C>::value>());
+        }
+
         //
-        //  Interface used by the accessor to manipulate the underlying adapter.
+        //  Function table used by the accessor to manipulate the underlying
+        //  adapter (see enumerator_adapter_vtable).
         //
         //  Parameters:
         //      [template] K
@@ -21,26 +154,69 @@ namespace polymorphic_collections
         //      [template] T
         //          Value type.
         //
-        template <typename K, typename T> class accessor_adapter_interface
+        template <typename K, typename T>
+        struct accessor_adapter_vtable
         {
-        public:
-            typedef K key_type;
-            typedef T value_type;
-            typedef accessor_adapter_interface<K, T> this_type;
-
-            virtual ~accessor_adapter_interface() = 0;
-            virtual this_type* move(void* ptr) = 0;
-            virtual boost::optional<T&> get(const K& key) = 0;
+            void (*destroy)(void* adapter);
+            void (*relocate)(void* adapter, void* ptr);
+            size_t size;
+            size_t alignment;
+            boost::optional<T&> (*get)(void* adapter, const K& key);
+            //  Looks up a batch of keys (see accessor::get_many()).
+            size_t (*get_many)(void* adapter, const K* keys, size_t count, T** out);
+            //  Whether get() may be called by several threads at once, in which
+            //  case the accessor only takes the shared side of its lock.
+            bool shared_get;
         };
-        
-        template <typename K, typename T>
-        inline accessor_adapter_interface<K, T>::~accessor_adapter_interface()
+
+        //
+        //  Looks up a batch of keys through an adapter (see
+        //  accessor::get_many()); returns the number of keys looked up.
+        //
+        template <typename K, typename T, typename A>
+        inline size_t get_many_from(A& adapter, const K* keys, size_t count, T** out, boost::true_type, boost::true_type)
         {
+            adapter.get_many(keys, count, out);
+            return count;
+        }
+
+        //  The values returned by get() stay where they are, so all of the keys
+        //  can be looked up.
+        template <typename K, typename T, typename A>
+        inline size_t get_many_from(A& adapter, const K* keys, size_t count, T** out, boost::false_type, boost::true_type)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto value = adapter.get(keys[i]);
+                out[i] = value ? boost::addressof(*value) : nullptr;
+            }
+            return count;
+        }
+
+        //  The value returned by get() may be overwritten by the next call
+        //  (e.g. functional adapters), so only one key is looked up.
+        template <typename K, typename T, typename A, typename B>
+        inline size_t get_many_from(A& adapter, const K* keys, size_t count, T** out, B, boost::false_type)
+        {
+            if (count == 0)
+            {
+                return 0;
+            }
+            auto value = adapter.get(keys[0]);
+            out[0] = value ? boost::addressof(*value) : nullptr;
+            return 1;
+        }
+
+        template <typename K, typename T, typename A>
+        inline size_t get_many_from(A& adapter, const K* keys, size_t count, T** out)
+        {
+            return get_many_from(adapter, keys, count, out, typename supports_bulk_get<A>::type(),
+                                 typename supports_shared_get<A>::type());
         }
 
         //
-        //  Proxy class which holds the actual adapter and exposes the interface
-        //  used by the parent accessor.
+        //  Proxy class which holds the actual adapter and implements the function
+        //  table used by the parent accessor.
         //
         //  Parameters:
         //      [template] K
@@ -50,14 +226,16 @@ namespace polymorphic_collections
         //      [template] A
         //          Adapter type.
         //
-        template <typename K, typename T, typename A> class accessor_adapter_proxy : public accessor_adapter_interface<K, T>,
-                                                                                     public boost::noncopyable
+        template <typename K, typename T, typename A> class accessor_adapter_proxy : public boost::noncopyable
         {
         public:
             typedef K key_type;
             typedef T value_type;
             typedef A adapter_type;
             typedef accessor_adapter_proxy<K, T, A> this_type;
+            typedef accessor_adapter_vtable<K, T> vtable_type;
+
+            static const vtable_type vtable;
 
             accessor_adapter_proxy(this_type&& rhs)
             : m_adapter(std::move(rhs.m_adapter))
@@ -68,14 +246,27 @@ namespace polymorphic_collections
             : m_adapter(std::move(adapter))
             {
             }
-            
-            virtual ~accessor_adapter_proxy()
+
+        private:
+            static this_type& self(void* adapter)
             {
+                return *static_cast<this_type*>(adapter);
             }
 
-            virtual boost::optional<value_type&> get(const key_type& key)
+            static void destroy(void* adapter)
             {
-                auto value = m_adapter.get(key);
+                self(adapter).~this_type();
+            }
+
+            static void relocate(void* adapter, void* ptr)
+            {
+                new(ptr) this_type(std::move(self(adapter)));
+                destroy(adapter);
+            }
+
+            static boost::optional<value_type&> get(void* adapter, const key_type& key)
+            {
+                auto value = self(adapter).m_adapter.get(key);
                 if (value)
                 {
                     return boost::optional<value_type&>(*value);
@@ -86,15 +277,26 @@ namespace polymorphic_collections
                 }
             }
 
-            virtual accessor_adapter_interface<key_type, value_type>* move(void* ptr)
+            static size_t get_many(void* adapter, const key_type* keys, size_t count, value_type** out)
             {
-                return new(ptr) this_type(std::move(m_adapter));
+                return get_many_from(self(adapter).m_adapter, keys, count, out);
             }
 
-        private:
             adapter_type m_adapter;
         };
 
+        template <typename K, typename T, typename A>
+        const accessor_adapter_vtable<K, T> accessor_adapter_proxy<K, T, A>::vtable =
+        {
+            &this_type::destroy,
+            is_trivially_relocatable<A>::value ? nullptr : &this_type::relocate,
+            sizeof(this_type),
+            boost::alignment_of<this_type>::value,
+            &this_type::get,
+            &this_type::get_many,
+            supports_shared_get<A>::value
+        };
+
         //
         //  Accessor adapter for types which support a find() method.
         //
@@ -107,6 +309,10 @@ namespace polymorphic_collections
             typedef typename T::mapped_type value_type;
             typedef typename T::key_type key_type;
             typedef find_accessor_adapter<T> this_type;
+            typedef boost::true_type trivially_relocatable;
+            //  find() is const for the standard containers.
+            typedef boost::true_type shared_get;
+            typedef boost::true_type bulk_get;
 
             find_accessor_adapter(collection_type& collection)
             : m_collection(collection)
@@ -128,6 +334,12 @@ namespace polymorphic_collections
                 return boost::none;
             }
 
+            template <typename V>
+            void get_many(const key_type* keys, size_t count, V** out)
+            {
+                find_many(m_collection, keys, count, out);
+            }
+
         private:
             collection_type& m_collection;
         };
@@ -139,7 +351,7 @@ namespace polymorphic_collections
         };
 
         template <typename K, typename T, typename C>
-        inline auto make_accessor_adapter(C& collection)
+        inline auto make_accessor_adapter(C& collection, memory_resource* = nullptr)
             -> typename boost::enable_if<supports_find_accessor_adapter<K, T, C>,
                                          find_accessor_adapter<C>>::type
         {
@@ -147,7 +359,7 @@ namespace polymorphic_collections
         }
 
         template <typename K, typename T, typename C>
-        inline auto make_accessor_adapter(const C& collection)
+        inline auto make_accessor_adapter(const C& collection, memory_resource* = nullptr)
             -> typename boost::enable_if<supports_find_accessor_adapter<K, T, C>,
                                          find_accessor_adapter<const C>>::type
         {
@@ -156,6 +368,8 @@ namespace polymorphic_collections
 
         //
         //  Accessor adapter for embedding collections which support a find() method.
+        //  The collection is allocated from the given memory resource, or from the
+        //  global heap if there is none.
         //
         template <typename T>
         class embedded_find_accessor_adapter : public boost::noncopyable
@@ -166,9 +380,14 @@ namespace polymorphic_collections
             typedef typename T::mapped_type value_type;
             typedef typename T::key_type key_type;
             typedef embedded_find_accessor_adapter<T> this_type;
+            //  The collection is held by a unique_ptr, which does not depend on
+            //  its own address.
+            typedef boost::true_type trivially_relocatable;
+            typedef boost::true_type shared_get;
+            typedef boost::true_type bulk_get;
 
-            embedded_find_accessor_adapter(collection_type&& collection)
-            : m_collection(new collection_type(std::move(collection)))
+            embedded_find_accessor_adapter(collection_type&& collection, memory_resource* resource = nullptr)
+            : m_collection(allocate_unique(resource, std::move(collection)))
             {
             }
 
@@ -187,8 +406,14 @@ namespace polymorphic_collections
                 return boost::none;
             }
 
+            template <typename V>
+            void get_many(const key_type* keys, size_t count, V** out)
+            {
+                find_many(*m_collection, keys, count, out);
+            }
+
         private:
-            std::unique_ptr<collection_type> m_collection;
+            std::unique_ptr<collection_type, resource_deleter<collection_type>> m_collection;
         };
 
         template <typename K, typename T, typename C>
@@ -198,12 +423,12 @@ namespace polymorphic_collections
         };
         
         template <typename K, typename T, typename C>
-        inline auto make_accessor_adapter(C&& collection, typename C::iterator* dummy = nullptr)
+        inline auto make_accessor_adapter(C&& collection, memory_resource* resource = nullptr, typename C::iterator* dummy = nullptr)
             -> typename boost::enable_if<supports_embedded_find_accessor_adapter<K, T, typename boost::remove_reference<C>::type>,
                                          embedded_find_accessor_adapter<typename boost::remove_reference<C>::type>>::type
         {
             // FIXME: the dummy parameter should not be necessary but Visual C++ chokes if it isn't present.
-            return embedded_find_accessor_adapter<typename boost::remove_reference<C>::type>(std::forward<C>(collection));
+            return embedded_find_accessor_adapter<typename boost::remove_reference<C>::type>(std::forward<C>(collection), resource);
         }
 
         //
@@ -259,13 +484,426 @@ namespace polymorphic_collections
         };
 
         template <typename K, typename T, typename F>
-        inline auto make_accessor_adapter(F&& func)
+        inline auto make_accessor_adapter(F&& func, memory_resource* = nullptr)
             -> typename boost::enable_if<supports_functional_accessor_adapter<K, T, typename boost::remove_reference<F>::type>,
                                          functional_accessor_adapter<typename boost::remove_reference<F>::type, K>>::type
         {
             return functional_accessor_adapter<typename boost::remove_reference<F>::type, K>(std::forward<F>(func));
         }
         
+        //  A static_accessor is converted to an accessor by moving its adapter
+        //  into the accessor.
+        template <typename K, typename T, typename K_, typename T_, typename A>
+        inline A make_accessor_adapter(static_accessor<K_, T_, A>&& a, memory_resource* = nullptr)
+        {
+            return std::move(a.adapter());
+        }
+
+        //
+        //  Accessor adapter which caches the values found by another adapter,
+        //  evicting the least recently used value once it holds capacity of
+        //  them. Keys which are not found are not cached.
+        //
+        //  Each value lives in an entry of its own, held by a list ordered by
+        //  recency. The entry returned to a thread is also pinned for that
+        //  thread until its next lookup, so that it survives being evicted by
+        //  the lookups of other threads in the meantime. Since get() reorders
+        //  the list, the adapter does not support shared_get; lookups from
+        //  several threads must be serialized by the lock of the accessor.
+        //
+        //  Parameters:
+        //      [template] K
+        //          Key type.
+        //      [template] T
+        //          Value type.
+        //      [template] A
+        //          Type of the adapter holding the source of the values.
+        //
+        template <typename K, typename T, typename A>
+        class caching_accessor_adapter : public boost::noncopyable
+        {
+        public:
+            typedef K key_type;
+            typedef typename boost::remove_const<T>::type value_type;
+            typedef A adapter_type;
+            typedef caching_accessor_adapter<K, T, A> this_type;
+            typedef boost::true_type trivially_relocatable;
+
+            caching_accessor_adapter(adapter_type&& source, size_t capacity, cache_statistics* statistics)
+            : m_cache(new cache(std::move(source), capacity, statistics))
+            {
+            }
+
+            caching_accessor_adapter(this_type&& rhs)
+            : m_cache(std::move(rhs.m_cache))
+            {
+            }
+
+            boost::optional<value_type&> get(const key_type& key)
+            {
+                cache& c = *m_cache;
+                //  Releases the entry returned by the previous lookup of the
+                //  thread, once this lookup has succeeded.
+                entry_ptr& pin = c.pin_of_thread();
+                auto found = c.index.find(key);
+                if (found != c.index.end())
+                {
+                    c.entries.splice(c.entries.begin(), c.entries, found->second);
+                    count(c.statistics ? &c.statistics->hits : nullptr);
+                    pin = *found->second;
+                    return pin->second;
+                }
+                count(c.statistics ? &c.statistics->misses : nullptr);
+                auto value = c.source.get(key);
+                if (!value)
+                {
+                    pin.reset();
+                    return boost::none;
+                }
+                c.entries.push_front(std::make_shared<entry>(key, *value));
+                try
+                {
+                    c.index.emplace(key, c.entries.begin());
+                }
+                catch (...)
+                {
+                    c.entries.pop_front();
+                    throw;
+                }
+                pin = c.entries.front();
+                if (c.entries.size() > c.capacity)
+                {
+                    c.index.erase(c.entries.back()->first);
+                    c.entries.pop_back();
+                    count(c.statistics ? &c.statistics->evictions : nullptr);
+                }
+                return pin->second;
+            }
+
+        private:
+            typedef std::pair<key_type, value_type> entry;
+            typedef std::shared_ptr<entry> entry_ptr;
+            typedef std::list<entry_ptr> entry_list;
+
+            struct cache
+            {
+                cache(adapter_type&& source_, size_t capacity_, cache_statistics* statistics_)
+                : source(std::move(source_)), capacity(std::max<size_t>(capacity_, 1)), statistics(statistics_)
+                {
+                    index.reserve(capacity + 1);
+                }
+
+                //  Entry pinned for the calling thread. The pins of threads
+                //  which have exited are dropped whenever a new thread shows
+                //  up, so that there are only as many as there are live
+                //  threads, and evicted values do not outlive their readers.
+                entry_ptr& pin_of_thread()
+                {
+                    size_t thread = thread_index();
+                    auto found = pins.find(thread);
+                    if (found == pins.end())
+                    {
+                        for (auto it = pins.begin(); it != pins.end();)
+                        {
+                            it = it->second.owner.expired() ? pins.erase(it) : std::next(it);
+                        }
+                        found = pins.emplace(thread, pin(thread_lifetime())).first;
+                    }
+                    return found->second.entry;
+                }
+
+                //  Entry last returned to a thread.
+                struct pin
+                {
+                    explicit pin(const std::shared_ptr<void>& thread)
+                    : owner(thread)
+                    {
+                    }
+
+                    std::weak_ptr<void> owner;
+                    entry_ptr entry;
+                };
+
+                adapter_type source;
+                size_t capacity;
+                cache_statistics* statistics;
+                entry_list entries;
+                std::unordered_map<key_type, typename entry_list::iterator, boost::hash<key_type>> index;
+                //  Pins by thread_index().
+                std::unordered_map<size_t, pin> pins;
+            };
+
+            //  Lookups are serialized by the lock of the accessor, so the
+            //  counters are updated without a read-modify-write instruction;
+            //  they are atomic so that they can be read from any thread.
+            static void count(boost::atomic<size_t>* counter)
+            {
+                if (counter)
+                {
+                    counter->store(counter->load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+                }
+            }
+
+            std::unique_ptr<cache> m_cache;
+        };
+
+        //
+        //  Accessor adapter which calls a function once per key and keeps its
+        //  results, including the keys it did not find. Concurrent callers for
+        //  a key which is being computed wait for that computation; callers
+        //  for other keys are not held back.
+        //
+        //  The results are kept in a hash table with a fixed number of buckets,
+        //  each a list of nodes published with a compare-and-swap and never
+        //  removed; lookups of computed keys thus take no lock, and the values
+        //  never move. Threads waiting for a computation sleep on one of a few
+        //  condition variables selected by the hash of the key.
+        //
+        //  If the function throws, the exception is passed to its caller and
+        //  the key is computed again by the next caller (or by a waiting one).
+        //
+        //  Parameters:
+        //      [template] F
+        //          Function type; it is called as func(key) concurrently for
+        //          different keys, and returns a boost::optional.
+        //      [template] K
+        //          Key type.
+        //
+        template <typename F, typename K>
+        class memoizing_accessor_adapter : public boost::noncopyable
+        {
+        public:
+            typedef F function_type;
+            typedef K key_type;
+            typedef typename is_callable_1<F, K>::return_type::value_type return_type;
+            typedef typename boost::remove_reference<return_type>::type value_type;
+            typedef memoizing_accessor_adapter<F, K> this_type;
+            typedef boost::true_type trivially_relocatable;
+            typedef boost::true_type shared_get;
+
+            memoizing_accessor_adapter(function_type&& func, size_t expected_keys)
+            : m_table(new table(std::move(func), expected_keys))
+            {
+            }
+
+            memoizing_accessor_adapter(this_type&& rhs)
+            : m_table(std::move(rhs.m_table))
+            {
+            }
+
+            boost::optional<value_type&> get(const key_type& key)
+            {
+                table& t = *m_table;
+                size_t hash = t.hash(key);
+                boost::atomic<node*>& bucket = t.buckets[hash & t.mask];
+                node* n = find(bucket.load(boost::memory_order_acquire), nullptr, key, hash);
+                if (!n)
+                {
+                    n = publish(bucket, key, hash);
+                }
+                for (;;)
+                {
+                    int state = n->state.load(boost::memory_order_acquire);
+                    if (state == ready)
+                    {
+                        return n->value ? boost::optional<value_type&>(*n->value) : boost::none;
+                    }
+                    if (state == idle && n->state.compare_exchange_strong(state, computing, boost::memory_order_acquire))
+                    {
+                        compute(*n);
+                    }
+                    else if (state == computing)
+                    {
+                        waiter& w = t.waiters[hash % waiter_count];
+                        boost::unique_lock<boost::mutex> lock(w.mutex);
+                        while (n->state.load(boost::memory_order_acquire) == computing)
+                        {
+                            w.ready.wait(lock);
+                        }
+                    }
+                }
+            }
+
+        private:
+            //  States of a node.
+            enum { idle, computing, ready };
+
+            static const size_t waiter_count = 64;
+
+            struct node : public boost::noncopyable
+            {
+                node(const key_type& key_, size_t hash_)
+                : key(key_), hash(hash_), next(nullptr), state(computing)
+                {
+                }
+
+                const key_type key;
+                const size_t hash;
+                node* next;
+                boost::atomic<int> state;
+                boost::optional<return_type> value;
+            };
+
+            struct waiter
+            {
+                boost::mutex mutex;
+                boost::condition_variable ready;
+            };
+
+            struct table
+            {
+                table(function_type&& func_, size_t expected_keys)
+                : func(std::move(func_))
+                {
+                    size_t count = 16;
+                    while (count < expected_keys)
+                    {
+                        count *= 2;
+                    }
+                    buckets.reset(new boost::atomic<node*>[count]);
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        buckets[i].store(nullptr, boost::memory_order_relaxed);
+                    }
+                    mask = count - 1;
+                }
+
+                ~table()
+                {
+                    for (size_t i = 0; i <= mask; ++i)
+                    {
+                        node* n = buckets[i].load(boost::memory_order_relaxed);
+                        while (n)
+                        {
+                            node* next = n->next;
+                            delete n;
+                            n = next;
+                        }
+                    }
+                }
+
+                function_type func;
+                boost::hash<key_type> hash;
+                std::unique_ptr<boost::atomic<node*>[]> buckets;
+                size_t mask;
+                waiter waiters[waiter_count];
+            };
+
+            //  Searches the nodes from first up to (excluding) last.
+            static node* find(node* first, node* last, const key_type& key, size_t hash)
+            {
+                for (node* n = first; n != last; n = n->next)
+                {
+                    if (n->hash == hash && n->key == key)
+                    {
+                        return n;
+                    }
+                }
+                return nullptr;
+            }
+
+            //  Adds a node for the key in the computing state, unless another
+            //  thread has added one in the meantime; the node is computed by
+            //  the thread which added it.
+            node* publish(boost::atomic<node*>& bucket, const key_type& key, size_t hash)
+            {
+                std::unique_ptr<node> added(new node(key, hash));
+                node* head = bucket.load(boost::memory_order_acquire);
+                node* searched = nullptr;
+                for (;;)
+                {
+                    if (node* n = find(head, searched, key, hash))
+                    {
+                        return n;
+                    }
+                    searched = head;
+                    added->next = head;
+                    if (bucket.compare_exchange_weak(head, added.get(), boost::memory_order_acq_rel, boost::memory_order_acquire))
+                    {
+                        break;
+                    }
+                }
+                node* n = added.release();
+                compute(*n);
+                return n;
+            }
+
+            void compute(node& n)
+            {
+                int state = ready;
+                try
+                {
+                    n.value = m_table->func(n.key);
+                }
+                catch (...)
+                {
+                    state = idle;
+                    wake(n, state);
+                    throw;
+                }
+                wake(n, state);
+            }
+
+            void wake(node& n, int state)
+            {
+                waiter& w = m_table->waiters[n.hash % waiter_count];
+                {
+                    boost::lock_guard<boost::mutex> lock(w.mutex);
+                    n.state.store(state, boost::memory_order_release);
+                }
+                w.ready.notify_all();
+            }
+
+            std::unique_ptr<table> m_table;
+        };
+
+        //
+        //  Accessor adapter which asks a filter over the keys of the collection
+        //  (e.g. a bloom_filter) before looking a key up in another adapter, so
+        //  that most lookups of missing keys do not search the collection.
+        //
+        //  Parameters:
+        //      [template] A
+        //          Type of the adapter holding the collection.
+        //      [template] B
+        //          Filter type, implementing may_contain(key).
+        //
+        template <typename A, typename B>
+        class filtered_accessor_adapter : public boost::noncopyable
+        {
+        public:
+            typedef A adapter_type;
+            typedef B filter_type;
+            typedef typename A::key_type key_type;
+            typedef decltype(declval<A&>().get(declval<const key_type&>())) result_type;
+            typedef filtered_accessor_adapter<A, B> this_type;
+            typedef typename is_trivially_relocatable<A>::type trivially_relocatable;
+            typedef typename supports_shared_get<A>::type shared_get;
+
+            filtered_accessor_adapter(adapter_type&& source, const filter_type& filter)
+            : m_source(std::move(source)), m_filter(&filter)
+            {
+            }
+
+            filtered_accessor_adapter(this_type&& rhs)
+            : m_source(std::move(rhs.m_source)), m_filter(rhs.m_filter)
+            {
+            }
+
+            result_type get(const key_type& key)
+            {
+                if (!m_filter->may_contain(key))
+                {
+                    return boost::none;
+                }
+                return m_source.get(key);
+            }
+
+        private:
+            adapter_type m_source;
+            const filter_type* m_filter;
+        };
+
         //  FIXME: Visual C++ has issues with decltype resolving to int if template
         //  substitution fails instead of giving an error message; typically this
         //  results in errors much deeper in the template code, which are extremely
@@ -278,11 +916,11 @@ namespace polymorphic_collections
         };
 
         template <typename K, typename T, typename U>
-        inline auto make_accessor_adapter_proxy(U&& param) 
+        inline auto make_accessor_adapter_proxy(U&& param, memory_resource* resource = nullptr) 
             -> accessor_adapter_proxy<K, T, typename get_accessor_adapter_type<K, T, U>::type>
         {
             return accessor_adapter_proxy<K, T, typename get_accessor_adapter_type<K, T, U>::type>
-                (make_accessor_adapter<K, T>(std::forward<U>(param)));
+                (make_accessor_adapter<K, T>(std::forward<U>(param), resource));
         }
         
         /*
@@ -6,47 +6,199 @@
 #ifndef POLYMORPHIC_COLLECTIONS_DETAIL_ACCUMULATOR_HPP
 #define POLYMORPHIC_COLLECTIONS_DETAIL_ACCUMULATOR_HPP
 
+#include <algorithm>
+#include <functional>
+#include <boost/assert.hpp>
+#include <boost/config.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include "common.hpp"
+#include "thread_slots.hpp"
 
 namespace polymorphic_collections
 {
+    template <typename T, typename A>
+    class static_accumulator;
+
     namespace detail
     {
         //
-        //  Interface used by the accumulator to manipulate the underlying adapter.
+        //  Function table used by the accumulator to manipulate the underlying
+        //  adapter (see enumerator_adapter_vtable).
         //
         //  Parameters:
         //      [template] T
         //          Value type.
         //
         template <typename T>
-        class accumulator_adapter_interface
+        struct accumulator_adapter_vtable
         {
-        public:
-            typedef T value_type;
-            typedef accumulator_adapter_interface<T> this_type;
+            void (*destroy)(void* adapter);
+            void (*relocate)(void* adapter, void* ptr);
+            size_t size;
+            size_t alignment;
+            void (*add)(void* adapter, T&& value);
+            //  Adds an item constructed in place, if the adapter supports it.
+            void (*emplace)(void* adapter, const emplacer<T>& make);
+            //  Copies a contiguous range of items to the collection.
+            void (*add_range)(void* adapter, const T* begin, const T* end);
+            //  Makes room for count more items; null if the adapter cannot.
+            void (*reserve)(void* adapter, size_t count);
+            //  Moves buffered items to the collection; null if the adapter does
+            //  not buffer.
+            void (*flush)(void* adapter);
+        };
 
-            virtual ~accumulator_adapter_interface() = 0;
-            virtual void add(value_type&&) = 0;
-            virtual this_type* move(void*) = 0;
+        //
+        //  Identifies accumulator adapters which construct items in place through
+        //  an emplace(const emplacer<T>&) method. Adapters opt in by defining an
+        //  emplacing typedef to boost::true_type; the other ones, as well as the
+        //  items which cannot be constructed from an emplacer (see
+        //  accepts_emplacer), are given an item constructed beforehand.
+        //
+        template <typename A, typename T, bool = has_emplacing<A>::value>
+        struct is_emplacing_accumulator_adapter : boost::false_type
+        {
         };
-        
-        template <typename T>
-        inline accumulator_adapter_interface<T>::~accumulator_adapter_interface()
+
+        template <typename A, typename T>
+        struct is_emplacing_accumulator_adapter<A, T, true>
+            : boost::integral_constant<bool, A::emplacing::value &&
+                                             accepts_emplacer<T>::value &&
+                                             boost::is_same<typename A::value_type, T>::value>
+        {
+        };
+
+        //  Adds the item made by an emplacer to an adapter.
+        template <typename T, typename A>
+        inline void emplace_item(A& adapter, const emplacer<T>& make, boost::true_type)
+        {
+            adapter.emplace(make);
+        }
+
+        template <typename T, typename A>
+        inline void emplace_item(A& adapter, const emplacer<T>& make, boost::false_type)
+        {
+            T value = make;
+            adapter.add(std::move(value));
+        }
+
+        template <typename T, typename A>
+        inline void emplace_item(A& adapter, const emplacer<T>& make)
+        {
+            emplace_item(adapter, make, typename is_emplacing_accumulator_adapter<A, T>::type());
+        }
+
+        //
+        //  Identifies accumulator adapters which add ranges of items natively,
+        //  through add_range(const T*, const T*) and reserve(size_t) methods.
+        //  Adapters opt in by defining a bulk_add typedef to boost::true_type;
+        //  the other ones are given the range one item at a time.
+        //
+        template <typename A, typename T, bool = has_bulk_add<A>::value>
+        struct is_bulk_accumulator_adapter : boost::false_type
+        {
+        };
+
+        template <typename A, typename T>
+        struct is_bulk_accumulator_adapter<A, T, true>
+            : boost::integral_constant<bool, A::bulk_add::value &&
+                                             boost::is_same<typename A::value_type, T>::value>
+        {
+        };
+
+        //
+        //  Identifies iterators over items stored contiguously, which can be
+        //  passed to the add_range entry of the function table as pointers.
+        //
+        template <typename I, typename T>
+        struct is_contiguous_iterator
+        {
+            typedef typename boost::remove_cv<T>::type element_type;
+
+            static const bool value =
+                (boost::is_pointer<I>::value &&
+                 boost::is_same<typename boost::remove_cv<typename boost::remove_pointer<I>::type>::type, element_type>::value) ||
+                (!boost::is_same<element_type, bool>::value &&
+                 (boost::is_same<I, typename std::vector<element_type>::iterator>::value ||
+                  boost::is_same<I, typename std::vector<element_type>::const_iterator>::value));
+
+            typedef boost::integral_constant<bool, value> type;
+        };
+
+        //  Makes room for count more items in the collection of an adapter which
+        //  adds ranges natively; does nothing for other adapters.
+        template <typename A>
+        inline void reserve_in(A& adapter, size_t count, boost::true_type)
+        {
+            adapter.reserve(count);
+        }
+
+        template <typename A>
+        inline void reserve_in(A&, size_t, boost::false_type)
+        {
+        }
+
+        //
+        //  Adds a range of items directly to an adapter, as the static facades
+        //  do (see accumulator::add_range()). Contiguous ranges go to adapters
+        //  which add ranges natively in a single call; for other forward
+        //  iterators such adapters reserve room for the whole range first.
+        //
+        template <typename T, typename A, typename I>
+        inline void add_range_to(A& adapter, I begin, I end, boost::true_type)
+        {
+            if (begin != end)
+            {
+                const T* first = &*begin;
+                adapter.add_range(first, first + (end - begin));
+            }
+        }
+
+        template <typename T, typename A, typename I>
+        inline void add_range_to(A& adapter, I begin, I end, boost::false_type)
+        {
+            add_range_to<T>(adapter, begin, end, typename std::iterator_traits<I>::iterator_category());
+        }
+
+        template <typename T, typename A, typename I>
+        inline void add_range_to(A& adapter, I begin, I end, std::input_iterator_tag)
+        {
+            for (; begin != end; ++begin)
+            {
+                T value = *begin;
+                adapter.add(std::move(value));
+            }
+        }
+
+        template <typename T, typename A, typename I>
+        inline void add_range_to(A& adapter, I begin, I end, std::forward_iterator_tag)
         {
+            reserve_in(adapter, std::distance(begin, end), typename is_bulk_accumulator_adapter<A, T>::type());
+            add_range_to<T>(adapter, begin, end, std::input_iterator_tag());
+        }
+
+        template <typename T, typename A, typename I>
+        inline void add_range_to(A& adapter, I begin, I end)
+        {
+            add_range_to<T>(adapter, begin, end,
+                            boost::integral_constant<bool, is_bulk_accumulator_adapter<A, T>::value &&
+                                                           is_contiguous_iterator<I, T>::value>());
         }
 
         //
         //  Proxy class which holds the actual adapter.
         //
         template <typename T, typename A>
-        class accumulator_adapter_proxy : public accumulator_adapter_interface<T>,
-                                          public boost::noncopyable
+        class accumulator_adapter_proxy : public boost::noncopyable
         {
         public:
             typedef T value_type;
             typedef A adapter_type;
             typedef accumulator_adapter_proxy<T, A> this_type;
+            typedef accumulator_adapter_vtable<T> vtable_type;
+
+            static const vtable_type vtable;
 
             accumulator_adapter_proxy(adapter_type&& adapter)
             : m_adapter(std::move(adapter))
@@ -58,24 +210,214 @@ namespace polymorphic_collections
             {
             }
 
-            virtual ~accumulator_adapter_proxy()
+        private:
+            static this_type& self(void* adapter)
             {
+                return *static_cast<this_type*>(adapter);
             }
 
-            virtual void add(value_type&& value)
+            static void destroy(void* adapter)
             {
-                m_adapter.add(std::move(value));
+                self(adapter).~this_type();
             }
 
-            virtual accumulator_adapter_interface<T>* move(void* ptr)
+            static void relocate(void* adapter, void* ptr)
+            {
+                new(ptr) this_type(std::move(self(adapter)));
+                destroy(adapter);
+            }
+
+            static void add(void* adapter, value_type&& value)
+            {
+                self(adapter).m_adapter.add(std::move(value));
+            }
+
+            static void emplace(void* adapter, const emplacer<value_type>& make)
+            {
+                emplace_item(self(adapter).m_adapter, make);
+            }
+
+            static void add_range(void* adapter, const value_type* begin, const value_type* end)
+            {
+                self(adapter).add_range_impl(begin, end, typename is_bulk_accumulator_adapter<A, T>::type(),
+                                             typename boost::is_copy_constructible<T>::type());
+            }
+
+            void add_range_impl(const value_type* begin, const value_type* end, boost::true_type, boost::true_type)
+            {
+                m_adapter.add_range(begin, end);
+            }
+
+            void add_range_impl(const value_type* begin, const value_type* end, boost::false_type, boost::true_type)
+            {
+                for (; begin != end; ++begin)
+                {
+                    value_type value = *begin;
+                    m_adapter.add(std::move(value));
+                }
+            }
+
+            //  Never called: the accumulator only adds ranges of copyable items.
+            template <typename B>
+            void add_range_impl(const value_type*, const value_type*, B, boost::false_type)
+            {
+            }
+
+            static void reserve(void* adapter, size_t count)
+            {
+                self(adapter).reserve_impl(count, typename is_bulk_accumulator_adapter<A, T>::type());
+            }
+
+            void reserve_impl(size_t count, boost::true_type)
+            {
+                m_adapter.reserve(count);
+            }
+
+            //  Not in the function table.
+            void reserve_impl(size_t, boost::false_type)
+            {
+            }
+
+            static void flush(void* adapter)
+            {
+                self(adapter).flush_impl(typename is_buffered_adapter<A>::type());
+            }
+
+            void flush_impl(boost::true_type)
+            {
+                m_adapter.flush();
+            }
+
+            //  Not in the function table.
+            void flush_impl(boost::false_type)
             {
-                return new(ptr) this_type(std::move(m_adapter));
             }
 
-        private:
             adapter_type m_adapter;
         };
 
+        template <typename T, typename A>
+        const accumulator_adapter_vtable<T> accumulator_adapter_proxy<T, A>::vtable =
+        {
+            &this_type::destroy,
+            is_trivially_relocatable<A>::value ? nullptr : &this_type::relocate,
+            sizeof(this_type),
+            boost::alignment_of<this_type>::value,
+            &this_type::add,
+            &this_type::emplace,
+            &this_type::add_range,
+            is_bulk_accumulator_adapter<A, T>::value ? &this_type::reserve : nullptr,
+            is_buffered_adapter<A>::value ? &this_type::flush : nullptr
+        };
+
+        //  Appends an item to a collection. For vectors the reallocation is kept
+        //  out of line: inlined, it makes the function table entry which adds
+        //  an item save and restore registers on every call, which costs more
+        //  than the common case itself.
+        template <typename C, typename V>
+        inline void push_item(C& collection, V&& value)
+        {
+            collection.push_back(std::forward<V>(value));
+        }
+
+        template <typename T, typename A, typename V>
+        BOOST_NOINLINE void grow_and_push_item(std::vector<T, A>& collection, V&& value)
+        {
+            collection.push_back(std::forward<V>(value));
+        }
+
+        template <typename T, typename A, typename V>
+        inline void push_item(std::vector<T, A>& collection, V&& value)
+        {
+            if (collection.size() < collection.capacity())
+            {
+                collection.push_back(std::forward<V>(value));
+            }
+            else
+            {
+                grow_and_push_item(collection, std::forward<V>(value));
+            }
+        }
+
+        //  Appends a range of items to a collection: with a single range insert
+        //  for vectors and deques, which copy trivially copyable items in one
+        //  block, and one push_back at a time otherwise. Range inserts require
+        //  assignable items.
+        template <typename C, typename I>
+        inline void append_items(C& collection, I begin, I end, boost::false_type)
+        {
+            for (; begin != end; ++begin)
+            {
+                collection.push_back(*begin);
+            }
+        }
+
+        template <typename C, typename I>
+        inline void append_items(C& collection, I begin, I end, boost::true_type)
+        {
+            collection.insert(collection.end(), begin, end);
+        }
+
+        //  Range inserts must not take their items from the vector itself, so
+        //  those are copied out first.
+        template <typename T, typename A>
+        inline void append_items(std::vector<T, A>& collection, const T* begin, const T* end, boost::true_type)
+        {
+            std::less<const T*> less;
+            if (begin != end && !less(begin, collection.data()) && less(begin, collection.data() + collection.size()))
+            {
+                std::vector<T, A> items(begin, end, collection.get_allocator());
+                collection.insert(collection.end(), items.begin(), items.end());
+            }
+            else
+            {
+                collection.insert(collection.end(), begin, end);
+            }
+        }
+
+        template <typename C>
+        struct has_range_insert : boost::false_type
+        {
+        };
+
+        template <typename T, typename A>
+        struct has_range_insert<std::vector<T, A>> : boost::true_type
+        {
+        };
+
+        template <typename T, typename A>
+        struct has_range_insert<std::deque<T, A>> : boost::true_type
+        {
+        };
+
+        template <typename C, typename I>
+        inline void append_items(C& collection, I begin, I end)
+        {
+            typedef typename C::value_type value_type;
+            typedef typename std::iterator_traits<I>::reference reference;
+            append_items(collection, begin, end,
+                         boost::integral_constant<bool, has_range_insert<C>::value &&
+                                                        boost::is_assignable<value_type&, reference>::value>());
+        }
+
+        //  Makes room for count more items in a collection, if it supports it.
+        //  Capacity grows at least geometrically, so that adding many small
+        //  ranges does not reallocate every time.
+        template <typename T, typename A>
+        inline void reserve_items(std::vector<T, A>& collection, size_t count)
+        {
+            size_t needed = collection.size() + count;
+            if (needed > collection.capacity())
+            {
+                collection.reserve(std::max(needed, collection.capacity() * 2));
+            }
+        }
+
+        template <typename C>
+        inline void reserve_items(C&, size_t)
+        {
+        }
+
         //
         //  Accumulator adapter encapsulating a collection implementing a push_back method.
         //
@@ -90,6 +432,9 @@ namespace polymorphic_collections
             typedef C collection_type;
             typedef typename C::value_type value_type;
             typedef push_back_accumulator_adapter<C> this_type;
+            typedef boost::true_type trivially_relocatable;
+            typedef boost::true_type emplacing;
+            typedef boost::true_type bulk_add;
 
             push_back_accumulator_adapter(collection_type& collection)
             : m_collection(collection)
@@ -98,10 +443,35 @@ namespace polymorphic_collections
 
             void add(value_type&& value)
             {
-                m_collection.push_back(std::move(value));
+                push_item(m_collection, std::move(value));
+            }
+
+            void emplace(const emplacer<value_type>& make)
+            {
+                emplace_impl(make, boost::integral_constant<bool, has_emplace_back<C, const emplacer<value_type>&>::value>());
+            }
+
+            void add_range(const value_type* begin, const value_type* end)
+            {
+                append_items(m_collection, begin, end);
+            }
+
+            void reserve(size_t count)
+            {
+                reserve_items(m_collection, count);
             }
 
         private:
+            void emplace_impl(const emplacer<value_type>& make, boost::true_type)
+            {
+                m_collection.emplace_back(make);
+            }
+
+            void emplace_impl(const emplacer<value_type>& make, boost::false_type)
+            {
+                m_collection.push_back(make);
+            }
+
             collection_type& m_collection;
         };
 
@@ -119,6 +489,123 @@ namespace polymorphic_collections
             return push_back_accumulator_adapter<typename boost::remove_reference<C>::type>(std::forward<C>(collection));
         }
 
+        //
+        //  Accumulator adapter which lets several threads add to a collection
+        //  implementing a push_back method without taking a lock for every item.
+        //
+        //  Each thread appends to its own buffer, which is moved to the collection
+        //  in one batch, under a lock, when it reaches the threshold. flush() moves
+        //  all of the buffers, and is called when the adapter is destroyed. The
+        //  items of a given thread reach the collection in the order in which
+        //  they were added; items of different threads are interleaved by batch.
+        //
+        //  The owning accumulator should use the no_lock policy, as the adapter
+        //  synchronizes itself. The collection must not be accessed by other
+        //  means until the buffers are flushed.
+        //
+        //  Parameters:
+        //      [template] C
+        //          Collection type.
+        //
+        template <typename C>
+        class buffered_accumulator_adapter
+        {
+        public:
+            typedef C collection_type;
+            typedef typename C::value_type value_type;
+            typedef buffered_accumulator_adapter<C> this_type;
+            typedef boost::true_type buffered;
+            //  The state is held by a unique_ptr, which does not depend on its
+            //  own address. It is allocated with allocate_unique(), as its
+            //  slots are aligned to cache lines.
+            typedef boost::true_type trivially_relocatable;
+
+            buffered_accumulator_adapter(collection_type& collection, size_t threshold)
+            : m_state(allocate_unique<state>(nullptr, collection, threshold))
+            {
+            }
+
+            buffered_accumulator_adapter(this_type&& rhs)
+            : m_state(std::move(rhs.m_state))
+            {
+            }
+
+            //  Items which cannot be flushed here are lost, as a destructor
+            //  cannot report the error; debug builds stop on it.
+            ~buffered_accumulator_adapter()
+            {
+                if (m_state)
+                {
+                    try
+                    {
+                        flush();
+                    }
+                    catch (...)
+                    {
+                        BOOST_ASSERT_MSG(false, "buffered_accumulator_adapter: items were lost by the final flush.");
+                    }
+                }
+            }
+
+            void add(value_type&& value)
+            {
+                state& st = *m_state;
+                st.buffers.with_own([&](std::vector<value_type>& items)
+                {
+                    items.push_back(std::move(value));
+                    if (items.size() >= st.threshold)
+                    {
+                        merge(items);
+                    }
+                });
+            }
+
+            void flush()
+            {
+                m_state->buffers.for_each([this](std::vector<value_type>& items)
+                {
+                    merge(items);
+                });
+            }
+
+        private:
+            struct state
+            {
+                collection_type& collection;
+                size_t threshold;
+                boost::mutex mutex;
+                thread_slots<std::vector<value_type>> buffers;
+
+                state(collection_type& collection, size_t threshold)
+                : collection(collection), threshold(threshold)
+                {
+                }
+            };
+
+            //  The buffer is cleared even if appending fails part way, as its
+            //  items may have been moved from.
+            void merge(std::vector<value_type>& items)
+            {
+                if (!items.empty())
+                {
+                    try
+                    {
+                        boost::mutex::scoped_lock lock(m_state->mutex);
+                        append_items(m_state->collection, std::make_move_iterator(items.begin()),
+                                     std::make_move_iterator(items.end()));
+                    }
+                    catch (...)
+                    {
+                        items.clear();
+                        throw;
+                    }
+                    items.clear();
+                }
+            }
+
+            std::unique_ptr<state, resource_deleter<state>> m_state;
+        };
+
         //
         //  Accumulator adapter encapsulating two output iterators representing a range.
         //
@@ -129,6 +616,7 @@ namespace polymorphic_collections
             typedef I iterator_type;
             typedef typename std::iterator_traits<iterator_type>::value_type value_type;
             typedef iterator_accumulator_adapter<iterator_type> this_type;
+            typedef typename is_bitwise_copyable<iterator_type>::type trivially_relocatable;
 
             iterator_accumulator_adapter(const iterator_type& begin, const iterator_type& end)
             : m_begin(begin), m_end(end)
@@ -224,6 +712,14 @@ namespace polymorphic_collections
             return functional_accumulator_adapter<T, typename boost::remove_reference<F>::type>(std::forward<F>(func));
         }
 
+        //  A static_accumulator is converted to an accumulator by moving its
+        //  adapter into the accumulator.
+        template <typename T, typename U, typename A>
+        inline A make_accumulator_adapter(static_accumulator<U, A>&& a)
+        {
+            return std::move(a.adapter());
+        }
+
         //  FIXME: Visual C++ has issues with decltype resolving to int if template
         //  substitution fails instead of giving an error message; typically this
         //  results in errors much deeper in the template code, which are extremely
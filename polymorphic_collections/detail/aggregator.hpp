@@ -6,51 +6,275 @@
 #ifndef POLYMORPHIC_COLLECTIONS_DETAIL_AGGREGATOR_HPP
 #define POLYMORPHIC_COLLECTIONS_DETAIL_AGGREGATOR_HPP
 
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+#include <boost/assert.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include "common.hpp"
+#include "open_table.hpp"
+#include "thread_slots.hpp"
 
 namespace polymorphic_collections
 {
+    template <typename K, typename T, typename A>
+    class static_aggregator;
+
     namespace detail
     {
         //
-        //  Interface used by the aggregator to manipulate the underlying adapter.
+        //  Type-erased sequence of key-value pairs, passed through the function
+        //  table so that adapters can add a batch of items in a single call.
+        //  next() refers to the key and value of the following pair, which remain
+        //  valid until the next call, and returns false at the end.
         //
         //  Parameters:
         //      [template] K
         //          Key type.
-        //      [tempalte] T
+        //      [template] T
         //          Value type.
         //
         template <typename K, typename T>
-        class aggregator_adapter_interface
+        class pair_source
         {
         public:
-            typedef K key_type;
-            typedef T value_type;
-            typedef aggregator_adapter_interface<K, T> this_type;
+            template <typename F>
+            pair_source(F& next, size_t size)
+            : m_next(&pair_source::call<F>), m_context(&next), m_size(size)
+            {
+            }
 
-            virtual ~aggregator_adapter_interface() = 0;
-            virtual void add(key_type&&, value_type&&) = 0;
-            virtual this_type* move(void* ptr) = 0;
+            bool next(const K*& key, const T*& value) const
+            {
+                return m_next(m_context, key, value);
+            }
+
+            //  Number of pairs, or 0 if it is not known in advance.
+            size_t size() const
+            {
+                return m_size;
+            }
+
+        private:
+            template <typename F>
+            static bool call(void* next, const K*& key, const T*& value)
+            {
+                return (*static_cast<F*>(next))(key, value);
+            }
+
+            bool (*m_next)(void* next, const K*& key, const T*& value);
+            void* m_context;
+            size_t m_size;
         };
-        
+
+        //
+        //  Functions feeding a pair_source from a range of pairs, or from an
+        //  enumerator of pairs. The iterators are advanced lazily, so that the
+        //  current pair stays valid until the next call.
+        //
+        template <typename K, typename T, typename I>
+        class iterator_pair_reader
+        {
+        public:
+            iterator_pair_reader(I begin, I end)
+            : m_begin(begin), m_end(end), m_started(false)
+            {
+            }
+
+            bool operator()(const K*& key, const T*& value)
+            {
+                if (m_started)
+                {
+                    ++m_begin;
+                }
+                m_started = true;
+                if (m_begin == m_end)
+                {
+                    return false;
+                }
+                key = boost::addressof(m_begin->first);
+                value = boost::addressof(m_begin->second);
+                return true;
+            }
+
+        private:
+            I m_begin, m_end;
+            bool m_started;
+        };
+
+        template <typename K, typename T, typename E>
+        class enumerator_pair_reader
+        {
+        public:
+            explicit enumerator_pair_reader(E& items)
+            : m_items(items)
+            {
+            }
+
+            bool operator()(const K*& key, const T*& value)
+            {
+                auto item = m_items.next();
+                if (!item)
+                {
+                    return false;
+                }
+                key = boost::addressof(item->first);
+                value = boost::addressof(item->second);
+                return true;
+            }
+
+        private:
+            E& m_items;
+        };
+
+        //  Length of a range if it can be computed without consuming it, or 0.
+        template <typename I>
+        inline size_t range_size(I begin, I end, std::input_iterator_tag)
+        {
+            return 0;
+        }
+
+        template <typename I>
+        inline size_t range_size(I begin, I end, std::forward_iterator_tag)
+        {
+            return std::distance(begin, end);
+        }
+
+        template <typename I>
+        inline size_t range_size(I begin, I end)
+        {
+            return range_size(begin, end, typename std::iterator_traits<I>::iterator_category());
+        }
+
+        //
+        //  Function table used by the aggregator to manipulate the underlying
+        //  adapter (see enumerator_adapter_vtable).
+        //
+        //  Parameters:
+        //      [template] K
+        //          Key type.
+        //      [template] T
+        //          Value type.
+        //
         template <typename K, typename T>
-        inline aggregator_adapter_interface<K, T>::~aggregator_adapter_interface()
+        struct aggregator_adapter_vtable
+        {
+            void (*destroy)(void* adapter);
+            void (*relocate)(void* adapter, void* ptr);
+            size_t size;
+            size_t alignment;
+            void (*add)(void* adapter, K&& key, T&& value);
+            //  Adds an item whose value is constructed in place, if the adapter
+            //  supports it, and possibly only if the key is not present yet.
+            void (*try_emplace)(void* adapter, K&& key, const emplacer<T>& make);
+            //  Copies a batch of items to the collection.
+            void (*add_many)(void* adapter, const pair_source<K, T>& items);
+            //  Moves buffered items to the collection; null if the adapter does
+            //  not buffer.
+            void (*flush)(void* adapter);
+        };
+
+        //
+        //  Identifies aggregator adapters which construct values in place through
+        //  a try_emplace(K&&, const emplacer<T>&) method. Adapters opt in by
+        //  defining an emplacing typedef to boost::true_type; the other ones, as
+        //  well as the values which cannot be constructed from an emplacer (see
+        //  accepts_emplacer), are given a value constructed beforehand.
+        //
+        template <typename A, typename K, typename T, bool = has_emplacing<A>::value>
+        struct is_emplacing_aggregator_adapter : boost::false_type
+        {
+        };
+
+        template <typename A, typename K, typename T>
+        struct is_emplacing_aggregator_adapter<A, K, T, true>
+            : boost::integral_constant<bool, A::emplacing::value &&
+                                             accepts_emplacer<T>::value &&
+                                             boost::is_same<typename A::key_type, K>::value &&
+                                             boost::is_same<typename A::value_type, T>::value>
+        {
+        };
+
+        //  Adds a key and the value made by an emplacer to an adapter.
+        template <typename K, typename T, typename A>
+        inline void emplace_value(A& adapter, K&& key, const emplacer<T>& make, boost::true_type)
+        {
+            adapter.try_emplace(std::move(key), make);
+        }
+
+        template <typename K, typename T, typename A>
+        inline void emplace_value(A& adapter, K&& key, const emplacer<T>& make, boost::false_type)
+        {
+            T value = make;
+            adapter.add(std::move(key), std::move(value));
+        }
+
+        template <typename K, typename T, typename A>
+        inline void emplace_value(A& adapter, K&& key, const emplacer<T>& make)
+        {
+            emplace_value(adapter, std::move(key), make, typename is_emplacing_aggregator_adapter<A, K, T>::type());
+        }
+
+        //
+        //  Identifies aggregator adapters which add batches of items natively,
+        //  through an add_many(const pair_source<K, T>&) method. Adapters opt in
+        //  by defining a bulk_add typedef to boost::true_type; the other ones are
+        //  given copies of the items one at a time.
+        //
+        template <typename A, typename K, typename T, bool = has_bulk_add<A>::value>
+        struct is_bulk_aggregator_adapter : boost::false_type
+        {
+        };
+
+        template <typename A, typename K, typename T>
+        struct is_bulk_aggregator_adapter<A, K, T, true>
+            : boost::integral_constant<bool, A::bulk_add::value &&
+                                             boost::is_same<typename A::key_type, K>::value &&
+                                             boost::is_same<typename A::value_type, T>::value>
         {
+        };
+
+        //  Adds a batch of items to an adapter.
+        template <typename K, typename T, typename A>
+        inline void add_pairs(A& adapter, const pair_source<K, T>& items, boost::true_type)
+        {
+            adapter.add_many(items);
+        }
+
+        template <typename K, typename T, typename A>
+        inline void add_pairs(A& adapter, const pair_source<K, T>& items, boost::false_type)
+        {
+            const K* key;
+            const T* value;
+            while (items.next(key, value))
+            {
+                K new_key = *key;
+                T new_value = *value;
+                adapter.add(std::move(new_key), std::move(new_value));
+            }
+        }
+
+        template <typename K, typename T, typename A>
+        inline void add_pairs(A& adapter, const pair_source<K, T>& items)
+        {
+            add_pairs(adapter, items, typename is_bulk_aggregator_adapter<A, K, T>::type());
         }
 
         //
         //  Proxy class which holds the actual adapter.
         //
         template <typename K, typename T, typename A>
-        class aggregator_adapter_proxy : public aggregator_adapter_interface<K, T>,
-                                         public boost::noncopyable
+        class aggregator_adapter_proxy : public boost::noncopyable
         {
         public:
             typedef K key_type;
             typedef T value_type;
             typedef A adapter_type;
             typedef aggregator_adapter_proxy<K, T, A> this_type;
+            typedef aggregator_adapter_vtable<K, T> vtable_type;
+
+            static const vtable_type vtable;
 
             aggregator_adapter_proxy(adapter_type&& adapter)
             : m_adapter(std::move(adapter))
@@ -62,24 +286,221 @@ namespace polymorphic_collections
             {
             }
 
-            virtual ~aggregator_adapter_proxy()
+        private:
+            static this_type& self(void* adapter)
+            {
+                return *static_cast<this_type*>(adapter);
+            }
+
+            static void destroy(void* adapter)
             {
+                self(adapter).~this_type();
             }
 
-            virtual void add(key_type&& key, value_type&& value)
+            static void relocate(void* adapter, void* ptr)
             {
-                m_adapter.add(std::move(key), std::move(value));
+                new(ptr) this_type(std::move(self(adapter)));
+                destroy(adapter);
             }
 
-            virtual aggregator_adapter_interface<K, T>* move(void* ptr)
+            static void add(void* adapter, key_type&& key, value_type&& value)
+            {
+                self(adapter).m_adapter.add(std::move(key), std::move(value));
+            }
+
+            static void try_emplace(void* adapter, key_type&& key, const emplacer<value_type>& make)
+            {
+                emplace_value(self(adapter).m_adapter, std::move(key), make);
+            }
+
+            static void add_many(void* adapter, const pair_source<key_type, value_type>& items)
+            {
+                add_pairs(self(adapter).m_adapter, items);
+            }
+
+            static void flush(void* adapter)
+            {
+                self(adapter).flush_impl(typename is_buffered_adapter<A>::type());
+            }
+
+            void flush_impl(boost::true_type)
+            {
+                m_adapter.flush();
+            }
+
+            //  Not in the function table.
+            void flush_impl(boost::false_type)
             {
-                return new(ptr) this_type(std::move(m_adapter));
             }
 
-        private:
             adapter_type m_adapter;
         };
 
+        template <typename K, typename T, typename A>
+        const aggregator_adapter_vtable<K, T> aggregator_adapter_proxy<K, T, A>::vtable =
+        {
+            &this_type::destroy,
+            is_trivially_relocatable<A>::value ? nullptr : &this_type::relocate,
+            sizeof(this_type),
+            boost::alignment_of<this_type>::value,
+            &this_type::add,
+            &this_type::try_emplace,
+            &this_type::add_many,
+            is_buffered_adapter<A>::value ? &this_type::flush : nullptr
+        };
+
+        //  Hash function of a collection: its own for hash maps, boost::hash
+        //  otherwise.
+        template <typename C, bool = has_hasher<C>::value>
+        struct hash_of
+        {
+            typedef boost::hash<typename C::key_type> type;
+        };
+
+        template <typename C>
+        struct hash_of<C, true>
+        {
+            typedef typename C::hasher type;
+        };
+
+        //  Makes room for count more items in a hash map; does nothing for other
+        //  collections, or if count is 0 (unknown).
+        template <typename C>
+        inline void reserve_pairs(C& collection, size_t count, boost::true_type)
+        {
+            if (count != 0)
+            {
+                collection.reserve(collection.size() + count);
+            }
+        }
+
+        template <typename C>
+        inline void reserve_pairs(C&, size_t, boost::false_type)
+        {
+        }
+
+        template <typename C>
+        inline void reserve_pairs(C& collection, size_t count)
+        {
+            reserve_pairs(collection, count, boost::integral_constant<bool, has_hasher<C>::value>());
+        }
+
+        //
+        //  Inserts a batch of items into a collection. Ordered maps insert each
+        //  item with a hint just after the previous one, which takes amortized
+        //  constant time when the keys ascend (e.g. sorted input appended to the
+        //  map) and falls back to a regular search otherwise. Hash maps reserve
+        //  room for the whole batch first, if its size is known.
+        //
+        template <typename C, typename K, typename T>
+        inline void insert_items(C& collection, const pair_source<K, T>& items, boost::true_type, boost::false_type)
+        {
+            const K* key;
+            const T* value;
+            auto hint = collection.end();
+            while (items.next(key, value))
+            {
+                hint = collection.emplace_hint(hint, *key, *value);
+                ++hint;
+            }
+        }
+
+        template <typename C, typename K, typename T>
+        inline void insert_items(C& collection, const pair_source<K, T>& items, boost::false_type, boost::true_type)
+        {
+            reserve_pairs(collection, items.size());
+            insert_items(collection, items, boost::false_type(), boost::false_type());
+        }
+
+        template <typename C, typename K, typename T>
+        inline void insert_items(C& collection, const pair_source<K, T>& items, boost::false_type, boost::false_type)
+        {
+            typedef typename C::value_type pair_type;
+            const K* key;
+            const T* value;
+            while (items.next(key, value))
+            {
+                collection.insert(pair_type(*key, *value));
+            }
+        }
+
+        template <typename C, typename K, typename T>
+        inline void insert_items(C& collection, const pair_source<K, T>& items)
+        {
+            insert_items(collection, items, boost::integral_constant<bool, has_key_compare<C>::value>(),
+                         boost::integral_constant<bool, has_hasher<C>::value>());
+        }
+
+        //
+        //  Inserts the value for a key, constructed from value, if the key is not
+        //  present yet; otherwise value is left untouched. Returns an iterator to
+        //  the element of the key, and whether it was inserted. Maps without a
+        //  try_emplace() method (the standard maps before C++17) are searched
+        //  before the value is emplaced.
+        //
+        template <typename C, typename K, typename V>
+        inline std::pair<typename C::iterator, bool> try_emplace_into(C& collection, K&& key, V&& value, boost::true_type)
+        {
+            return collection.try_emplace(std::forward<K>(key), std::forward<V>(value));
+        }
+
+        template <typename C, typename K, typename V>
+        inline std::pair<typename C::iterator, bool> try_emplace_into(C& collection, K&& key, V&& value, boost::false_type)
+        {
+            auto it = collection.find(key);
+            if (it != collection.end())
+            {
+                return std::make_pair(it, false);
+            }
+            return collection.emplace(std::piecewise_construct,
+                                      std::forward_as_tuple(std::forward<K>(key)),
+                                      std::forward_as_tuple(std::forward<V>(value)));
+        }
+
+        template <typename C, typename K, typename V>
+        inline std::pair<typename C::iterator, bool> try_emplace_into(C& collection, K&& key, V&& value)
+        {
+            return try_emplace_into(collection, std::forward<K>(key), std::forward<V>(value),
+                                    boost::integral_constant<bool, has_try_emplace<C, K, V>::value>());
+        }
+
+        //
+        //  Same as above for ordered maps, with a hint to the position just
+        //  after the element of the key. Without try_emplace(), the hint is
+        //  only used if the key belongs right before it, which is the case when
+        //  ascending keys are inserted one after another.
+        //
+        template <typename C, typename K, typename V>
+        inline typename C::iterator try_emplace_into(C& collection, typename C::iterator hint, K&& key, V&& value, boost::true_type)
+        {
+            return collection.try_emplace(hint, std::forward<K>(key), std::forward<V>(value));
+        }
+
+        template <typename C, typename K, typename V>
+        inline typename C::iterator try_emplace_into(C& collection, typename C::iterator hint, K&& key, V&& value, boost::false_type)
+        {
+            auto compare = collection.key_comp();
+            if ((hint != collection.end() && !compare(key, hint->first)) ||
+                (hint != collection.begin() && !compare(std::prev(hint)->first, key)))
+            {
+                hint = collection.lower_bound(key);
+                if (hint != collection.end() && !compare(key, hint->first))
+                {
+                    return hint;
+                }
+            }
+            return collection.emplace_hint(hint, std::piecewise_construct,
+                                           std::forward_as_tuple(std::forward<K>(key)),
+                                           std::forward_as_tuple(std::forward<V>(value)));
+        }
+
+        template <typename C, typename K, typename V>
+        inline typename C::iterator try_emplace_into(C& collection, typename C::iterator hint, K&& key, V&& value)
+        {
+            return try_emplace_into(collection, hint, std::forward<K>(key), std::forward<V>(value),
+                                    boost::integral_constant<bool, has_try_emplace<C, K, V>::value>());
+        }
+
         //
         //  Aggregator adapter encapsulating a collection implementing an insert() method.
         //
@@ -96,6 +517,9 @@ namespace polymorphic_collections
             typedef typename T::mapped_type value_type;
             typedef typename T::value_type pair_type;
             typedef insert_aggregator_adapter<T> this_type;
+            typedef boost::true_type trivially_relocatable;
+            typedef boost::true_type emplacing;
+            typedef boost::true_type bulk_add;
 
             insert_aggregator_adapter(T& collection)
             : m_collection(collection)
@@ -107,6 +531,17 @@ namespace polymorphic_collections
                 m_collection.insert(pair_type(std::move(key), std::move(value)));
             }
 
+            //  The value is only constructed if the key is not present yet.
+            void try_emplace(key_type&& key, const emplacer<value_type>& make)
+            {
+                try_emplace_into(m_collection, std::move(key), make);
+            }
+
+            void add_many(const pair_source<key_type, value_type>& items)
+            {
+                insert_items(m_collection, items);
+            }
+
         private:
             collection_type& m_collection;
         };
@@ -128,6 +563,299 @@ namespace polymorphic_collections
             return insert_aggregator_adapter<typename boost::remove_reference<C>::type>(std::forward<C>(collection));
         }
 
+        //
+        //  Aggregator adapter which merges the values of duplicate keys instead of
+        //  keeping the first one: each item is looked up once with
+        //  try_emplace_into(), and if the key is present the existing value is
+        //  replaced by the result of merge(existing, value) (e.g. a sum, or a
+        //  maximum).
+        //
+        //  Maps which synchronize themselves and implement a locked upsert,
+        //  merge(key, value, merge) (see sharded_map), are updated through it
+        //  instead, so that several threads can merge into the same key.
+        //
+        //  Parameters:
+        //      [template] C
+        //          Collection type; a map.
+        //      [template] F
+        //          Merge function type.
+        //
+        template <typename C, typename F>
+        class merge_aggregator_adapter
+        {
+        public:
+            typedef C collection_type;
+            typedef F function_type;
+            typedef typename C::key_type key_type;
+            typedef typename C::mapped_type value_type;
+            typedef merge_aggregator_adapter<C, F> this_type;
+            typedef typename is_bitwise_copyable<F>::type trivially_relocatable;
+            typedef boost::true_type emplacing;
+            typedef boost::true_type bulk_add;
+
+            merge_aggregator_adapter(collection_type& collection, const function_type& merge)
+            : m_collection(collection), m_merge(merge)
+            {
+            }
+
+            merge_aggregator_adapter(this_type&& rhs)
+            : m_collection(rhs.m_collection), m_merge(std::move(rhs.m_merge))
+            {
+            }
+
+            void add(key_type&& key, value_type&& value)
+            {
+                merge_item(std::move(key), std::move(value), locked_merge());
+            }
+
+            void try_emplace(key_type&& key, const emplacer<value_type>& make)
+            {
+                try_emplace(std::move(key), make, locked_merge());
+            }
+
+            void add_many(const pair_source<key_type, value_type>& items)
+            {
+                reserve_pairs(m_collection, items.size());
+                const key_type* key;
+                const value_type* value;
+                while (items.next(key, value))
+                {
+                    merge_item(*key, *value, locked_merge());
+                }
+            }
+
+        private:
+            typedef boost::integral_constant<bool, has_merge<C, key_type, value_type, F&>::value> locked_merge;
+
+            template <typename K, typename V>
+            void merge_item(K&& key, V&& value, boost::true_type)
+            {
+                m_collection.merge(std::forward<K>(key), std::forward<V>(value), m_merge);
+            }
+
+            template <typename K, typename V>
+            void merge_item(K&& key, V&& value, boost::false_type)
+            {
+                //  try_emplace_into() leaves its arguments untouched if the key
+                //  is present.
+                auto result = try_emplace_into(m_collection, std::forward<K>(key), std::forward<V>(value));
+                if (!result.second)
+                {
+                    merge(result.first->second, std::forward<V>(value));
+                }
+            }
+
+            //  The locked upsert takes a value, so the item is constructed
+            //  before the lookup.
+            void try_emplace(key_type&& key, const emplacer<value_type>& make, boost::true_type)
+            {
+                value_type value = make;
+                m_collection.merge(std::move(key), std::move(value), m_merge);
+            }
+
+            void try_emplace(key_type&& key, const emplacer<value_type>& make, boost::false_type)
+            {
+                auto result = try_emplace_into(m_collection, std::move(key), make);
+                if (!result.second)
+                {
+                    value_type value = make;
+                    merge(result.first->second, std::move(value));
+                }
+            }
+
+            template <typename U>
+            void merge(value_type& existing, U&& value)
+            {
+                existing = m_merge(existing, std::forward<U>(value));
+            }
+
+            collection_type& m_collection;
+            function_type m_merge;
+        };
+
+        //
+        //  Moves a batch of entries into a map, merging the values of keys which
+        //  are already present. Entries bound for an ordered map are sorted
+        //  first, so that each one can be inserted with a hint just after the
+        //  previous one. Maps implementing a locked upsert
+        //  (see merge_aggregator_adapter) are updated through it, as other
+        //  threads may be writing to them.
+        //
+        template <typename C, typename E, typename F, typename O>
+        inline void merge_entries(C& collection, std::vector<E>& entries, F& merge, boost::true_type, O)
+        {
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                collection.merge(std::move(it->first), std::move(it->second), merge);
+            }
+        }
+
+        template <typename C, typename E, typename F>
+        inline void merge_entries(C& collection, std::vector<E>& entries, F& merge, boost::false_type, boost::true_type)
+        {
+            auto compare = collection.key_comp();
+            std::sort(entries.begin(), entries.end(), [&](const E& lhs, const E& rhs)
+            {
+                return compare(lhs.first, rhs.first);
+            });
+            auto hint = collection.end();
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                size_t size = collection.size();
+                hint = try_emplace_into(collection, hint, std::move(it->first), std::move(it->second));
+                if (collection.size() == size)
+                {
+                    hint->second = merge(hint->second, std::move(it->second));
+                }
+                ++hint;
+            }
+        }
+
+        template <typename C, typename E, typename F>
+        inline void merge_entries(C& collection, std::vector<E>& entries, F& merge, boost::false_type, boost::false_type)
+        {
+            reserve_pairs(collection, entries.size());
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                auto result = try_emplace_into(collection, std::move(it->first), std::move(it->second));
+                if (!result.second)
+                {
+                    result.first->second = merge(result.first->second, std::move(it->second));
+                }
+            }
+        }
+
+        template <typename C, typename E, typename F>
+        inline void merge_entries(C& collection, std::vector<E>& entries, F& merge)
+        {
+            merge_entries(collection, entries, merge,
+                          boost::integral_constant<bool, has_merge<C, typename C::key_type, typename C::mapped_type, F&>::value>(),
+                          boost::integral_constant<bool, has_key_compare<C>::value>());
+        }
+
+        //
+        //  Aggregator adapter which lets several threads add to a map without
+        //  taking a lock for every item, for high-rate sinks such as metrics.
+        //
+        //  Each thread adds to a small hash table of its own (see open_table),
+        //  where the values of duplicate keys are combined with merge() right
+        //  away. A table is merged into the map in one batch, under a lock, when
+        //  it holds threshold distinct keys; flush() merges all of the tables,
+        //  and is called when the adapter is destroyed.
+        //
+        //  The owning aggregator should use the no_lock policy, as the adapter
+        //  synchronizes itself. The map must not be accessed by other means
+        //  until the tables are flushed.
+        //
+        //  Parameters:
+        //      [template] C
+        //          Collection type; a map.
+        //      [template] F
+        //          Merge function type (see merge_aggregator_adapter).
+        //
+        template <typename C, typename F>
+        class buffered_aggregator_adapter
+        {
+        public:
+            typedef C collection_type;
+            typedef F function_type;
+            typedef typename C::key_type key_type;
+            typedef typename C::mapped_type value_type;
+            typedef buffered_aggregator_adapter<C, F> this_type;
+            typedef boost::true_type buffered;
+            //  The state is held by a unique_ptr, which does not depend on its
+            //  own address. It is allocated with allocate_unique(), as its
+            //  slots are aligned to cache lines.
+            typedef boost::true_type trivially_relocatable;
+
+            buffered_aggregator_adapter(collection_type& collection, const function_type& merge, size_t threshold)
+            : m_state(allocate_unique<state>(nullptr, collection, merge, threshold))
+            {
+            }
+
+            buffered_aggregator_adapter(this_type&& rhs)
+            : m_state(std::move(rhs.m_state))
+            {
+            }
+
+            //  Entries which cannot be flushed here are lost, as a destructor
+            //  cannot report the error; debug builds stop on it.
+            ~buffered_aggregator_adapter()
+            {
+                if (m_state)
+                {
+                    try
+                    {
+                        flush();
+                    }
+                    catch (...)
+                    {
+                        BOOST_ASSERT_MSG(false, "buffered_aggregator_adapter: entries were lost by the final flush.");
+                    }
+                }
+            }
+
+            void add(key_type&& key, value_type&& value)
+            {
+                state& st = *m_state;
+                st.tables.with_own([&](table_type& items)
+                {
+                    items.combine(std::move(key), std::move(value), st.merge);
+                    if (items.size() >= st.threshold)
+                    {
+                        merge(items);
+                    }
+                });
+            }
+
+            void flush()
+            {
+                m_state->tables.for_each([this](table_type& items)
+                {
+                    merge(items);
+                });
+            }
+
+        private:
+            typedef open_table<key_type, value_type, typename hash_of<C>::type> table_type;
+
+            struct state
+            {
+                collection_type& collection;
+                function_type merge;
+                size_t threshold;
+                boost::mutex mutex;
+                thread_slots<table_type> tables;
+
+                state(collection_type& collection, const function_type& merge, size_t threshold)
+                : collection(collection), merge(merge), threshold(threshold)
+                {
+                }
+            };
+
+            //  The table is cleared even if merging fails part way, as its
+            //  entries may have been moved from.
+            void merge(table_type& items)
+            {
+                if (!items.empty())
+                {
+                    try
+                    {
+                        boost::mutex::scoped_lock lock(m_state->mutex);
+                        merge_entries(m_state->collection, items.entries(), m_state->merge);
+                    }
+                    catch (...)
+                    {
+                        items.clear();
+                        throw;
+                    }
+                    items.clear();
+                }
+            }
+
+            std::unique_ptr<state, resource_deleter<state>> m_state;
+        };
+
         //
         //  Aggregator adapter encapsulating a functor.
         //
@@ -186,6 +914,86 @@ namespace polymorphic_collections
             return functional_aggregator_adapter<K, T, typename boost::remove_reference<F>::type>(std::forward<F>(func));
         }
         
+        //  A static_aggregator is converted to an aggregator by moving its
+        //  adapter into the aggregator.
+        template <typename K, typename T, typename K_, typename T_, typename A>
+        inline A make_aggregator_adapter(static_aggregator<K_, T_, A>&& a)
+        {
+            return std::move(a.adapter());
+        }
+
+        //
+        //  Aggregator adapter which inserts the keys of the items into a filter
+        //  over the keys of the collection (e.g. a bloom_filter) before passing
+        //  them on to another adapter; lookups which consult the filter thus
+        //  find every key which has been added.
+        //
+        //  Parameters:
+        //      [template] A
+        //          Type of the adapter holding the collection.
+        //      [template] B
+        //          Filter type, implementing insert(key).
+        //
+        template <typename A, typename B>
+        class filtered_aggregator_adapter
+        {
+        public:
+            typedef A adapter_type;
+            typedef B filter_type;
+            typedef typename A::key_type key_type;
+            typedef typename A::value_type value_type;
+            typedef filtered_aggregator_adapter<A, B> this_type;
+            typedef typename is_trivially_relocatable<A>::type trivially_relocatable;
+            typedef boost::true_type emplacing;
+            typedef boost::true_type bulk_add;
+            typedef typename is_buffered_adapter<A>::type buffered;
+
+            filtered_aggregator_adapter(adapter_type&& source, filter_type& filter)
+            : m_source(std::move(source)), m_filter(&filter)
+            {
+            }
+
+            filtered_aggregator_adapter(this_type&& rhs)
+            : m_source(std::move(rhs.m_source)), m_filter(rhs.m_filter)
+            {
+            }
+
+            void add(key_type&& key, value_type&& value)
+            {
+                m_filter->insert(key);
+                m_source.add(std::move(key), std::move(value));
+            }
+
+            void try_emplace(key_type&& key, const emplacer<value_type>& make)
+            {
+                m_filter->insert(key);
+                emplace_value(m_source, std::move(key), make);
+            }
+
+            void add_many(const pair_source<key_type, value_type>& items)
+            {
+                auto next = [&](const key_type*& key, const value_type*& value) -> bool
+                {
+                    if (!items.next(key, value))
+                    {
+                        return false;
+                    }
+                    m_filter->insert(*key);
+                    return true;
+                };
+                add_pairs(m_source, pair_source<key_type, value_type>(next, items.size()));
+            }
+
+            void flush()
+            {
+                m_source.flush();
+            }
+
+        private:
+            adapter_type m_source;
+            filter_type* m_filter;
+        };
+
         //  FIXME: Visual C++ has issues with decltype resolving to int if template
         //  substitution fails instead of giving an error message; typically this
         //  results in errors much deeper in the template code, which are extremely
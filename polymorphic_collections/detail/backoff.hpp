@@ -0,0 +1,102 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYMORPHIC_COLLECTIONS_DETAIL_BACKOFF_HPP
+#define POLYMORPHIC_COLLECTIONS_DETAIL_BACKOFF_HPP
+
+#include <cstddef>
+#include <memory>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
+namespace polymorphic_collections
+{
+    namespace detail
+    {
+        //
+        //  Tells the processor that the thread is spinning, which saves power
+        //  and frees the pipeline for the other hyper-thread of the core.
+        //
+        inline void cpu_relax()
+        {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+            _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+            __asm__ __volatile__("yield");
+#endif
+        }
+
+        //
+        //  Exponential backoff for spinning locks: each call to pause() spins
+        //  twice as long as the previous one, up to a limit after which the
+        //  thread yields its time slice instead, so that a lock holder which
+        //  has been preempted can make progress.
+        //
+        class backoff
+        {
+        public:
+            //  Spins per pause() beyond which the thread yields.
+            static const unsigned max_spins = 1024;
+
+            backoff()
+            : m_spins(1)
+            {
+            }
+
+            void pause()
+            {
+                if (m_spins <= max_spins)
+                {
+                    spin(m_spins);
+                    m_spins *= 2;
+                }
+                else
+                {
+                    boost::this_thread::yield();
+                }
+            }
+
+            static void spin(unsigned count)
+            {
+                for (unsigned i = 0; i < count; ++i)
+                {
+                    cpu_relax();
+                }
+            }
+
+        private:
+            unsigned m_spins;
+        };
+
+        //
+        //  Small number identifying the calling thread, assigned on first use in
+        //  order of arrival, so that threads spread evenly over per-thread slots.
+        //
+        inline size_t thread_index()
+        {
+            static boost::atomic<size_t> next(0);
+            static thread_local size_t index = next.fetch_add(1, boost::memory_order_relaxed);
+            return index;
+        }
+
+        //
+        //  Object which lives as long as the calling thread: a weak_ptr to it
+        //  expires when the thread exits.
+        //
+        inline const std::shared_ptr<void>& thread_lifetime()
+        {
+            static thread_local std::shared_ptr<void> token = std::make_shared<char>(0);
+            return token;
+        }
+    }
+}
+
+#endif  // POLYMORPHIC_COLLECTIONS_DETAIL_BACKOFF_HPP
@@ -6,10 +6,27 @@
 #ifndef POLYMORPHIC_COLLECTIONS_DETAIL_COMMON_HPP
 #define POLYMORPHIC_COLLECTIONS_DETAIL_COMMON_HPP
 
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
 #include <utility>
+#include <vector>
 #include <boost/optional.hpp>
 #include <boost/mpl/has_xxx.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/type_traits.hpp>
+#include <boost/utility/addressof.hpp>
+
+#include "../memory_resource.hpp"
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#endif
 
 namespace polymorphic_collections
 {
@@ -162,7 +179,7 @@ namespace polymorphic_collections
             {                                                                           \
             }                                                                           \
             template <typename U>                                                       \
-            static yes_tag test(U&&, decltype(declval<U>().x(declval<A>()))* dummy = 0)        \
+            static yes_tag test(U&&, typename boost::remove_reference<decltype(declval<U>().x(declval<A>()))>::type* dummy = 0) \
             {                                                                           \
             }                                                                           \
             static no_tag test(...)                                                     \
@@ -174,11 +191,403 @@ namespace polymorphic_collections
         HAS_METHOD_DEF_1(push_back)
         HAS_METHOD_DEF_1(find)
         HAS_METHOD_DEF_1(insert)
+        HAS_METHOD_DEF_1(emplace_back)
+        HAS_METHOD_DEF_1(bucket)
+
+#define HAS_METHOD_DEF_2(x)                                                             \
+        template <typename T, typename A, typename B>                                   \
+        struct has_##x                                                                  \
+        {                                                                               \
+            template <typename U>                                                       \
+            static yes_tag test(U&&, typename boost::remove_reference<decltype(declval<U>().x(declval<A>(), declval<B>()))>::type* dummy = 0) \
+            {                                                                           \
+            }                                                                           \
+            static no_tag test(...)                                                     \
+            {                                                                           \
+            }                                                                           \
+            static const bool value = sizeof(test(declval<T>())) == sizeof(yes_tag);  \
+        };
+        HAS_METHOD_DEF_2(try_emplace)
+
+#define HAS_METHOD_DEF_3(x)                                                             \
+        template <typename T, typename A, typename B, typename C>                       \
+        struct has_##x                                                                  \
+        {                                                                               \
+            template <typename U>                                                       \
+            static yes_tag test(U&&, typename boost::remove_reference<decltype(declval<U>().x(declval<A>(), declval<B>(), declval<C>()))>::type* dummy = 0) \
+            {                                                                           \
+            }                                                                           \
+            static no_tag test(...)                                                     \
+            {                                                                           \
+            }                                                                           \
+            static const bool value = sizeof(test(declval<T>())) == sizeof(yes_tag);  \
+        };
+        //  Locked upsert of concurrent maps (see sharded_map::merge).
+        HAS_METHOD_DEF_3(merge)
+
+        //
+        //  Type-erased construction of a T, passed through the function tables so
+        //  that adapters can construct items in place, e.g. with emplace_back().
+        //  It converts to T by calling the function it was given, whose result is
+        //  constructed directly where the conversion is used. It refers to the
+        //  function and may only be converted once.
+        //
+        //  Example:
+        //      auto make = [&]() { return T(std::forward<Args>(args)...); };
+        //      collection.emplace_back(emplacer<T>(make));
+        //
+        template <typename T>
+        class emplacer
+        {
+        public:
+            template <typename F>
+            explicit emplacer(F& make)
+            : m_make(&emplacer::call<F>), m_context(&make)
+            {
+            }
+
+            //  Not copyable, so that the constructors of types such as std::any
+            //  which take any copyable object do not take the emplacer itself.
+            emplacer(const emplacer&) = delete;
+            emplacer& operator=(const emplacer&) = delete;
+
+            operator T() const
+            {
+                return m_make(m_context);
+            }
+
+        private:
+            template <typename F>
+            static T call(void* make)
+            {
+                return (*static_cast<F*>(make))();
+            }
+
+            T (*m_make)(void* make);
+            void* m_context;
+        };
+
+        //
+        //  Whether a T may be constructed from an emplacer<T>, which is only safe
+        //  if T has no constructor accepting unrelated types: such a constructor
+        //  (e.g. the ones of boost::any, or of std::optional<std::any>) would
+        //  store the emplacer instead of calling its conversion operator. Those
+        //  types are given a value constructed beforehand instead.
+        //
+        template <typename T>
+        struct accepts_emplacer
+        {
+        private:
+            struct unrelated
+            {
+            };
+
+        public:
+            static const bool value = !boost::is_constructible<T, const unrelated&>::value;
+        };
+
+        BOOST_MPL_HAS_XXX_TRAIT_DEF(emplacing)
+        BOOST_MPL_HAS_XXX_TRAIT_DEF(bulk_add)
+
+        BOOST_MPL_HAS_XXX_TRAIT_DEF(buffered)
+
+        //
+        //  Identifies accumulator and aggregator adapters which buffer items and
+        //  implement flush(). Adapters opt in by defining a buffered typedef to
+        //  boost::true_type.
+        //
+        template <typename A, bool = has_buffered<A>::value>
+        struct is_buffered_adapter : boost::false_type
+        {
+        };
+
+        template <typename A>
+        struct is_buffered_adapter<A, true>
+            : boost::integral_constant<bool, A::buffered::value>
+        {
+        };
+
+        //  Moves the items buffered by an adapter to its collection; does
+        //  nothing for adapters which do not buffer them.
+        template <typename A>
+        inline void flush_adapter(A& adapter, boost::true_type)
+        {
+            adapter.flush();
+        }
+
+        template <typename A>
+        inline void flush_adapter(A&, boost::false_type)
+        {
+        }
+
+        template <typename A>
+        inline void flush_adapter(A& adapter)
+        {
+            flush_adapter(adapter, typename is_buffered_adapter<A>::type());
+        }
+
+        //
+        //  Identifies collections whose elements are stored contiguously in memory,
+        //  so that a range of them can be described by a pair of pointers.
+        //
+        template <typename C>
+        struct is_contiguous_collection : boost::false_type
+        {
+        };
+
+        template <typename T, typename A>
+        struct is_contiguous_collection<std::vector<T, A>> : boost::true_type
+        {
+        };
+
+        //  vector<bool> is a bitset in disguise.
+        template <typename A>
+        struct is_contiguous_collection<std::vector<bool, A>> : boost::false_type
+        {
+        };
+
+        template <typename T, size_t N>
+        struct is_contiguous_collection<std::array<T, N>> : boost::true_type
+        {
+        };
+
+        template <typename T, typename Tr, typename A>
+        struct is_contiguous_collection<std::basic_string<T, Tr, A>> : boost::true_type
+        {
+        };
+
+        //
+        //  Identifies collections whose iterators, including the end iterator,
+        //  still refer to the same elements after the collection is moved; such
+        //  collections can be embedded in an adapter by value. Not the case for
+        //  std::array, whose elements are moved one by one, nor for collections
+        //  with a sentinel node or a small buffer inside the object. Deques are
+        //  not included either: the standard does not say that their iterators
+        //  survive a move, and some implementations (e.g. Visual C++) have them
+        //  refer to the deque object itself.
+        //
+        template <typename T>
+        struct has_move_stable_iterators : boost::false_type
+        {
+        };
+
+        template <typename T, typename A>
+        struct has_move_stable_iterators<std::vector<T, A>> : boost::true_type
+        {
+        };
+
+        //  Returns a pointer to the first element of a contiguous collection, or
+        //  nullptr if it is empty.
+        template <typename C>
+        inline auto contiguous_begin(C& collection) -> decltype(boost::addressof(*collection.begin()))
+        {
+            return collection.empty() ? nullptr : boost::addressof(*collection.begin());
+        }
+
+        template <typename I>
+        struct is_random_access_iterator
+            : boost::is_convertible<typename std::iterator_traits<I>::iterator_category,
+                                    std::random_access_iterator_tag>
+        {
+        };
+
+        //  Hints the processor to fetch the cache line holding ptr, so that a
+        //  later access to it does not stall.
+        inline void prefetch(const void* ptr)
+        {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+            _mm_prefetch(static_cast<const char*>(ptr), _MM_HINT_T0);
+#elif defined(__GNUC__)
+            __builtin_prefetch(ptr);
+#endif
+        }
 
         BOOST_MPL_HAS_XXX_TRAIT_DEF(iterator)
         BOOST_MPL_HAS_XXX_TRAIT_DEF(value_type)
         BOOST_MPL_HAS_XXX_TRAIT_DEF(key_type)
         BOOST_MPL_HAS_XXX_TRAIT_DEF(mapped_type)
+        BOOST_MPL_HAS_XXX_TRAIT_DEF(key_compare)
+        BOOST_MPL_HAS_XXX_TRAIT_DEF(hasher)
+        //
+        //  Allocates a block from a memory resource, or from the global heap if
+        //  the resource is null. Blocks aligned beyond what operator new
+        //  guarantees (e.g. for cache_line_storage) use its aligned form, or
+        //  before C++17 an oversized block aligned by hand, with the address
+        //  operator new returned stored just in front of the aligned one.
+        //
+#if defined(__cpp_aligned_new)
+        const size_t default_new_alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+#else
+        const size_t default_new_alignment = boost::alignment_of<long double>::value;
+#endif
+
+        inline void* allocate_from(memory_resource* resource, size_t size, size_t alignment)
+        {
+            if (resource)
+            {
+                return resource->allocate(size, alignment);
+            }
+            else if (alignment > default_new_alignment)
+            {
+#if defined(__cpp_aligned_new)
+                return ::operator new(size, std::align_val_t(alignment));
+#else
+                void* block = ::operator new(size + alignment + sizeof(void*));
+                std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block) + sizeof(void*);
+                void* aligned = reinterpret_cast<void*>((address + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1));
+                static_cast<void**>(aligned)[-1] = block;
+                return aligned;
+#endif
+            }
+            return ::operator new(size);
+        }
+
+        inline void deallocate_to(memory_resource* resource, void* ptr, size_t size, size_t alignment)
+        {
+            if (resource)
+            {
+                resource->deallocate(ptr, size, alignment);
+            }
+            else if (alignment > default_new_alignment)
+            {
+#if defined(__cpp_aligned_new)
+                ::operator delete(ptr, std::align_val_t(alignment));
+#else
+                ::operator delete(static_cast<void**>(ptr)[-1]);
+#endif
+            }
+            else
+            {
+                ::operator delete(ptr);
+            }
+        }
+
+        //
+        //  Deleter for objects created by allocate_unique(): destroys the object
+        //  and returns its memory to the resource it came from.
+        //
+        template <typename T>
+        class resource_deleter
+        {
+        public:
+            resource_deleter(memory_resource* resource = nullptr)
+            : m_resource(resource)
+            {
+            }
+
+            void operator()(T* ptr) const
+            {
+                ptr->~T();
+                deallocate_to(m_resource, ptr, sizeof(T), boost::alignment_of<T>::value);
+            }
+
+        private:
+            memory_resource* m_resource;
+        };
+
+        //
+        //  Moves value into a new object allocated from a memory resource (or the
+        //  global heap if resource is null).
+        //
+        template <typename T>
+        inline std::unique_ptr<T, resource_deleter<T>> allocate_unique(memory_resource* resource, T&& value)
+        {
+            void* ptr = allocate_from(resource, sizeof(T), boost::alignment_of<T>::value);
+            try
+            {
+                new (ptr) T(std::move(value));
+            }
+            catch (...)
+            {
+                deallocate_to(resource, ptr, sizeof(T), boost::alignment_of<T>::value);
+                throw;
+            }
+            return std::unique_ptr<T, resource_deleter<T>>(static_cast<T*>(ptr), resource_deleter<T>(resource));
+        }
+
+        //
+        //  Constructs a T from args in a new object allocated from a memory
+        //  resource (or the global heap if resource is null). Unlike a plain
+        //  new, this honours alignments beyond what operator new guarantees
+        //  before C++17.
+        //
+        template <typename T, typename... Args>
+        inline std::unique_ptr<T, resource_deleter<T>> allocate_unique(memory_resource* resource, Args&&... args)
+        {
+            void* ptr = allocate_from(resource, sizeof(T), boost::alignment_of<T>::value);
+            try
+            {
+                new (ptr) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                deallocate_to(resource, ptr, sizeof(T), boost::alignment_of<T>::value);
+                throw;
+            }
+            return std::unique_ptr<T, resource_deleter<T>>(static_cast<T*>(ptr), resource_deleter<T>(resource));
+        }
+
+        BOOST_MPL_HAS_XXX_TRAIT_DEF(combining)
+
+        //  Identifies lock policies which combine the operations of several
+        //  threads (see flat_combining).
+        template <typename P, bool = has_combining<P>::value>
+        struct is_combining_policy : boost::false_type
+        {
+        };
+
+        template <typename P>
+        struct is_combining_policy<P, true>
+            : boost::integral_constant<bool, P::combining::value>
+        {
+        };
+
+        BOOST_MPL_HAS_XXX_TRAIT_DEF(trivially_relocatable)
+
+        //
+        //  Identifies adapters which can be moved to another address by copying
+        //  their bytes, after which the original is not destroyed. Adapters opt in
+        //  by defining a trivially_relocatable typedef to boost::true_type.
+        //
+        template <typename A, bool = has_trivially_relocatable<A>::value>
+        struct is_trivially_relocatable : boost::false_type
+        {
+        };
+
+        template <typename A>
+        struct is_trivially_relocatable<A, true>
+            : boost::integral_constant<bool, A::trivially_relocatable::value>
+        {
+        };
+
+        //  Types, typically iterators, which can be copied byte-wise.
+        template <typename T>
+        struct is_bitwise_copyable
+            : boost::integral_constant<bool, boost::has_trivial_copy<T>::value &&
+                                             boost::has_trivial_destructor<T>::value>
+        {
+        };
+
+        //
+        //  Moves a type-erased adapter from one buffer to another, using the
+        //  relocate entry of its function table or, if there is none, memcpy.
+        //
+        //  Parameters:
+        //      [template] V
+        //          Function table type, with relocate and size members.
+        //
+        template <typename V>
+        inline void relocate_adapter(const V* vtable, void* from, void* to)
+        {
+            if (vtable->relocate)
+            {
+                vtable->relocate(from, to);
+            }
+            else
+            {
+                std::memcpy(to, from, vtable->size);
+            }
+        }
     }
 }
 
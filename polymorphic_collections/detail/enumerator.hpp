@@ -6,47 +6,75 @@
 #ifndef POLYMORPHIC_COLLECTIONS_DETAIL_ENUMERATOR_HPP
 #define POLYMORPHIC_COLLECTIONS_DETAIL_ENUMERATOR_HPP
 
+#include <algorithm>
+#include <boost/atomic.hpp>
+
 #include "common.hpp"
 
 namespace polymorphic_collections
 {
+    template <typename T, typename A>
+    class static_enumerator;
+
     namespace detail
     {
         //
-        //  Interface used by the enumerator to manipulate the underlying adapter.
+        //  Function table used by the enumerator to manipulate the underlying
+        //  adapter. The enumerator holds a pointer to a static instance of this
+        //  table next to the adapter itself, so that a call only needs to load
+        //  the function pointer (unlike a virtual call, which first has to load
+        //  the vtable pointer from the object).
         //
         //  Parameters:
         //      [template] T
         //          Value type.
         //
-        template <typename T> class enumerator_adapter_interface
+        template <typename T>
+        struct enumerator_adapter_vtable
         {
-        public:
-            typedef T value_type;
-            typedef enumerator_adapter_interface<T> this_type;
-
-            virtual ~enumerator_adapter_interface() = 0;
-            virtual this_type* move(void* ptr) = 0;
-            virtual boost::optional<T&> next() = 0;
+            //  Destroys the adapter without freeing its memory.
+            void (*destroy)(void* adapter);
+            //  Move-constructs the adapter at ptr and destroys the original; null
+            //  if the adapter can be relocated with memcpy.
+            void (*relocate)(void* adapter, void* ptr);
+            //  Size and alignment of the adapter, in bytes.
+            size_t size;
+            size_t alignment;
+            boost::optional<T&> (*next)(void* adapter);
+            size_t (*next_n)(void* adapter, T** out, size_t max);
+            //  Exposes the remaining items as a raw range and advances past the
+            //  first consume of them (see enumerator::try_contiguous).
+            bool (*contiguous)(void* adapter, T*& begin, T*& end, size_t consume);
+            //  Moves the second half of the remaining items into a new adapter of
+            //  the same type, constructed at ptr. Null if the adapter cannot be
+            //  split.
+            void (*split)(void* adapter, void* ptr);
         };
-        
-        template <typename T>
-        inline enumerator_adapter_interface<T>::~enumerator_adapter_interface()
+
+        //
+        //  Whether a contiguous range of U can be exposed as a range of T: pointer
+        //  arithmetic is only meaningful if the objects are exactly of type T.
+        //
+        template <typename U, typename T>
+        struct is_contiguous_compatible
+            : boost::integral_constant<bool, boost::is_same<typename boost::remove_cv<U>::type,
+                                                            typename boost::remove_cv<T>::type>::value &&
+                                             boost::is_convertible<U*, T*>::value>
         {
-        }
+        };
 
         //
-        //  Proxy class which holds the actual adapter and exposes an interface
-        //  potentially for a different value type.
+        //  Proxy class which holds the actual adapter and implements the function
+        //  table, potentially for a different value type.
         //
         //  This is the mechanism by which you can have the following work:
         //      vector<int> v;
         //      enumerator<const int> e = v;
         //
-        //  The underlying adapter is an iterator_enumerator_adapter<int> held
-        //  by a enumerator_adapter_proxy<int, const int> which implements the
-        //  enumerator_adapter_interface<const int> interface exposed to the
-        //  containing enumerator.
+        //  The underlying adapter is an iterator_enumerator_adapter<int*> held
+        //  by a enumerator_adapter_proxy<const int, ...> which implements the
+        //  enumerator_adapter_vtable<const int> table used by the containing
+        //  enumerator.
         //
         //  Parameters:
         //      [template] T
@@ -54,13 +82,15 @@ namespace polymorphic_collections
         //      [template] A
         //          Adapter type.
         //
-        template <typename T, typename A> class enumerator_adapter_proxy : public enumerator_adapter_interface<T>,
-                                                                           public boost::noncopyable
+        template <typename T, typename A> class enumerator_adapter_proxy : public boost::noncopyable
         {
         public:
             typedef T value_type;
             typedef A adapter_type;
             typedef enumerator_adapter_proxy<T, A> this_type;
+            typedef enumerator_adapter_vtable<T> vtable_type;
+
+            static const vtable_type vtable;
 
             enumerator_adapter_proxy(this_type&& rhs)
             : m_adapter(std::move(rhs.m_adapter))
@@ -72,13 +102,26 @@ namespace polymorphic_collections
             {
             }
 
-            virtual ~enumerator_adapter_proxy()
+        private:
+            static this_type& self(void* adapter)
             {
+                return *static_cast<this_type*>(adapter);
             }
 
-            virtual boost::optional<value_type&> next()
+            static void destroy(void* adapter)
             {
-                auto value = m_adapter.next();
+                self(adapter).~this_type();
+            }
+
+            static void relocate(void* adapter, void* ptr)
+            {
+                new(ptr) this_type(std::move(self(adapter)));
+                destroy(adapter);
+            }
+
+            static boost::optional<value_type&> next(void* adapter)
+            {
+                auto value = self(adapter).m_adapter.next();
                 if (value)
                 {
                     return *value;
@@ -89,15 +132,66 @@ namespace polymorphic_collections
                 }
             }
 
-            virtual enumerator_adapter_interface<value_type>* move(void* ptr)
+            static size_t next_n(void* adapter, value_type** out, size_t max)
             {
-                return new(ptr) this_type(std::move(m_adapter));
+                return self(adapter).m_adapter.next_n(out, max);
+            }
+
+            static bool contiguous(void* adapter, value_type*& begin, value_type*& end, size_t consume)
+            {
+                typedef is_contiguous_compatible<typename adapter_type::value_type, value_type> is_compatible;
+                return self(adapter).contiguous_impl(begin, end, consume, typename is_compatible::type());
+            }
+
+            static void split(void* adapter, void* ptr)
+            {
+                self(adapter).split_impl(ptr, typename adapter_type::splittable());
+            }
+
+            void split_impl(void* ptr, boost::true_type)
+            {
+                new(ptr) this_type(m_adapter.split());
+            }
+
+            //  Not in the function table.
+            void split_impl(void*, boost::false_type)
+            {
+            }
+
+            bool contiguous_impl(value_type*& begin, value_type*& end, size_t consume, boost::true_type)
+            {
+                typename adapter_type::value_type* first;
+                typename adapter_type::value_type* last;
+                if (m_adapter.contiguous(first, last, consume))
+                {
+                    begin = first;
+                    end = last;
+                    return true;
+                }
+                return false;
+            }
+
+            bool contiguous_impl(value_type*&, value_type*&, size_t, boost::false_type)
+            {
+                return false;
             }
 
-        private:
             A m_adapter;
         };
 
+        template <typename T, typename A>
+        const enumerator_adapter_vtable<T> enumerator_adapter_proxy<T, A>::vtable =
+        {
+            &this_type::destroy,
+            is_trivially_relocatable<A>::value ? nullptr : &this_type::relocate,
+            sizeof(this_type),
+            boost::alignment_of<this_type>::value,
+            &this_type::next,
+            &this_type::next_n,
+            &this_type::contiguous,
+            A::splittable::value ? &this_type::split : nullptr
+        };
+
         //
         //  Enumerator adapter based on a range specified by a pair of STL-compatible
         //  forward iterators.
@@ -115,6 +209,9 @@ namespace polymorphic_collections
                 boost::is_const<typename boost::remove_pointer<T>::type>,
                 const iterator_value_type, 
                 iterator_value_type>::type value_type;
+            //  Random-access ranges can be split in constant time.
+            typedef typename is_random_access_iterator<T>::type splittable;
+            typedef typename is_bitwise_copyable<T>::type trivially_relocatable;
 
             iterator_enumerator_adapter(const iterator_type& begin, const iterator_type& end)
             : m_begin(begin), m_end(end)
@@ -146,18 +243,60 @@ namespace polymorphic_collections
                 }
             }
 
+            template <typename U>
+            size_t next_n(U** out, size_t max)
+            {
+                size_t count = 0;
+                while (count < max && m_begin != m_end)
+                {
+                    out[count++] = boost::addressof(*m_begin);
+                    ++m_begin;
+                }
+                return count;
+            }
+
+            //  Only ranges specified by pointers are known to be contiguous.
+            bool contiguous(value_type*& begin, value_type*& end, size_t consume)
+            {
+                return contiguous(begin, end, consume, typename boost::is_pointer<iterator_type>::type());
+            }
+
+            //  Keeps the first half of the remaining range (rounded up) and
+            //  returns an adapter for the second half.
+            this_type split()
+            {
+                T middle = m_begin + (m_end - m_begin + 1) / 2;
+                this_type tail(middle, m_end);
+                m_end = middle;
+                return tail;
+            }
+
         private:
+            bool contiguous(value_type*& begin, value_type*& end, size_t consume, boost::true_type)
+            {
+                begin = m_begin;
+                end = m_end;
+                m_begin += std::min<size_t>(consume, m_end - m_begin);
+                return true;
+            }
+
+            bool contiguous(value_type*&, value_type*&, size_t, boost::false_type)
+            {
+                return false;
+            }
+
             T m_begin, m_end;
         };
 
         template <typename T, typename C>
         struct supports_iterator_enumerator_adapter
         {
-            static const bool value = has_iterator<C>::value;
+            static const bool value = has_iterator<C>::value &&
+                                      !is_contiguous_collection<C>::value;
         };
 
         template <typename T, typename C>
-        inline auto make_enumerator_adapter(C& collection)
+        inline auto make_enumerator_adapter(C& collection, memory_resource* = nullptr)
             -> typename boost::enable_if<supports_iterator_enumerator_adapter<T, C>,
                                          iterator_enumerator_adapter<typename C::iterator>>::type
         {
@@ -165,20 +304,283 @@ namespace polymorphic_collections
         }
 
         template <typename T, typename C>
-        inline auto make_enumerator_adapter(const C& collection)
+        inline auto make_enumerator_adapter(const C& collection, memory_resource* = nullptr)
             -> typename boost::enable_if<supports_iterator_enumerator_adapter<T, C>,
                                          iterator_enumerator_adapter<typename C::const_iterator>>::type
         {
             return iterator_enumerator_adapter<typename C::const_iterator>(collection.cbegin(), collection.cend());
         }
 
+        //  Contiguous collections are enumerated through plain pointers, which
+        //  allows the enumerator to expose the range via try_contiguous().
+        template <typename T, typename C>
+        struct supports_contiguous_enumerator_adapter
+        {
+            static const bool value = is_contiguous_collection<C>::value;
+        };
+
+        template <typename T, typename C>
+        inline auto make_enumerator_adapter(C& collection, memory_resource* = nullptr)
+            -> typename boost::enable_if<supports_contiguous_enumerator_adapter<T, C>,
+                                         iterator_enumerator_adapter<typename C::value_type*>>::type
+        {
+            typename C::value_type* begin = contiguous_begin(collection);
+            return iterator_enumerator_adapter<typename C::value_type*>(begin, begin + collection.size());
+        }
+
+        template <typename T, typename C>
+        inline auto make_enumerator_adapter(const C& collection, memory_resource* = nullptr)
+            -> typename boost::enable_if<supports_contiguous_enumerator_adapter<T, C>,
+                                         iterator_enumerator_adapter<const typename C::value_type*>>::type
+        {
+            const typename C::value_type* begin = contiguous_begin(collection);
+            return iterator_enumerator_adapter<const typename C::value_type*>(begin, begin + collection.size());
+        }
+
         template <typename T, size_t N>
-        inline auto make_enumerator_adapter(T (&ar)[N])
+        inline auto make_enumerator_adapter(T (&ar)[N], memory_resource* = nullptr)
             -> iterator_enumerator_adapter<T*>
         {
             return iterator_enumerator_adapter<T*>(std::begin(ar), std::end(ar));
         }
 
+        //
+        //  Enumerator adapter over a random-access range which may be consumed by
+        //  several threads at once without locking.
+        //
+        //  The position in the range is an atomic index which is claimed with a
+        //  single fetch_add per call, so each item is handed out exactly once;
+        //  next_n() claims a whole block of items with one atomic operation.
+        //  The owning enumerator should use the no_lock policy, as the adapter
+        //  synchronizes itself.
+        //
+        //  Parameters:
+        //      [template] T
+        //          Random-access iterator type.
+        //
+        template <typename T>
+        class concurrent_enumerator_adapter
+        {
+        public:
+            typedef T iterator_type;
+            typedef concurrent_enumerator_adapter<T> this_type;
+            typedef typename boost::remove_reference<
+                typename std::iterator_traits<T>::reference>::type value_type;
+            //  Consumers may be running concurrently, so the range cannot be split.
+            typedef boost::false_type splittable;
+
+            concurrent_enumerator_adapter(const iterator_type& begin, const iterator_type& end)
+            : m_begin(begin), m_size(end - begin), m_cursor(0)
+            {
+            }
+
+            concurrent_enumerator_adapter(this_type&& rhs)
+            : m_begin(std::move(rhs.m_begin)), m_size(rhs.m_size), m_cursor(rhs.m_cursor.load())
+            {
+            }
+
+            boost::optional<value_type&> next()
+            {
+                //  Avoid growing the cursor indefinitely once the range is exhausted.
+                if (m_cursor.load(boost::memory_order_relaxed) >= m_size)
+                {
+                    return boost::none;
+                }
+                size_t index = m_cursor.fetch_add(1, boost::memory_order_relaxed);
+                if (index < m_size)
+                {
+                    return m_begin[index];
+                }
+                else
+                {
+                    return boost::none;
+                }
+            }
+
+            template <typename U>
+            size_t next_n(U** out, size_t max)
+            {
+                if (max == 0 || m_cursor.load(boost::memory_order_relaxed) >= m_size)
+                {
+                    return 0;
+                }
+                //  Clamped so that a huge max cannot wrap the cursor around.
+                max = std::min(max, m_size);
+                size_t index = m_cursor.fetch_add(max, boost::memory_order_relaxed);
+                if (index >= m_size)
+                {
+                    return 0;
+                }
+                size_t count = std::min(max, m_size - index);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    out[i] = boost::addressof(m_begin[index + i]);
+                }
+                return count;
+            }
+
+            //  Claims everything that remains in a single operation. The range
+            //  cannot be exposed without claiming it, since other threads may
+            //  claim part of it in the meantime.
+            bool contiguous(value_type*& begin, value_type*& end, size_t consume)
+            {
+                return contiguous(begin, end, consume, typename boost::is_pointer<iterator_type>::type());
+            }
+
+        private:
+            bool contiguous(value_type*& begin, value_type*& end, size_t consume, boost::true_type)
+            {
+                if (consume < m_size - std::min(m_cursor.load(), m_size))
+                {
+                    return false;
+                }
+                size_t index = std::min(m_cursor.exchange(m_size), m_size);
+                begin = m_begin + index;
+                end = m_begin + m_size;
+                return true;
+            }
+
+            bool contiguous(value_type*&, value_type*&, size_t, boost::false_type)
+            {
+                return false;
+            }
+
+            iterator_type m_begin;
+            size_t m_size;
+            boost::atomic<size_t> m_cursor;
+        };
+
+        template <typename C, bool = has_iterator<C>::value>
+        struct supports_concurrent_enumerator_adapter
+        {
+            static const bool value = false;
+        };
+
+        template <typename C>
+        struct supports_concurrent_enumerator_adapter<C, true>
+        {
+            static const bool value = is_random_access_iterator<typename C::iterator>::value;
+        };
+
+        template <typename C>
+        inline auto make_concurrent_enumerator_adapter(C& collection)
+            -> typename boost::enable_if_c<supports_concurrent_enumerator_adapter<C>::value &&
+                                           !is_contiguous_collection<C>::value,
+                                           concurrent_enumerator_adapter<typename C::iterator>>::type
+        {
+            return concurrent_enumerator_adapter<typename C::iterator>(std::begin(collection), std::end(collection));
+        }
+
+        template <typename C>
+        inline auto make_concurrent_enumerator_adapter(const C& collection)
+            -> typename boost::enable_if_c<supports_concurrent_enumerator_adapter<C>::value &&
+                                           !is_contiguous_collection<C>::value,
+                                           concurrent_enumerator_adapter<typename C::const_iterator>>::type
+        {
+            return concurrent_enumerator_adapter<typename C::const_iterator>(collection.cbegin(), collection.cend());
+        }
+
+        template <typename C>
+        inline auto make_concurrent_enumerator_adapter(C& collection)
+            -> typename boost::enable_if<is_contiguous_collection<C>,
+                                         concurrent_enumerator_adapter<typename C::value_type*>>::type
+        {
+            typename C::value_type* begin = contiguous_begin(collection);
+            return concurrent_enumerator_adapter<typename C::value_type*>(begin, begin + collection.size());
+        }
+
+        template <typename C>
+        inline auto make_concurrent_enumerator_adapter(const C& collection)
+            -> typename boost::enable_if<is_contiguous_collection<C>,
+                                         concurrent_enumerator_adapter<const typename C::value_type*>>::type
+        {
+            const typename C::value_type* begin = contiguous_begin(collection);
+            return concurrent_enumerator_adapter<const typename C::value_type*>(begin, begin + collection.size());
+        }
+
+        template <typename T, size_t N>
+        inline auto make_concurrent_enumerator_adapter(T (&ar)[N])
+            -> concurrent_enumerator_adapter<T*>
+        {
+            return concurrent_enumerator_adapter<T*>(std::begin(ar), std::end(ar));
+        }
+
+        //
+        //  Owns the collection of an embedded adapter. Collections whose iterators
+        //  survive a move (see has_move_stable_iterators) are held by value; any
+        //  other collection is moved to a separate block, allocated from the given
+        //  memory resource or the global heap, so that it never moves again.
+        //
+        //  Parameters:
+        //      [template] T
+        //          Collection type.
+        //
+        template <typename T, bool = has_move_stable_iterators<T>::value>
+        class embedded_collection
+        {
+        public:
+            typedef T collection_type;
+            typedef embedded_collection<T, false> this_type;
+            typedef boost::true_type trivially_relocatable;
+
+            embedded_collection(T&& collection, memory_resource* resource)
+            : m_collection(allocate_unique(resource, std::move(collection)))
+            {
+            }
+
+            embedded_collection(this_type&& rhs)
+            : m_collection(std::move(rhs.m_collection))
+            {
+            }
+
+            this_type& operator=(this_type&& rhs)
+            {
+                m_collection = std::move(rhs.m_collection);
+                return *this;
+            }
+
+            collection_type& get()
+            {
+                return *m_collection;
+            }
+
+        private:
+            std::unique_ptr<collection_type, resource_deleter<collection_type>> m_collection;
+        };
+
+        template <typename T>
+        class embedded_collection<T, true>
+        {
+        public:
+            typedef T collection_type;
+            typedef embedded_collection<T, true> this_type;
+            typedef boost::false_type trivially_relocatable;
+
+            embedded_collection(T&& collection, memory_resource*)
+            : m_collection(std::move(collection))
+            {
+            }
+
+            embedded_collection(this_type&& rhs)
+            : m_collection(std::move(rhs.m_collection))
+            {
+            }
+
+            this_type& operator=(this_type&& rhs)
+            {
+                m_collection = std::move(rhs.m_collection);
+                return *this;
+            }
+
+            collection_type& get()
+            {
+                return m_collection;
+            }
+
+        private:
+            collection_type m_collection;
+        };
+
         //
         //  Enumerator adapter which embeds an STL-compatible collection in the enumerator.
         //
@@ -198,6 +600,10 @@ namespace polymorphic_collections
         //  automatically destroyed. With the std::move, the vector is moved into the
         //  resulting enumerator object.
         //
+        //  Vectors are stored in the adapter itself; other collections, deques
+        //  included, are allocated from the given memory resource, or from the
+        //  global heap if there is none (see embedded_collection).
+        //
         //  Parameters:
         //      [template] T
         //          Collection type.
@@ -210,11 +616,16 @@ namespace polymorphic_collections
             typedef typename T::iterator iterator_type;
             typedef typename T::value_type value_type;
             typedef embedded_enumerator_adapter<T> this_type;
-
-            embedded_enumerator_adapter(T&& collection)
-            : m_collection(new T(std::move(collection))), 
-              m_begin(m_collection->begin()), 
-              m_end(m_collection->end())
+            //  The collection is owned by a single adapter.
+            typedef boost::false_type splittable;
+            //  A collection held on the heap does not depend on its own address.
+            typedef boost::integral_constant<bool, embedded_collection<T>::trivially_relocatable::value &&
+                                                   is_bitwise_copyable<iterator_type>::value> trivially_relocatable;
+
+            embedded_enumerator_adapter(T&& collection, memory_resource* resource = nullptr)
+            : m_collection(std::move(collection), resource), 
+              m_begin(m_collection.get().begin()), 
+              m_end(m_collection.get().end())
             {
             }
 
@@ -245,8 +656,38 @@ namespace polymorphic_collections
                 }
             }
 
+            template <typename U>
+            size_t next_n(U** out, size_t max)
+            {
+                size_t count = 0;
+                while (count < max && m_begin != m_end)
+                {
+                    out[count++] = boost::addressof(*m_begin);
+                    ++m_begin;
+                }
+                return count;
+            }
+
+            bool contiguous(value_type*& begin, value_type*& end, size_t consume)
+            {
+                return contiguous(begin, end, consume, typename is_contiguous_collection<collection_type>::type());
+            }
+
         private:
-            std::unique_ptr<collection_type> m_collection;
+            bool contiguous(value_type*& begin, value_type*& end, size_t consume, boost::true_type)
+            {
+                begin = m_begin == m_end ? nullptr : boost::addressof(*m_begin);
+                end = begin + (m_end - m_begin);
+                m_begin += std::min<size_t>(consume, m_end - m_begin);
+                return true;
+            }
+
+            bool contiguous(value_type*&, value_type*&, size_t, boost::false_type)
+            {
+                return false;
+            }
+
+            embedded_collection<collection_type> m_collection;
             iterator_type m_begin, m_end;
         };
 
@@ -257,12 +698,12 @@ namespace polymorphic_collections
         };
         
         template <typename T, typename C>
-        inline auto make_enumerator_adapter(C&& collection, typename C::iterator* dummy = nullptr)
+        inline auto make_enumerator_adapter(C&& collection, memory_resource* resource = nullptr, typename C::iterator* dummy = nullptr)
             -> typename boost::enable_if<supports_embedded_enumerator_adapter<T, typename boost::remove_reference<C>::type>,
                                          embedded_enumerator_adapter<typename boost::remove_reference<C>::type>>::type
         {
             // FIXME: the dummy parameter should not be necessary but Visual C++ chokes if it isn't present.
-            return embedded_enumerator_adapter<typename boost::remove_reference<C>::type>(std::forward<C>(collection));
+            return embedded_enumerator_adapter<typename boost::remove_reference<C>::type>(std::forward<C>(collection), resource);
         }
         
         //
@@ -289,6 +730,7 @@ namespace polymorphic_collections
             typedef F function_type;
             typedef typename is_callable<F>::return_type::value_type return_type;
             typedef typename boost::remove_reference<return_type>::type value_type;
+            typedef boost::false_type splittable;
 
             functional_enumerator_adapter(const function_type& func)
             : m_func(func)
@@ -319,6 +761,29 @@ namespace polymorphic_collections
                 }
             }
 
+            //  The value returned by the functor is only held until the next call,
+            //  so at most one item can be produced per batch.
+            template <typename U>
+            size_t next_n(U** out, size_t max)
+            {
+                if (max == 0)
+                {
+                    return 0;
+                }
+                auto value = next();
+                if (value)
+                {
+                    out[0] = boost::addressof(*value);
+                    return 1;
+                }
+                return 0;
+            }
+
+            bool contiguous(value_type*&, value_type*&, size_t)
+            {
+                return false;
+            }
+
         private:
             function_type m_func;
             boost::optional<return_type> m_value;
@@ -331,13 +796,21 @@ namespace polymorphic_collections
         };
 
         template <typename T, typename F>
-        inline auto make_enumerator_adapter(F&& func)
+        inline auto make_enumerator_adapter(F&& func, memory_resource* = nullptr)
             -> typename boost::enable_if<supports_functional_enumerator_adapter<T, typename boost::remove_reference<F>::type>,
                                          functional_enumerator_adapter<typename boost::remove_reference<F>::type>>::type
         {
             return functional_enumerator_adapter<typename boost::remove_reference<F>::type>(std::forward<F>(func));
         }
         
+        //  A static_enumerator is converted to an enumerator by moving its adapter
+        //  into the enumerator.
+        template <typename T, typename U, typename A>
+        inline A make_enumerator_adapter(static_enumerator<U, A>&& e, memory_resource* = nullptr)
+        {
+            return std::move(e.adapter());
+        }
+
         //  FIXME: Visual C++ has issues with decltype resolving to int if template
         //  substitution fails instead of giving an error message; typically this
         //  results in errors much deeper in the template code, which are extremely
@@ -350,11 +823,11 @@ namespace polymorphic_collections
         };
 
         template <typename T, typename U>
-        inline auto make_enumerator_adapter_proxy(U&& param) 
+        inline auto make_enumerator_adapter_proxy(U&& param, memory_resource* resource = nullptr) 
             -> enumerator_adapter_proxy<T, typename get_enumerator_adapter_type<T, U>::type>
         {
             return enumerator_adapter_proxy<T, typename get_enumerator_adapter_type<T, U>::type>
-                (make_enumerator_adapter<T>(std::forward<U>(param)));
+                (make_enumerator_adapter<T>(std::forward<U>(param), resource));
         }
 
 /*        
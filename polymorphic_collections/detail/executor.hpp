@@ -0,0 +1,128 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYMORPHIC_COLLECTIONS_DETAIL_EXECUTOR_HPP
+#define POLYMORPHIC_COLLECTIONS_DETAIL_EXECUTOR_HPP
+
+#include <deque>
+#include <exception>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+#include "common.hpp"
+
+namespace polymorphic_collections
+{
+    namespace detail
+    {
+        //
+        //  Unit of work scheduled on the executor: calls run(context, index).
+        //
+        struct executor_task
+        {
+            void (*run)(void* context, size_t index);
+            void* context;
+            size_t index;
+        };
+
+        //
+        //  Double-ended task queue owned by one worker thread. The owner pushes and
+        //  pops at the back (most recently scheduled first, which keeps its working
+        //  set warm) while other threads steal from the front.
+        //
+        class work_stealing_queue : public boost::noncopyable
+        {
+        public:
+            void push(const executor_task& task)
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                m_tasks.push_back(task);
+            }
+
+            bool pop(executor_task& task)
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                if (m_tasks.empty())
+                {
+                    return false;
+                }
+                task = m_tasks.back();
+                m_tasks.pop_back();
+                return true;
+            }
+
+            bool steal(executor_task& task)
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                if (m_tasks.empty())
+                {
+                    return false;
+                }
+                task = m_tasks.front();
+                m_tasks.pop_front();
+                return true;
+            }
+
+        private:
+            boost::mutex m_mutex;
+            std::deque<executor_task> m_tasks;
+        };
+
+        //
+        //  Group of tasks calling the same functor with different indices, which
+        //  is waited on as a whole. Lives on the stack of the waiting thread.
+        //
+        template <typename F>
+        class task_batch : public boost::noncopyable
+        {
+        public:
+            task_batch(F& func, size_t count)
+            : m_func(func), m_pending(count), m_failed(false)
+            {
+            }
+
+            static void run(void* context, size_t index)
+            {
+                task_batch* batch = static_cast<task_batch*>(context);
+                try
+                {
+                    batch->m_func(index);
+                }
+                catch (...)
+                {
+                    if (!batch->m_failed.exchange(true))
+                    {
+                        batch->m_exception = std::current_exception();
+                    }
+                }
+                //  Must be the last access to the batch, which may be destroyed
+                //  as soon as the waiting thread observes completion.
+                batch->m_pending.fetch_sub(1, boost::memory_order_release);
+            }
+
+            bool done() const
+            {
+                return m_pending.load(boost::memory_order_acquire) == 0;
+            }
+
+            void rethrow_if_failed()
+            {
+                if (m_failed.load())
+                {
+                    std::rethrow_exception(m_exception);
+                }
+            }
+
+        private:
+            F& m_func;
+            boost::atomic<size_t> m_pending;
+            boost::atomic<bool> m_failed;
+            std::exception_ptr m_exception;
+        };
+    }
+}
+
+#endif  // POLYMORPHIC_COLLECTIONS_DETAIL_EXECUTOR_HPP
@@ -0,0 +1,155 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYMORPHIC_COLLECTIONS_DETAIL_OPEN_TABLE_HPP
+#define POLYMORPHIC_COLLECTIONS_DETAIL_OPEN_TABLE_HPP
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
+
+namespace polymorphic_collections
+{
+    namespace detail
+    {
+        //
+        //  Small hash table with open addressing, used to combine the values of
+        //  duplicate keys before they reach the actual collection. The entries
+        //  are stored densely in insertion order, so that they can be moved out
+        //  in one pass; the table itself only holds their indices, probed
+        //  linearly, and is kept at most half full.
+        //
+        //  Parameters:
+        //      [template] K
+        //          Key type.
+        //      [template] T
+        //          Value type.
+        //      [template] H
+        //          Hash function type.
+        //      [template] E
+        //          Key equality function type.
+        //
+        template <typename K, typename T, typename H = boost::hash<K>, typename E = std::equal_to<K>>
+        class open_table
+        {
+        public:
+            typedef K key_type;
+            typedef T value_type;
+            typedef std::pair<K, T> entry_type;
+
+            open_table()
+            : m_mask(0)
+            {
+            }
+
+            //
+            //  Adds a key and its value, or if the key is already present,
+            //  replaces its value by merge(existing, value).
+            //
+            template <typename F>
+            void combine(key_type&& key, value_type&& value, F& merge)
+            {
+                if ((m_entries.size() + 1) * 2 > m_slots.size())
+                {
+                    grow();
+                }
+                size_t hash = mix(m_hash(key));
+                size_t i = hash & m_mask;
+                while (m_slots[i] != free_slot)
+                {
+                    boost::uint32_t index = m_slots[i];
+                    if (m_hashes[index] == hash && m_equal(m_entries[index].first, key))
+                    {
+                        value_type& existing = m_entries[index].second;
+                        existing = merge(existing, std::move(value));
+                        return;
+                    }
+                    i = (i + 1) & m_mask;
+                }
+                m_hashes.push_back(hash);
+                try
+                {
+                    m_entries.push_back(entry_type(std::move(key), std::move(value)));
+                }
+                catch (...)
+                {
+                    m_hashes.pop_back();
+                    throw;
+                }
+                m_slots[i] = static_cast<boost::uint32_t>(m_entries.size() - 1);
+            }
+
+            //  Number of distinct keys.
+            size_t size() const
+            {
+                return m_entries.size();
+            }
+
+            bool empty() const
+            {
+                return m_entries.empty();
+            }
+
+            //  Entries in insertion order; they may be moved from before clear().
+            std::vector<entry_type>& entries()
+            {
+                return m_entries;
+            }
+
+            //  Removes all of the entries, keeping the memory for reuse.
+            void clear()
+            {
+                if (!m_entries.empty())
+                {
+                    m_entries.clear();
+                    m_hashes.clear();
+                    std::fill(m_slots.begin(), m_slots.end(), free_slot);
+                }
+            }
+
+        private:
+            static const boost::uint32_t free_slot = 0xFFFFFFFF;
+
+            //  boost::hash is the identity for integers; the table only uses the
+            //  low bits of the hash, so the high bits are folded in.
+            static size_t mix(size_t hash)
+            {
+                boost::uint64_t h = static_cast<boost::uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+                return static_cast<size_t>(h ^ (h >> 32));
+            }
+
+            void grow()
+            {
+                size_t capacity = m_slots.empty() ? 16 : m_slots.size() * 2;
+                m_slots.assign(capacity, free_slot);
+                m_mask = capacity - 1;
+                for (size_t index = 0; index < m_entries.size(); ++index)
+                {
+                    size_t i = m_hashes[index] & m_mask;
+                    while (m_slots[i] != free_slot)
+                    {
+                        i = (i + 1) & m_mask;
+                    }
+                    m_slots[i] = static_cast<boost::uint32_t>(index);
+                }
+            }
+
+            std::vector<boost::uint32_t> m_slots;
+            std::vector<size_t> m_hashes;
+            std::vector<entry_type> m_entries;
+            size_t m_mask;
+            H m_hash;
+            E m_equal;
+        };
+
+        template <typename K, typename T, typename H, typename E>
+        const boost::uint32_t open_table<K, T, H, E>::free_slot;
+    }
+}
+
+#endif  // POLYMORPHIC_COLLECTIONS_DETAIL_OPEN_TABLE_HPP
@@ -0,0 +1,338 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYMORPHIC_COLLECTIONS_DETAIL_SIMD_HPP
+#define POLYMORPHIC_COLLECTIONS_DETAIL_SIMD_HPP
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+#include <boost/mpl/if.hpp>
+#include <boost/type_traits.hpp>
+
+//
+//  Vectorized kernels used by the algorithms on contiguous ranges of arithmetic
+//  types. SSE2 is part of the x86-64 baseline; the AVX2 kernels are selected at
+//  run time when the processor supports them. Other architectures, or builds
+//  defining POLYMORPHIC_COLLECTIONS_NO_SIMD, use the scalar algorithms.
+//
+#if !defined(POLYMORPHIC_COLLECTIONS_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define POLYMORPHIC_COLLECTIONS_SIMD 1
+#endif
+
+#ifdef POLYMORPHIC_COLLECTIONS_SIMD
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//  GCC and Clang only allow AVX2 intrinsics in functions compiled for AVX2.
+#if defined(__GNUC__)
+#define POLYMORPHIC_COLLECTIONS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define POLYMORPHIC_COLLECTIONS_TARGET_AVX2
+#endif
+
+namespace polymorphic_collections
+{
+    namespace detail
+    {
+        namespace simd
+        {
+            //
+            //  Maps an element type to the type of its vector lanes, or void if
+            //  the type is not supported. Only equality is vectorized, so the
+            //  signedness of integers does not matter.
+            //
+            template <typename T, bool = boost::is_integral<T>::value && !boost::is_same<T, bool>::value>
+            struct lane_type
+            {
+                typedef void type;
+            };
+
+            template <typename T>
+            struct lane_type<T, true>
+            {
+                typedef typename boost::mpl::if_c<sizeof(T) == 4, boost::int32_t,
+                        typename boost::mpl::if_c<sizeof(T) == 8, boost::int64_t, void>::type>::type type;
+            };
+
+            template <>
+            struct lane_type<float, false>
+            {
+                typedef float type;
+            };
+
+            template <>
+            struct lane_type<double, false>
+            {
+                typedef double type;
+            };
+
+            template <typename T>
+            struct is_supported
+                : boost::integral_constant<bool, !boost::is_void<typename lane_type<T>::type>::value>
+            {
+            };
+
+            inline bool has_avx2()
+            {
+                static const bool result = []() -> bool
+                {
+#if defined(_MSC_VER)
+                    int info[4];
+                    __cpuid(info, 1);
+                    bool os_saves_ymm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+                                        (_xgetbv(0) & 6) == 6;
+                    __cpuidex(info, 7, 0);
+                    return os_saves_ymm && (info[1] & (1 << 5));
+#else
+                    return __builtin_cpu_supports("avx2") != 0;
+#endif
+                }();
+                return result;
+            }
+
+            //  Masks have at most 8 bits set.
+            inline unsigned int popcount(unsigned int mask)
+            {
+                mask = mask - ((mask >> 1) & 0x55);
+                mask = (mask & 0x33) + ((mask >> 2) & 0x33);
+                return (mask + (mask >> 4)) & 0x0f;
+            }
+
+            inline unsigned int lowest_bit(unsigned int mask)
+            {
+#if defined(_MSC_VER)
+                unsigned long index;
+                _BitScanForward(&index, mask);
+                return index;
+#else
+                return __builtin_ctz(mask);
+#endif
+            }
+
+            //
+            //  Lane traits: load a vector, broadcast a scalar, and compare two vectors
+            //  for equality yielding one bit per lane.
+            //
+            namespace sse2
+            {
+                template <typename S> struct lanes;
+
+                template <>
+                struct lanes<boost::int32_t>
+                {
+                    typedef __m128i vector;
+                    static const size_t width = 4;
+                    static vector load(const void* p) { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+                    static vector broadcast(boost::int32_t v) { return _mm_set1_epi32(v); }
+                    static unsigned int equal(vector a, vector b) { return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b))); }
+                };
+
+                template <>
+                struct lanes<boost::int64_t>
+                {
+                    typedef __m128i vector;
+                    static const size_t width = 2;
+                    static vector load(const void* p) { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+                    static vector broadcast(boost::int64_t v) { return _mm_set1_epi64x(v); }
+                    static unsigned int equal(vector a, vector b)
+                    {
+                        //  SSE2 has no 64-bit comparison: both halves must match.
+                        __m128i halves = _mm_cmpeq_epi32(a, b);
+                        __m128i both = _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+                        return _mm_movemask_pd(_mm_castsi128_pd(both));
+                    }
+                };
+
+                template <>
+                struct lanes<float>
+                {
+                    typedef __m128 vector;
+                    static const size_t width = 4;
+                    static vector load(const void* p) { return _mm_loadu_ps(static_cast<const float*>(p)); }
+                    static vector broadcast(float v) { return _mm_set1_ps(v); }
+                    static unsigned int equal(vector a, vector b) { return _mm_movemask_ps(_mm_cmpeq_ps(a, b)); }
+                };
+
+                template <>
+                struct lanes<double>
+                {
+                    typedef __m128d vector;
+                    static const size_t width = 2;
+                    static vector load(const void* p) { return _mm_loadu_pd(static_cast<const double*>(p)); }
+                    static vector broadcast(double v) { return _mm_set1_pd(v); }
+                    static unsigned int equal(vector a, vector b) { return _mm_movemask_pd(_mm_cmpeq_pd(a, b)); }
+                };
+            }
+
+            namespace avx2
+            {
+                template <typename S> struct lanes;
+
+                template <>
+                struct lanes<boost::int32_t>
+                {
+                    typedef __m256i vector;
+                    static const size_t width = 8;
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static vector load(const void* p) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static vector broadcast(boost::int32_t v) { return _mm256_set1_epi32(v); }
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static unsigned int equal(vector a, vector b) { return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b))); }
+                };
+
+                template <>
+                struct lanes<boost::int64_t>
+                {
+                    typedef __m256i vector;
+                    static const size_t width = 4;
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static vector load(const void* p) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static vector broadcast(boost::int64_t v) { return _mm256_set1_epi64x(v); }
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static unsigned int equal(vector a, vector b) { return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b))); }
+                };
+
+                template <>
+                struct lanes<float>
+                {
+                    typedef __m256 vector;
+                    static const size_t width = 8;
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static vector load(const void* p) { return _mm256_loadu_ps(static_cast<const float*>(p)); }
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static vector broadcast(float v) { return _mm256_set1_ps(v); }
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static unsigned int equal(vector a, vector b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)); }
+                };
+
+                template <>
+                struct lanes<double>
+                {
+                    typedef __m256d vector;
+                    static const size_t width = 4;
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static vector load(const void* p) { return _mm256_loadu_pd(static_cast<const double*>(p)); }
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static vector broadcast(double v) { return _mm256_set1_pd(v); }
+                    POLYMORPHIC_COLLECTIONS_TARGET_AVX2 static unsigned int equal(vector a, vector b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_EQ_OQ)); }
+                };
+            }
+
+//
+//  The kernels are identical for every instruction set but must be compiled
+//  separately for each, so that AVX2 instructions never leak into the code
+//  used on processors without it. Tails shorter than a vector are handled
+//  with scalar code on the original element type.
+//
+#define POLYMORPHIC_COLLECTIONS_SIMD_KERNELS(isa, target)                                   \
+            namespace isa                                                                   \
+            {                                                                               \
+                template <typename T>                                                       \
+                target inline size_t count(const T* first, const T* last, T value)         \
+                {                                                                           \
+                    typedef lanes<typename lane_type<T>::type> lanes_type;                  \
+                    typename lanes_type::vector needle = lanes_type::broadcast(value);      \
+                    size_t result = 0;                                                      \
+                    for (; size_t(last - first) >= lanes_type::width; first += lanes_type::width) \
+                    {                                                                       \
+                        result += popcount(lanes_type::equal(lanes_type::load(first), needle)); \
+                    }                                                                       \
+                    for (; first != last; ++first)                                          \
+                    {                                                                       \
+                        result += *first == value;                                          \
+                    }                                                                       \
+                    return result;                                                          \
+                }                                                                           \
+                                                                                            \
+                template <typename T>                                                       \
+                target inline const T* find(const T* first, const T* last, T value)        \
+                {                                                                           \
+                    typedef lanes<typename lane_type<T>::type> lanes_type;                  \
+                    typename lanes_type::vector needle = lanes_type::broadcast(value);      \
+                    for (; size_t(last - first) >= lanes_type::width; first += lanes_type::width) \
+                    {                                                                       \
+                        unsigned int mask = lanes_type::equal(lanes_type::load(first), needle); \
+                        if (mask)                                                           \
+                        {                                                                   \
+                            return first + lowest_bit(mask);                                \
+                        }                                                                   \
+                    }                                                                       \
+                    for (; first != last; ++first)                                          \
+                    {                                                                       \
+                        if (*first == value)                                                \
+                        {                                                                   \
+                            return first;                                                   \
+                        }                                                                   \
+                    }                                                                       \
+                    return last;                                                            \
+                }                                                                           \
+                                                                                            \
+                template <typename T>                                                       \
+                target inline bool equal(const T* first, const T* last, const T* other)    \
+                {                                                                           \
+                    typedef lanes<typename lane_type<T>::type> lanes_type;                  \
+                    const unsigned int all = (1u << lanes_type::width) - 1;                 \
+                    for (; size_t(last - first) >= lanes_type::width;                       \
+                           first += lanes_type::width, other += lanes_type::width)          \
+                    {                                                                       \
+                        if (lanes_type::equal(lanes_type::load(first), lanes_type::load(other)) != all) \
+                        {                                                                   \
+                            return false;                                                   \
+                        }                                                                   \
+                    }                                                                       \
+                    for (; first != last; ++first, ++other)                                 \
+                    {                                                                       \
+                        if (!(*first == *other))                                            \
+                        {                                                                   \
+                            return false;                                                   \
+                        }                                                                   \
+                    }                                                                       \
+                    return true;                                                            \
+                }                                                                           \
+            }
+
+            POLYMORPHIC_COLLECTIONS_SIMD_KERNELS(sse2, )
+            POLYMORPHIC_COLLECTIONS_SIMD_KERNELS(avx2, POLYMORPHIC_COLLECTIONS_TARGET_AVX2)
+
+#undef POLYMORPHIC_COLLECTIONS_SIMD_KERNELS
+
+            //
+            //  Entry points, dispatching on the processor's capabilities.
+            //
+
+            template <typename T>
+            inline size_t count(const T* first, const T* last, T value)
+            {
+                return has_avx2() ? avx2::count(first, last, value) : sse2::count(first, last, value);
+            }
+
+            template <typename T>
+            inline const T* find(const T* first, const T* last, T value)
+            {
+                return has_avx2() ? avx2::find(first, last, value) : sse2::find(first, last, value);
+            }
+
+            template <typename T>
+            inline bool equal(const T* first, const T* last, const T* other)
+            {
+                return has_avx2() ? avx2::equal(first, last, other) : sse2::equal(first, last, other);
+            }
+        }
+    }
+}
+
+#else
+
+namespace polymorphic_collections
+{
+    namespace detail
+    {
+        namespace simd
+        {
+            template <typename T>
+            struct is_supported : boost::false_type
+            {
+            };
+        }
+    }
+}
+
+#endif  // POLYMORPHIC_COLLECTIONS_SIMD
+
+#endif  // POLYMORPHIC_COLLECTIONS_DETAIL_SIMD_HPP
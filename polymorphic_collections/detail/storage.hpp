@@ -0,0 +1,254 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYMORPHIC_COLLECTIONS_DETAIL_STORAGE_HPP
+#define POLYMORPHIC_COLLECTIONS_DETAIL_STORAGE_HPP
+
+#include <new>
+#include <boost/config.hpp>
+#include <boost/static_assert.hpp>
+
+#include "common.hpp"
+
+namespace polymorphic_collections
+{
+    namespace detail
+    {
+        //
+        //  Source of the heap blocks of an adapter_storage: the global heap, or
+        //  for storage policies using a memory resource, that resource.
+        //
+        template <typename S, bool = S::uses_resource>
+        class storage_allocator
+        {
+        public:
+            memory_resource* resource() const
+            {
+                return nullptr;
+            }
+
+            void adopt_resource(memory_resource*)
+            {
+            }
+        };
+
+        template <typename S>
+        class storage_allocator<S, true>
+        {
+        public:
+            storage_allocator()
+            : m_resource(nullptr)
+            {
+            }
+
+            memory_resource* resource() const
+            {
+                return m_resource;
+            }
+
+            void adopt_resource(memory_resource* resource)
+            {
+                m_resource = resource;
+            }
+
+        private:
+            memory_resource* m_resource;
+        };
+
+        //
+        //  Holds the type-erased adapter of a facade: a pointer to the function
+        //  table of the adapter, and the adapter itself, either in the internal
+        //  buffer or on the heap. The facades inherit from this class privately.
+        //
+        //  The buffer comes first (after the resource pointer, if any), so that
+        //  its alignment is also the alignment of the facade.
+        //
+        //  Parameters:
+        //      [template] V
+        //          Function table type (e.g. enumerator_adapter_vtable<T>).
+        //      [template] S
+        //          Storage policy (see policy.hpp).
+        //
+        template <typename V, typename S>
+        class adapter_storage : public storage_allocator<S>
+        {
+        public:
+            typedef V vtable_type;
+            typedef S storage_policy;
+            typedef adapter_storage<V, S> this_type;
+
+            BOOST_STATIC_ASSERT_MSG(S::size > 0, "The buffer of a storage policy cannot be empty.");
+
+            adapter_storage()
+            : m_vtable(nullptr), m_adapter(nullptr)
+            {
+            }
+
+            ~adapter_storage()
+            {
+                dispose();
+            }
+
+            //  Whether a proxy of type A is stored in the internal buffer.
+            template <typename A>
+            struct fits
+            {
+                static const bool value = sizeof(A) <= S::size &&
+                                          boost::alignment_of<A>::value <= S::alignment;
+            };
+
+            //  Whether the buffer can hold anything the buffer of storage policy
+            //  S_ holds.
+            template <typename S_>
+            struct buffer_holds
+            {
+                static const bool value = S_::size <= S::size && S_::alignment <= S::alignment;
+            };
+
+            //
+            //  Returns memory for an adapter with the given function table: the
+            //  internal buffer if the adapter fits in it, otherwise a heap block,
+            //  or nullptr if the storage policy is strict.
+            //
+            void* allocate(const vtable_type* vtable)
+            {
+                if (vtable->size <= S::size && vtable->alignment <= S::alignment)
+                {
+                    return m_storage;
+                }
+                return S::strict ? nullptr : allocate_from(this->resource(), vtable->size, vtable->alignment);
+            }
+
+            void deallocate(void* ptr, const vtable_type* vtable)
+            {
+                if (ptr != m_storage)
+                {
+                    deallocate_to(this->resource(), ptr, vtable->size, vtable->alignment);
+                }
+            }
+
+            template <typename A>
+            void construct(A&& adapter)
+            {
+                typedef typename boost::remove_reference<A>::type proxy_type;
+                BOOST_STATIC_ASSERT_MSG(!S::strict || fits<proxy_type>::value,
+                                        "The adapter does not fit in the strict_inline storage of the facade.");
+
+                void* ptr = allocate(&proxy_type::vtable);
+                try
+                {
+                    new (ptr) proxy_type(std::move(adapter));
+                }
+                catch (...)
+                {
+                    deallocate(ptr, &proxy_type::vtable);
+                    throw;
+                }
+                m_adapter = ptr;
+                m_vtable = &proxy_type::vtable;
+            }
+
+            //
+            //  Takes over the adapter of rhs, which is left empty. Heap adapters
+            //  change hands if both sides allocate from the same place; other
+            //  adapters are relocated.
+            //
+            template <typename S_>
+            void move_from(adapter_storage<V, S_>& rhs)
+            {
+                BOOST_STATIC_ASSERT_MSG(!S::strict || (S_::strict && S_::size <= S::size && S_::alignment <= S::alignment),
+                                        "Facades with strict_inline storage can only be moved from facades with smaller strict_inline storage.");
+
+                move_from(rhs, boost::integral_constant<bool, !S::uses_resource && !S_::uses_resource && buffer_holds<S_>::value>());
+            }
+
+            //  Between buffers which never need a new heap block (e.g. two
+            //  default_storage facades), heap adapters always change hands and
+            //  inline adapters always fit: the move only relocates the adapter,
+            //  which stays simple enough to be inlined into the facades.
+            template <typename S_>
+            void move_from(adapter_storage<V, S_>& rhs, boost::true_type)
+            {
+                if (rhs.m_adapter == rhs.m_storage)
+                {
+                    relocate_adapter(rhs.m_vtable, rhs.m_adapter, m_storage);
+                    m_adapter = m_storage;
+                }
+                else
+                {
+                    m_adapter = rhs.m_adapter;
+                }
+                m_vtable = rhs.m_vtable;
+                rhs.m_vtable = nullptr;
+                rhs.m_adapter = nullptr;
+            }
+
+            template <typename S_>
+            void move_from(adapter_storage<V, S_>& rhs, boost::false_type)
+            {
+                if (!rhs.m_adapter)
+                {
+                    return;
+                }
+                else if (rhs.m_adapter != rhs.m_storage && rhs.resource() == this->resource())
+                {
+                    m_adapter = rhs.m_adapter;
+                }
+                else
+                {
+                    m_adapter = relocate_from(rhs);
+                }
+                m_vtable = rhs.m_vtable;
+                rhs.m_vtable = nullptr;
+                rhs.m_adapter = nullptr;
+            }
+
+            //  Moves the adapter of rhs to memory of this storage and returns
+            //  it; kept out of line so that move_from() can be inlined.
+            template <typename S_>
+            BOOST_NOINLINE void* relocate_from(adapter_storage<V, S_>& rhs)
+            {
+                void* ptr = allocate(rhs.m_vtable);
+                try
+                {
+                    relocate_adapter(rhs.m_vtable, rhs.m_adapter, ptr);
+                }
+                catch (...)
+                {
+                    deallocate(ptr, rhs.m_vtable);
+                    throw;
+                }
+                rhs.deallocate(rhs.m_adapter, rhs.m_vtable);
+                return ptr;
+            }
+
+            //  Move construction also takes over the memory resource, if both
+            //  sides use one.
+            template <typename S_>
+            void move_construct_from(adapter_storage<V, S_>& rhs)
+            {
+                this->adopt_resource(rhs.resource());
+                move_from(rhs);
+            }
+
+            void dispose()
+            {
+                if (m_adapter)
+                {
+                    m_vtable->destroy(m_adapter);
+                    deallocate(m_adapter, m_vtable);
+                    m_vtable = nullptr;
+                    m_adapter = nullptr;
+                }
+            }
+
+            alignas(S::alignment) char m_storage[S::size];
+            const vtable_type* m_vtable;
+            void* m_adapter;
+        };
+    }
+}
+
+#endif  // POLYMORPHIC_COLLECTIONS_DETAIL_STORAGE_HPP
@@ -0,0 +1,91 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYMORPHIC_COLLECTIONS_DETAIL_THREAD_SLOTS_HPP
+#define POLYMORPHIC_COLLECTIONS_DETAIL_THREAD_SLOTS_HPP
+
+#include <cstddef>
+#include <boost/utility.hpp>
+
+#include "../policy.hpp"
+#include "backoff.hpp"
+
+namespace polymorphic_collections
+{
+    namespace detail
+    {
+        //
+        //  Array of buffers indexed by thread (see thread_index()), used by the
+        //  buffered adapters: each thread works on a buffer of its own, and the
+        //  buffers are drained one at a time. Threads beyond the number of slots
+        //  share them.
+        //
+        //  A slot is only contended while another thread drains it, so it is
+        //  protected by a spin_lock. Each slot has a cache line of its own.
+        //
+        //  Parameters:
+        //      [template] B
+        //          Buffer type; it must be default constructible.
+        //      [template] N
+        //          Number of slots.
+        //
+        template <typename B, size_t N = 64>
+        class thread_slots : public boost::noncopyable
+        {
+        public:
+            typedef B buffer_type;
+            typedef thread_slots<B, N> this_type;
+
+            static const size_t slot_count = N;
+
+            //  Calls func(buffer) with the buffer of the calling thread locked.
+            template <typename F>
+            void with_own(F func)
+            {
+                with_slot(m_slots[thread_index() % N], func);
+            }
+
+            //  Calls func(buffer) for each buffer in turn, with that buffer
+            //  locked; stops at the first exception.
+            template <typename F>
+            void for_each(F func)
+            {
+                for (size_t i = 0; i < N; ++i)
+                {
+                    with_slot(m_slots[i], func);
+                }
+            }
+
+        private:
+            struct alignas(cache_line_size) slot : public spin_lock
+            {
+                using spin_lock::lock;
+                using spin_lock::unlock;
+
+                buffer_type buffer;
+            };
+
+            template <typename F>
+            static void with_slot(slot& s, F& func)
+            {
+                s.lock();
+                try
+                {
+                    func(s.buffer);
+                }
+                catch (...)
+                {
+                    s.unlock();
+                    throw;
+                }
+                s.unlock();
+            }
+
+            slot m_slots[N];
+        };
+    }
+}
+
+#endif  // POLYMORPHIC_COLLECTIONS_DETAIL_THREAD_SLOTS_HPP
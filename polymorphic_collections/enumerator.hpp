@@ -15,6 +15,7 @@
 #include <boost/utility.hpp>
 
 #include "policy.hpp"
+#include "detail/storage.hpp"
 #include "detail/enumerator.hpp"
 
 namespace polymorphic_collections
@@ -29,22 +30,25 @@ namespace polymorphic_collections
     //          if the objects are immutable.
     //      [template] P1, ...
     //          Policies (see policy.hpp)
+    //      [template] S
+    //          Storage policy for the type-erased adapter (see policy.hpp).
     //
-    template <typename T, typename P1 = no_lock>
-    class enumerator : public P1, 
+    template <typename T, typename P1 = no_lock, typename S = default_storage>
+    class enumerator : public P1,
+                       private detail::adapter_storage<detail::enumerator_adapter_vtable<T>, S>,
                        public boost::noncopyable
     {
     public:
         typedef T value_type;
-        typedef enumerator<T, P1> this_type;
+        typedef enumerator<T, P1, S> this_type;
+        typedef S storage_policy;
         typedef P1 lock_policy;
 
         //  Size, in bytes, of the internal storage buffer used to store the
         //  type-erased adapter object, thereby avoiding a heap allocation.
-        static const size_t internal_storage_size = 32 - sizeof(ptrdiff_t);
+        static const size_t internal_storage_size = S::size;
 
         enumerator()
-        : m_adapter(nullptr)
         {
             
         }
@@ -52,57 +56,45 @@ namespace polymorphic_collections
         template <typename U>
         enumerator(detail::enumerator_adapter_proxy<T, U>&& adapter)
         {
-            size_t proxy_size = sizeof(adapter);
-            if (proxy_size <= internal_storage_size)
-            {
-                m_adapter = new (m_storage) detail::enumerator_adapter_proxy<T, U>(std::move(adapter));
-            }
-            else
-            {
-                m_adapter = new detail::enumerator_adapter_proxy<T, U>(std::move(adapter));
-            }
+            construct(std::move(adapter));
         }
 
-        template <typename _P1>
-        enumerator(enumerator<T, _P1>&& rhs)
+        template <typename _P1, typename _S>
+        enumerator(enumerator<T, _P1, _S>&& rhs)
         {
-            if (reinterpret_cast<char*>(rhs.m_adapter) == rhs.m_storage)
-            {
-                m_adapter = rhs.m_adapter->move(m_storage);
-            }
-            else
-            {
-                m_adapter = rhs.m_adapter;
-            }
-            rhs.m_adapter = nullptr;
+            move_construct_from(rhs);
         }
 
         template <typename U>
         enumerator(U&& param)
-        : m_adapter(nullptr)
         {
             *this = detail::make_enumerator_adapter_proxy<T>(std::forward<U>(param));
         }
 
+        //
+        //  Constructs the enumerator with a storage policy using a memory resource
+        //  (see resource_storage), which will provide the memory for the adapter
+        //  if it does not fit in the internal buffer, and for any collection
+        //  embedded in the adapter.
+        //
+        template <typename U>
+        enumerator(U&& param, memory_resource* resource)
+        {
+            BOOST_STATIC_ASSERT_MSG(S::uses_resource, "The storage policy of the enumerator does not use a memory resource.");
+            this->adopt_resource(resource);
+            construct(detail::make_enumerator_adapter_proxy<T>(std::forward<U>(param), this->resource()));
+        }
+
         ~enumerator()
         {
             dispose();
         }
 
-        template <typename _P1>
-        this_type& operator=(enumerator<T, _P1>&& rhs)
+        template <typename _P1, typename _S>
+        this_type& operator=(enumerator<T, _P1, _S>&& rhs)
         {
             dispose();
-
-            if (reinterpret_cast<char*>(rhs.m_adapter) == rhs.m_storage)
-            {
-                m_adapter = rhs.m_adapter->move(m_storage);
-            }
-            else
-            {
-                m_adapter = rhs.m_adapter;
-            }
-            rhs.m_adapter = nullptr;
+            move_from(rhs);
             return *this;
         }
 
@@ -110,24 +102,14 @@ namespace polymorphic_collections
         this_type& operator=(detail::enumerator_adapter_proxy<T, U>&& adapter)
         {
             dispose();
-
-            size_t proxy_size = sizeof(adapter);
-            if (proxy_size <= internal_storage_size)
-            {
-                m_adapter = new (m_storage) detail::enumerator_adapter_proxy<T, U>(std::move(adapter));
-            }
-            else
-            {
-                m_adapter = new detail::enumerator_adapter_proxy<T, U>(std::move(adapter));
-            }
-
+            construct(std::move(adapter));
             return *this;
         }
 
         template <typename U>
         this_type& operator=(U&& param)
         {
-            *this = detail::make_enumerator_adapter_proxy<T>(std::forward<U>(param));
+            *this = detail::make_enumerator_adapter_proxy<T>(std::forward<U>(param), this->resource());
             return *this;
         }
 
@@ -143,7 +125,7 @@ namespace polymorphic_collections
                 {
                     try
                     {
-                        boost::optional<T&> value = m_adapter->next();
+                        boost::optional<T&> value = m_vtable->next(m_adapter);
                         lock_policy::unlock();
                         return value;
                     }
@@ -160,29 +142,335 @@ namespace polymorphic_collections
             }
         }
 
-    private:
-        template <typename U, typename _P1>
-        friend class enumerator;
+        //
+        //  Retrieves a block of items in a single call, storing pointers to them
+        //  in the caller-provided buffer. The lock is only taken once for the
+        //  whole block.
+        //
+        //  Parameters:
+        //      [out] out
+        //          Buffer which will receive pointers to the items. Must have room
+        //          for at least max pointers.
+        //      [in] max
+        //          Maximum number of items to retrieve.
+        //
+        //  Returns:
+        //      The number of items stored in out. This may be less than max even
+        //      if the enumerator is not exhausted (e.g. functional enumerators
+        //      produce one item per call); zero means there are no more items.
+        //      The pointers remain valid for as long as a reference returned by
+        //      next() would.
+        //
+        size_t next_n(T** out, size_t max)
+        {
+            if (!m_adapter)
+            {
+                return 0;
+            }
+            else
+            {
+                if (lock_policy::lock())
+                {
+                    try
+                    {
+                        size_t count = m_vtable->next_n(m_adapter, out, max);
+                        lock_policy::unlock();
+                        return count;
+                    }
+                    catch (...)
+                    {
+                        lock_policy::unlock();
+                        throw;
+                    }
+                }
+                else
+                {
+                    return 0;
+                }
+            }
+        }
 
-        void dispose()
+        //
+        //  Exposes the remaining items as a raw range if the underlying collection
+        //  stores them contiguously (vectors, arrays, strings, pointer ranges).
+        //  On success the enumerator is advanced past the first consume items of
+        //  the returned range (all of them by default). Algorithms which stop
+        //  early can thus look at the range with a consume of 0, then call
+        //  try_contiguous() again to advance only past the items they used.
+        //
+        //  Parameters:
+        //      [in] consume
+        //          Number of items to advance past.
+        //
+        //  Returns:
+        //      A [begin, end) pair of pointers, or an empty value if the items are
+        //      not contiguous, in which case the enumerator is left untouched.
+        //      Concurrent enumerators only expose the range if all of it is
+        //      consumed, since other threads may claim part of it otherwise.
+        //
+        boost::optional<std::pair<T*, T*>> try_contiguous(size_t consume = ~static_cast<size_t>(0))
         {
-            if (m_adapter)
+            if (!m_adapter)
             {
-                if (reinterpret_cast<char*>(m_adapter) == m_storage)
+                return boost::none;
+            }
+            else
+            {
+                if (lock_policy::lock())
                 {
-                    m_adapter->~enumerator_adapter_interface();
+                    try
+                    {
+                        T* begin = nullptr;
+                        T* end = nullptr;
+                        bool result = m_vtable->contiguous(m_adapter, begin, end, consume);
+                        lock_policy::unlock();
+                        if (result)
+                        {
+                            return std::make_pair(begin, end);
+                        }
+                        return boost::none;
+                    }
+                    catch (...)
+                    {
+                        lock_policy::unlock();
+                        throw;
+                    }
                 }
                 else
                 {
-                    delete m_adapter;
+                    return boost::none;
                 }
-                m_adapter = nullptr;
             }
         }
-        detail::enumerator_adapter_interface<T>* m_adapter;
-        char m_storage[internal_storage_size];
+
+        //
+        //  Divides the remaining items between this enumerator and another one,
+        //  so that they can be consumed independently (e.g. on different threads).
+        //  This enumerator keeps the first half and tail receives the second.
+        //
+        //  Only enumerators over random-access ranges support splitting, in
+        //  constant time; other enumerators are left untouched. Splitting also
+        //  fails if tail has strict_inline storage too small for the adapter, or
+        //  if tail is this enumerator.
+        //
+        //  Parameters:
+        //      [out] tail
+        //          Enumerator which will receive the second half of the items.
+        //          Any previous contents are discarded.
+        //
+        //  Returns:
+        //      True if the enumerator was split.
+        //
+        template <typename _P1, typename _S>
+        bool split(enumerator<T, _P1, _S>& tail)
+        {
+            if (!m_adapter || !m_vtable->split || static_cast<const void*>(&tail) == this)
+            {
+                return false;
+            }
+            else
+            {
+                tail.dispose();
+                void* ptr = tail.allocate(m_vtable);
+                if (!ptr)
+                {
+                    return false;
+                }
+                if (lock_policy::lock())
+                {
+                    try
+                    {
+                        m_vtable->split(m_adapter, ptr);
+                        lock_policy::unlock();
+                    }
+                    catch (...)
+                    {
+                        lock_policy::unlock();
+                        tail.deallocate(ptr, m_vtable);
+                        throw;
+                    }
+                    tail.m_adapter = ptr;
+                    tail.m_vtable = m_vtable;
+                    return true;
+                }
+                else
+                {
+                    tail.deallocate(ptr, m_vtable);
+                    return false;
+                }
+            }
+        }
+
+        //  Memory resource used for heap allocations, or nullptr for the
+        //  global heap.
+        memory_resource* resource() const
+        {
+            return storage_type::resource();
+        }
+
+    private:
+        template <typename U, typename _P1, typename _S>
+        friend class enumerator;
+
+        typedef detail::adapter_storage<detail::enumerator_adapter_vtable<T>, S> storage_type;
+        using storage_type::allocate;
+        using storage_type::deallocate;
+        using storage_type::construct;
+        using storage_type::move_from;
+        using storage_type::move_construct_from;
+        using storage_type::dispose;
+        using storage_type::m_vtable;
+        using storage_type::m_adapter;
+    };
+
+    //
+    //  Enumerator which holds its adapter by value rather than type-erased, so
+    //  that calls go directly to the adapter and can be inlined. Meant for hot
+    //  loops where the source type is known; there is no lock policy.
+    //
+    //  A static_enumerator can be moved into an enumerator (with the same or a
+    //  compatible value type) when it has to cross an API boundary, after
+    //  which it must not be used anymore. The algorithms accept both.
+    //
+    //  Example:
+    //      std::vector<int> v;
+    //      auto e = make_static_enumerator<int>(v);
+    //      while (auto value = e.next()) { ... }
+    //      enumerator<int> erased = std::move(e);
+    //
+    //  Parameters:
+    //      [template] T
+    //          Value type exposed by the enumerator.
+    //      [template] A
+    //          Adapter type (see make_enumerator_adapter()).
+    //
+    template <typename T, typename A>
+    class static_enumerator : public boost::noncopyable
+    {
+    public:
+        typedef T value_type;
+        typedef A adapter_type;
+        typedef static_enumerator<T, A> this_type;
+
+        explicit static_enumerator(adapter_type&& adapter)
+        : m_adapter(std::move(adapter))
+        {
+        }
+
+        static_enumerator(this_type&& rhs)
+        : m_adapter(std::move(rhs.m_adapter))
+        {
+        }
+
+        boost::optional<T&> next()
+        {
+            auto value = m_adapter.next();
+            if (value)
+            {
+                return boost::optional<T&>(*value);
+            }
+            return boost::none;
+        }
+
+        //  See enumerator::next_n().
+        size_t next_n(T** out, size_t max)
+        {
+            return m_adapter.next_n(out, max);
+        }
+
+        //  See enumerator::try_contiguous().
+        boost::optional<std::pair<T*, T*>> try_contiguous(size_t consume = ~static_cast<size_t>(0))
+        {
+            typedef detail::is_contiguous_compatible<typename adapter_type::value_type, T> is_compatible;
+            return try_contiguous(consume, typename is_compatible::type());
+        }
+
+        //
+        //  See enumerator::split(). The adapter of the second half is moved into
+        //  the type-erased tail, which therefore cannot have strict_inline storage
+        //  too small for it.
+        //
+        template <typename _P1, typename _S>
+        bool split(enumerator<T, _P1, _S>& tail)
+        {
+            return split(tail, typename adapter_type::splittable());
+        }
+
+        adapter_type& adapter()
+        {
+            return m_adapter;
+        }
+
+    private:
+        boost::optional<std::pair<T*, T*>> try_contiguous(size_t consume, boost::true_type)
+        {
+            typename adapter_type::value_type* begin = nullptr;
+            typename adapter_type::value_type* end = nullptr;
+            if (m_adapter.contiguous(begin, end, consume))
+            {
+                return std::pair<T*, T*>(begin, end);
+            }
+            return boost::none;
+        }
+
+        boost::optional<std::pair<T*, T*>> try_contiguous(size_t, boost::false_type)
+        {
+            return boost::none;
+        }
+
+        template <typename _P1, typename _S>
+        bool split(enumerator<T, _P1, _S>& tail, boost::true_type)
+        {
+            tail = detail::enumerator_adapter_proxy<T, adapter_type>(m_adapter.split());
+            return true;
+        }
+
+        template <typename _P1, typename _S>
+        bool split(enumerator<T, _P1, _S>&, boost::false_type)
+        {
+            return false;
+        }
+
+        adapter_type m_adapter;
     };
 
+    namespace detail
+    {
+        //  Identifies the enumerator types accepted by the algorithms.
+        template <typename E>
+        struct is_enumerator : boost::false_type
+        {
+        };
+
+        template <typename T, typename P1, typename S>
+        struct is_enumerator<enumerator<T, P1, S>> : boost::true_type
+        {
+        };
+
+        template <typename T, typename A>
+        struct is_enumerator<static_enumerator<T, A>> : boost::true_type
+        {
+        };
+    }
+
+    //
+    //  Makes a static_enumerator out of the source object, which may be anything
+    //  an enumerator can be constructed from.
+    //
+    //  Parameters:
+    //      [template] T
+    //          Value type exposed by the enumerator.
+    //      [in] param
+    //          Parameter which will be passed to make_enumerator_adapter().
+    //
+    template <typename T, typename U>
+    inline auto make_static_enumerator(U&& param)
+        -> static_enumerator<T, typename detail::get_enumerator_adapter_type<T, U>::type>
+    {
+        return static_enumerator<T, typename detail::get_enumerator_adapter_type<T, U>::type>
+            (detail::make_enumerator_adapter<T>(std::forward<U>(param)));
+    }
+
     //
     //  Makes an explicitly-typed enumerator out of the source object.
     //
@@ -202,6 +490,20 @@ namespace polymorphic_collections
         return enumerator<T>(detail::make_enumerator_adapter_proxy<T>(std::forward<U>(param)));
     }
 
+    //
+    //  Makes an enumerator whose allocations, including any collection moved
+    //  into it, come from the given memory resource.
+    //
+    //  Example:
+    //      std::pmr::monotonic_buffer_resource arena;
+    //      auto e = make_enumerator<int>(std::move(v), &arena);
+    //
+    template <typename T, typename U>
+    inline auto make_enumerator(U&& param, memory_resource* resource) -> enumerator<T, no_lock, pmr_storage>
+    {
+        return enumerator<T, no_lock, pmr_storage>(std::forward<U>(param), resource);
+    }
+
     //
     //  Makes an enumerator out of a pointer and an element count.
     //
@@ -215,6 +517,42 @@ namespace polymorphic_collections
         return enumerator<T>(detail::enumerator_adapter_proxy<T, detail::iterator_enumerator_adapter<T*>>
             (detail::iterator_enumerator_adapter<T*>(ptr, ptr + count)));
     }
+
+    //
+    //  Makes an enumerator which can be shared by several consumer threads
+    //  without locking, out of a random-access collection.
+    //
+    //  Each item is handed out to exactly one caller; the position is advanced
+    //  with a single atomic operation per call to next(), or per block with
+    //  next_n(). The enumerator should use the no_lock policy.
+    //
+    //  Example:
+    //      std::vector<Job> jobs;
+    //      auto e = make_concurrent_enumerator<Job>(jobs);
+    //      // on each worker thread:
+    //      Job* block[16];
+    //      while (size_t n = e.next_n(block, 16)) { ... }
+    //
+    //  Parameters:
+    //      [template] T
+    //          Enumerator type.
+    //      [in] collection
+    //          Collection with random-access iterators, or an array.
+    //
+    template <typename T, typename C>
+    inline auto make_concurrent_enumerator(C& collection) -> enumerator<T>
+    {
+        typedef decltype(detail::make_concurrent_enumerator_adapter(collection)) adapter_type;
+        return enumerator<T>(detail::enumerator_adapter_proxy<T, adapter_type>
+            (detail::make_concurrent_enumerator_adapter(collection)));
+    }
+
+    template <typename T>
+    inline enumerator<T> make_concurrent_enumerator(T* ptr, size_t count)
+    {
+        return enumerator<T>(detail::enumerator_adapter_proxy<T, detail::concurrent_enumerator_adapter<T*>>
+            (detail::concurrent_enumerator_adapter<T*>(ptr, ptr + count)));
+    }
 }
 
 #endif  // POLYMORPHIC_COLLECTIONS_ENUMERATOR_HPP
@@ -0,0 +1,174 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYMORPHIC_COLLECTIONS_EXECUTOR_HPP
+#define POLYMORPHIC_COLLECTIONS_EXECUTOR_HPP
+
+#include <memory>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "detail/backoff.hpp"
+#include "detail/executor.hpp"
+
+namespace polymorphic_collections
+{
+    //
+    //  Work-stealing thread pool used by the parallel algorithms.
+    //
+    //  Every worker owns a task queue; idle workers steal from the queues of
+    //  the others, so uneven chunks of work are balanced automatically. A thread
+    //  waiting for its tasks to complete executes queued tasks itself, so tasks
+    //  may safely schedule and wait on further work.
+    //
+    //  Parameters:
+    //      [in] threads
+    //          Number of worker threads; zero uses one per hardware thread,
+    //          less the calling thread which also participates.
+    //
+    class executor : public boost::noncopyable
+    {
+    public:
+        explicit executor(size_t threads = 0)
+        : m_queued(0), m_next_queue(0), m_stopping(false)
+        {
+            if (threads == 0)
+            {
+                size_t hardware = boost::thread::hardware_concurrency();
+                threads = hardware > 1 ? hardware - 1 : 1;
+            }
+            for (size_t i = 0; i < threads; ++i)
+            {
+                m_queues.push_back(std::unique_ptr<detail::work_stealing_queue>(new detail::work_stealing_queue()));
+            }
+            for (size_t i = 0; i < threads; ++i)
+            {
+                m_threads.create_thread([this, i]()
+                {
+                    worker(i);
+                });
+            }
+        }
+
+        ~executor()
+        {
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                m_stopping = true;
+            }
+            m_condition.notify_all();
+            m_threads.join_all();
+        }
+
+        //
+        //  Returns the number of threads which execute tasks: the workers plus
+        //  the thread waiting on them.
+        //
+        size_t concurrency() const
+        {
+            return m_queues.size() + 1;
+        }
+
+        //
+        //  Calls func(i) for every i in [0, count), in parallel, and waits for all
+        //  of the calls to complete. func must be safe to call concurrently.
+        //
+        //  If any call throws, the first exception is rethrown once all of the
+        //  calls have completed.
+        //
+        template <typename F>
+        void for_each_index(size_t count, F func)
+        {
+            if (count == 0)
+            {
+                return;
+            }
+
+            detail::task_batch<F> batch(func, count);
+            //  Counted before they are pushed, so that a worker which pops one
+            //  of them right away never takes the count below zero.
+            m_queued.fetch_add(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                detail::executor_task task = { &detail::task_batch<F>::run, &batch, i };
+                m_queues[m_next_queue.fetch_add(1, boost::memory_order_relaxed) % m_queues.size()]->push(task);
+            }
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+            }
+            m_condition.notify_all();
+
+            //  The waiting thread owns no queue, so it only steals, starting
+            //  from a queue which depends on the thread so that waiting threads
+            //  do not all compete for the same one.
+            size_t start = detail::thread_index() % m_queues.size();
+            while (!batch.done())
+            {
+                if (!run_one(start, false))
+                {
+                    boost::this_thread::yield();
+                }
+            }
+            batch.rethrow_if_failed();
+        }
+
+    private:
+        //  Executes a single queued task, looking first at the queue with the given
+        //  index and then stealing from the others. Only the owner of the queue
+        //  pops from its back; other threads steal from its front as well.
+        bool run_one(size_t index, bool owner)
+        {
+            if (m_queued.load(boost::memory_order_relaxed) == 0)
+            {
+                return false;
+            }
+
+            detail::executor_task task;
+            bool found = owner ? m_queues[index]->pop(task) : m_queues[index]->steal(task);
+            for (size_t i = 1; !found && i < m_queues.size(); ++i)
+            {
+                found = m_queues[(index + i) % m_queues.size()]->steal(task);
+            }
+            if (found)
+            {
+                m_queued.fetch_sub(1);
+                task.run(task.context, task.index);
+            }
+            return found;
+        }
+
+        void worker(size_t index)
+        {
+            while (true)
+            {
+                if (run_one(index, true))
+                {
+                    continue;
+                }
+
+                boost::mutex::scoped_lock lock(m_mutex);
+                if (m_stopping)
+                {
+                    return;
+                }
+                if (m_queued.load() == 0)
+                {
+                    m_condition.wait(lock);
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<detail::work_stealing_queue>> m_queues;
+        boost::atomic<size_t> m_queued;
+        boost::atomic<size_t> m_next_queue;
+        boost::mutex m_mutex;
+        boost::condition_variable m_condition;
+        bool m_stopping;
+        boost::thread_group m_threads;
+    };
+}
+
+#endif  // POLYMORPHIC_COLLECTIONS_EXECUTOR_HPP
@@ -0,0 +1,32 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYMORPHIC_COLLECTIONS_MEMORY_RESOURCE_HPP
+#define POLYMORPHIC_COLLECTIONS_MEMORY_RESOURCE_HPP
+
+//
+//  Memory resource used for the heap allocations of the facades (see
+//  resource_storage in policy.hpp): std::pmr::memory_resource when compiling
+//  as C++17, boost::container::pmr::memory_resource otherwise or if
+//  POLYMORPHIC_COLLECTIONS_USE_BOOST_PMR is defined.
+//
+#if !defined(POLYMORPHIC_COLLECTIONS_USE_BOOST_PMR) && \
+    ((defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L)
+#include <memory_resource>
+
+namespace polymorphic_collections
+{
+    typedef std::pmr::memory_resource memory_resource;
+}
+#else
+#include <boost/container/pmr/memory_resource.hpp>
+
+namespace polymorphic_collections
+{
+    typedef boost::container::pmr::memory_resource memory_resource;
+}
+#endif
+
+#endif  // POLYMORPHIC_COLLECTIONS_MEMORY_RESOURCE_HPP
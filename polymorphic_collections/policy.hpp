@@ -6,8 +6,22 @@
 #ifndef POLYMORPHIC_COLLECTIONS_POLICY_HPP
 #define POLYMORPHIC_COLLECTIONS_POLICY_HPP
 
+#include <cstddef>
+#include <exception>
+#include <boost/atomic.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/type_traits/alignment_of.hpp>
 
+#include "detail/backoff.hpp"
+
+//
+//  Lock policies, which synchronize the calls made through a facade.
+//
+//  lock() returns false if the call should be abandoned (atomic_nonblocking).
+//  lock_shared() is taken instead for calls which only read the underlying
+//  collection (e.g. accessor::get() on a map); it is the same as lock() for
+//  the policies which do not distinguish readers from writers.
+//
 namespace polymorphic_collections
 {
     class no_lock
@@ -21,6 +35,15 @@ namespace polymorphic_collections
         void unlock()
         {
         }
+
+        bool lock_shared()
+        {
+            return true;
+        }
+
+        void unlock_shared()
+        {
+        }
     };
 
     class atomic
@@ -39,6 +62,16 @@ namespace polymorphic_collections
             m_mutex.unlock();
         }
 
+        bool lock_shared()
+        {
+            return lock();
+        }
+
+        void unlock_shared()
+        {
+            unlock();
+        }
+
     private:
         mutex_type m_mutex;
     };
@@ -58,9 +91,428 @@ namespace polymorphic_collections
             m_mutex.unlock();
         }
 
+        bool lock_shared()
+        {
+            return lock();
+        }
+
+        void unlock_shared()
+        {
+            unlock();
+        }
+
     private:
         mutex_type m_mutex;
     };
+
+    //
+    //  Test-and-test-and-set spinlock with exponential backoff, for critical
+    //  sections too short to be worth putting a thread to sleep (a find() or a
+    //  push_back()). Waiting threads yield once the backoff reaches its limit.
+    //  The lock itself is a single byte.
+    //
+    class spin_lock
+    {
+    protected:
+        spin_lock()
+        : m_locked(false)
+        {
+        }
+
+        bool lock()
+        {
+            detail::backoff backoff;
+            while (m_locked.exchange(true, boost::memory_order_acquire))
+            {
+                //  Wait for the lock to look free before writing to it again,
+                //  so that the cache line is not bounced between the waiters.
+                do
+                {
+                    backoff.pause();
+                }
+                while (m_locked.load(boost::memory_order_relaxed));
+            }
+            return true;
+        }
+
+        void unlock()
+        {
+            m_locked.store(false, boost::memory_order_release);
+        }
+
+        bool lock_shared()
+        {
+            return lock();
+        }
+
+        void unlock_shared()
+        {
+            unlock();
+        }
+
+    private:
+        boost::atomic<bool> m_locked;
+    };
+
+    //
+    //  Ticket lock: threads are served in the order in which they asked for
+    //  the lock, so none can starve under contention. Waiting threads back off
+    //  in proportion to their distance from the head of the queue.
+    //
+    class ticket_lock
+    {
+    protected:
+        ticket_lock()
+        : m_next(0), m_serving(0)
+        {
+        }
+
+        bool lock()
+        {
+            unsigned ticket = m_next.fetch_add(1, boost::memory_order_relaxed);
+            while (true)
+            {
+                unsigned serving = m_serving.load(boost::memory_order_acquire);
+                if (serving == ticket)
+                {
+                    return true;
+                }
+                unsigned distance = ticket - serving;
+                if (distance > detail::backoff::max_spins / spins_per_waiter)
+                {
+                    boost::this_thread::yield();
+                }
+                else
+                {
+                    detail::backoff::spin(distance * spins_per_waiter);
+                }
+            }
+        }
+
+        void unlock()
+        {
+            m_serving.store(m_serving.load(boost::memory_order_relaxed) + 1, boost::memory_order_release);
+        }
+
+        bool lock_shared()
+        {
+            return lock();
+        }
+
+        void unlock_shared()
+        {
+            unlock();
+        }
+
+    private:
+        static const unsigned spins_per_waiter = 32;
+
+        boost::atomic<unsigned> m_next;
+        boost::atomic<unsigned> m_serving;
+    };
+
+    //
+    //  Reader-writer spinlock: any number of shared holders, or one exclusive
+    //  holder. A waiting writer blocks new readers, so that writers cannot be
+    //  starved by a continuous stream of readers.
+    //
+    class reader_writer_lock
+    {
+    protected:
+        reader_writer_lock()
+        : m_state(0)
+        {
+        }
+
+        bool lock()
+        {
+            detail::backoff backoff;
+            while (true)
+            {
+                unsigned state = m_state.load(boost::memory_order_relaxed);
+                if ((state & ~writer_waiting) == 0 &&
+                    m_state.compare_exchange_weak(state, writer, boost::memory_order_acquire))
+                {
+                    return true;
+                }
+                if (!(state & writer_waiting))
+                {
+                    m_state.fetch_or(writer_waiting, boost::memory_order_relaxed);
+                }
+                backoff.pause();
+            }
+        }
+
+        void unlock()
+        {
+            //  Other writers may have flagged themselves in the meantime.
+            m_state.fetch_and(~writer, boost::memory_order_release);
+        }
+
+        bool lock_shared()
+        {
+            detail::backoff backoff;
+            while (true)
+            {
+                unsigned state = m_state.load(boost::memory_order_relaxed);
+                if (!(state & (writer | writer_waiting)) &&
+                    m_state.compare_exchange_weak(state, state + 1, boost::memory_order_acquire))
+                {
+                    return true;
+                }
+                backoff.pause();
+            }
+        }
+
+        void unlock_shared()
+        {
+            m_state.fetch_sub(1, boost::memory_order_release);
+        }
+
+    private:
+        //  The low bits of the state count the readers.
+        static const unsigned writer = 1u << 31;
+        static const unsigned writer_waiting = 1u << 30;
+
+        boost::atomic<unsigned> m_state;
+    };
+
+    static const size_t cache_line_size = 64;
+
+    //
+    //  Flat-combining lock, for facades on which many threads contend (e.g. a
+    //  shared sink accumulator). A thread which finds the lock taken does not
+    //  wait for it: it publishes its operation in a slot, and whichever thread
+    //  holds the lock executes all of the published operations before
+    //  releasing it. The collection thus stays in the cache of one core and the
+    //  lock changes hands far less often.
+    //
+    //  Only accumulator::add() and aggregator::add() are combined; other calls
+    //  take the lock normally (and execute pending operations on unlock).
+    //  Operations of a given thread are executed in the order of the calls,
+    //  and exceptions are rethrown on the calling thread.
+    //
+    //  Parameters:
+    //      [template] Slots
+    //          Number of publication slots, each on its own cache line. With
+    //          more threads than slots, a thread whose slot is in use waits for
+    //          the lock instead.
+    //
+    template <size_t Slots = 32>
+    class flat_combining
+    {
+    public:
+        typedef boost::true_type combining;
+
+    protected:
+        flat_combining()
+        : m_locked(false)
+        {
+            for (size_t i = 0; i < Slots; ++i)
+            {
+                m_slots[i].pending.store(nullptr, boost::memory_order_relaxed);
+            }
+        }
+
+        bool lock()
+        {
+            detail::backoff backoff;
+            while (!try_lock())
+            {
+                backoff.pause();
+            }
+            return true;
+        }
+
+        void unlock()
+        {
+            execute_pending();
+            m_locked.store(false, boost::memory_order_release);
+        }
+
+        bool lock_shared()
+        {
+            return lock();
+        }
+
+        void unlock_shared()
+        {
+            unlock();
+        }
+
+        //
+        //  Executes run(context) under the lock, either on this thread or on
+        //  the thread holding the lock.
+        //
+        void combine(void (*run)(void*), void* context)
+        {
+            if (try_lock())
+            {
+                execute_locked(run, context);
+                return;
+            }
+
+            request req;
+            req.run = run;
+            req.context = context;
+            req.done.store(false, boost::memory_order_relaxed);
+            slot& s = m_slots[detail::thread_index() % Slots];
+            request* expected = nullptr;
+            if (!s.pending.compare_exchange_strong(expected, &req, boost::memory_order_release, boost::memory_order_relaxed))
+            {
+                lock();
+                execute_locked(run, context);
+                return;
+            }
+
+            detail::backoff backoff;
+            while (!req.done.load(boost::memory_order_acquire))
+            {
+                //  Whoever gets the lock executes every published operation,
+                //  including ours, when releasing it.
+                if (try_lock())
+                {
+                    unlock();
+                }
+                else
+                {
+                    backoff.pause();
+                }
+            }
+            if (req.error)
+            {
+                std::rethrow_exception(req.error);
+            }
+        }
+
+    private:
+        struct request
+        {
+            void (*run)(void*);
+            void* context;
+            boost::atomic<bool> done;
+            std::exception_ptr error;
+        };
+
+        struct alignas(cache_line_size) slot
+        {
+            boost::atomic<request*> pending;
+        };
+
+        bool try_lock()
+        {
+            return !m_locked.load(boost::memory_order_relaxed) &&
+                   !m_locked.exchange(true, boost::memory_order_acquire);
+        }
+
+        void execute_locked(void (*run)(void*), void* context)
+        {
+            try
+            {
+                run(context);
+            }
+            catch (...)
+            {
+                unlock();
+                throw;
+            }
+            unlock();
+        }
+
+        void execute_pending()
+        {
+            for (size_t i = 0; i < Slots; ++i)
+            {
+                request* req = m_slots[i].pending.load(boost::memory_order_acquire);
+                if (req)
+                {
+                    try
+                    {
+                        req->run(req->context);
+                    }
+                    catch (...)
+                    {
+                        req->error = std::current_exception();
+                    }
+                    //  The request lives on the stack of its thread, which may
+                    //  return as soon as it is marked as done.
+                    m_slots[i].pending.store(nullptr, boost::memory_order_relaxed);
+                    req->done.store(true, boost::memory_order_release);
+                }
+            }
+        }
+
+        boost::atomic<bool> m_locked;
+        slot m_slots[Slots];
+    };
+
+    //
+    //  Storage policies, describing the buffer in which a facade stores its
+    //  type-erased adapter. Adapters which do not fit in the buffer are
+    //  allocated on the heap.
+    //
+    //  Parameters:
+    //      [template] Size
+    //          Size of the buffer, in bytes; must not be 0.
+    //      [template] Alignment
+    //          Alignment of the buffer, and therefore of the facade.
+    //
+    template <size_t Size, size_t Alignment = boost::alignment_of<void*>::value>
+    struct inline_storage
+    {
+        static const size_t size = Size;
+        static const size_t alignment = Alignment;
+        static const bool strict = false;
+        static const bool uses_resource = false;
+    };
+
+    //
+    //  Storage policy which never allocates: constructing a facade out of an
+    //  adapter which does not fit in the buffer fails at compile time.
+    //
+    template <size_t Size, size_t Alignment = boost::alignment_of<void*>::value>
+    struct strict_inline
+    {
+        static const size_t size = Size;
+        static const size_t alignment = Alignment;
+        static const bool strict = true;
+        static const bool uses_resource = false;
+    };
+
+    //
+    //  Storage policy which allocates adapters which do not fit in the buffer,
+    //  and collections embedded by the adapters, from a memory resource given
+    //  to the facade at construction (see memory_resource.hpp). Without a
+    //  resource the global heap is used.
+    //
+    //  As with the std::pmr containers, a facade constructed by moving
+    //  another one uses the same resource, while move assignment keeps the
+    //  resource of the target and moves the adapter to it if they differ.
+    //  Unlike them, a collection embedded by the adapter stays where it is:
+    //  it is owned by the adapter and freed to the resource it came from,
+    //  which must therefore outlive every facade the adapter is moved to.
+    //  Moving the collection itself would invalidate the iterators of the
+    //  adapter.
+    //
+    template <size_t Size, size_t Alignment = boost::alignment_of<void*>::value>
+    struct resource_storage
+    {
+        static const size_t size = Size;
+        static const size_t alignment = Alignment;
+        static const bool strict = false;
+        static const bool uses_resource = true;
+    };
+
+    //  A facade with the default storage and the no_lock policy is 32 bytes
+    //  (on top of the buffer, it holds a function table and an adapter pointer).
+    typedef inline_storage<32 - 2 * sizeof(ptrdiff_t)> default_storage;
+
+    //  The resource pointer makes a no_lock facade with this storage 40 bytes.
+    typedef resource_storage<32 - 2 * sizeof(ptrdiff_t)> pmr_storage;
+
+    //  A facade with this storage and the no_lock policy occupies exactly one
+    //  cache line, so that facades used by different threads never share one.
+    typedef inline_storage<cache_line_size - 2 * sizeof(ptrdiff_t), cache_line_size> cache_line_storage;
 }
 
 #endif  // POLYMORPHIC_COLLECTIONS_POLICY_HPP
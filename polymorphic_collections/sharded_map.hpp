@@ -0,0 +1,434 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYMORPHIC_COLLECTIONS_SHARDED_MAP_HPP
+#define POLYMORPHIC_COLLECTIONS_SHARDED_MAP_HPP
+
+#include <iterator>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/utility.hpp>
+
+#include "policy.hpp"
+
+namespace polymorphic_collections
+{
+    //
+    //  Hash map split into N shards, each an unordered_map with its own lock,
+    //  so that threads working on unrelated keys do not contend. A key always
+    //  goes to the shard selected by its hash.
+    //
+    //  The map implements the members used by the standard adapters (insert,
+    //  try_emplace, merge, find, begin/end), so that aggregators, accessors and
+    //  enumerators can be made from it directly. Their facades should use the
+    //  no_lock policy, as the shards synchronize themselves:
+    //      sharded_map<std::string, int> map;
+    //      aggregator<std::string, int> sink = map;      // from any thread
+    //      accessor<std::string, int> lookup = map;      // from any thread
+    //
+    //  Insertions and lookups are thread-safe. Elements are never moved, so
+    //  references to them (and dereferencing the iterators returned by find()
+    //  and insert()) remain valid as the map grows; the values themselves are
+    //  not protected once a reference to them has been returned. Iteration
+    //  (and thus enumeration) visits the shards one after the other, and must
+    //  not overlap with insertions.
+    //
+    //  Parameters:
+    //      [template] K
+    //          Key type.
+    //      [template] T
+    //          Value type.
+    //      [template] N
+    //          Number of shards.
+    //      [template] H
+    //          Hash function type.
+    //      [template] P
+    //          Lock policy of each shard (see policy.hpp); lookups take the
+    //          shared side of the lock.
+    //
+    template <typename K, typename T, size_t N = 16, typename H = boost::hash<K>, typename P = reader_writer_lock>
+    class sharded_map : public boost::noncopyable
+    {
+        struct shard;
+
+    public:
+        typedef K key_type;
+        typedef T mapped_type;
+        typedef std::pair<const K, T> value_type;
+        typedef H hasher;
+        typedef P lock_policy;
+        typedef std::unordered_map<K, T, H> shard_type;
+        typedef sharded_map<K, T, N, H, P> this_type;
+
+        static const size_t shard_count = N;
+
+        //
+        //  Forward iterator over the elements of all of the shards, in shard
+        //  order. Dereferencing goes through a pointer to the element, which
+        //  unlike the iterator of the shard is not invalidated by insertions,
+        //  so the result of find() remains usable.
+        //
+        template <typename I, typename V, typename S>
+        class basic_iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef V value_type;
+            typedef ptrdiff_t difference_type;
+            typedef V* pointer;
+            typedef V& reference;
+
+            basic_iterator()
+            : m_shards(nullptr), m_index(N), m_value(nullptr)
+            {
+            }
+
+            //  Must be called with the shard locked, unless index is N.
+            basic_iterator(S* shards, size_t index, const I& it)
+            : m_shards(shards), m_index(index), m_it(it), m_value(nullptr)
+            {
+                if (m_index < N && m_it != m_shards[m_index].map.end())
+                {
+                    m_value = boost::addressof(*m_it);
+                }
+            }
+
+            //  Iterators convert to const_iterators.
+            template <typename I_, typename V_, typename S_>
+            basic_iterator(const basic_iterator<I_, V_, S_>& rhs)
+            : m_shards(rhs.m_shards), m_index(rhs.m_index), m_it(rhs.m_it), m_value(rhs.m_value)
+            {
+            }
+
+            reference operator*() const
+            {
+                return *m_value;
+            }
+
+            pointer operator->() const
+            {
+                return m_value;
+            }
+
+            basic_iterator& operator++()
+            {
+                ++m_it;
+                skip_empty();
+                return *this;
+            }
+
+            basic_iterator operator++(int)
+            {
+                basic_iterator previous = *this;
+                ++*this;
+                return previous;
+            }
+
+            bool operator==(const basic_iterator& rhs) const
+            {
+                return m_value == rhs.m_value;
+            }
+
+            bool operator!=(const basic_iterator& rhs) const
+            {
+                return !(*this == rhs);
+            }
+
+        private:
+            template <typename I_, typename V_, typename S_>
+            friend class basic_iterator;
+            friend class sharded_map;
+
+            //  Moves to the first element of the next non-empty shard if the
+            //  iterator is at the end of its shard.
+            void skip_empty()
+            {
+                while (m_index < N && m_it == m_shards[m_index].map.end())
+                {
+                    if (++m_index < N)
+                    {
+                        m_it = m_shards[m_index].map.begin();
+                    }
+                }
+                m_value = m_index < N ? boost::addressof(*m_it) : nullptr;
+            }
+
+            S* m_shards;
+            size_t m_index;
+            I m_it;
+            V* m_value;
+        };
+
+        typedef basic_iterator<typename shard_type::iterator, value_type, shard> iterator;
+        typedef basic_iterator<typename shard_type::const_iterator, const value_type, const shard> const_iterator;
+
+        explicit sharded_map(const hasher& hash = hasher())
+        : m_hash(hash)
+        {
+            for (size_t i = 0; i < N; ++i)
+            {
+                m_shards[i].map = shard_type(0, hash);
+            }
+        }
+
+        //
+        //  Inserts the value for a key if the key is not present yet.
+        //
+        //  Returns:
+        //      An iterator to the element of the key, and whether it was
+        //      inserted.
+        //
+        std::pair<iterator, bool> insert(const value_type& value)
+        {
+            return try_emplace(value.first, value.second);
+        }
+
+        std::pair<iterator, bool> insert(value_type&& value)
+        {
+            size_t index = shard_of(value.first);
+            exclusive_lock lock(m_shards[index]);
+            auto result = m_shards[index].map.insert(std::move(value));
+            return std::make_pair(iterator(m_shards, index, result.first), result.second);
+        }
+
+        //  Constructs the value for a key from args if the key is not present
+        //  yet; otherwise args are left untouched.
+        template <typename... Args>
+        std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+        {
+            size_t index = shard_of(key);
+            exclusive_lock lock(m_shards[index]);
+            auto result = try_emplace_in(m_shards[index].map, key, std::forward<Args>(args)...);
+            return std::make_pair(iterator(m_shards, index, result.first), result.second);
+        }
+
+        template <typename... Args>
+        std::pair<iterator, bool> try_emplace(key_type&& key, Args&&... args)
+        {
+            size_t index = shard_of(key);
+            exclusive_lock lock(m_shards[index]);
+            auto result = try_emplace_in(m_shards[index].map, std::move(key), std::forward<Args>(args)...);
+            return std::make_pair(iterator(m_shards, index, result.first), result.second);
+        }
+
+        //
+        //  Inserts the value for a key, or if the key is present, replaces its
+        //  value by merge(existing, value), all under the lock of the shard.
+        //  This is how concurrent writers combine values (e.g. counters): the
+        //  value returned by try_emplace() is no longer protected.
+        //
+        //  Parameters:
+        //      [in] key
+        //          Key of the element.
+        //      [in] value
+        //          Value inserted, or passed to merge.
+        //      [in] merge
+        //          Function called as merge(existing, value); it must not
+        //          access the map.
+        //
+        //  Returns:
+        //      An iterator to the element of the key, and whether it was
+        //      inserted.
+        //
+        template <typename V, typename F>
+        std::pair<iterator, bool> merge(const key_type& key, V&& value, F&& merge)
+        {
+            size_t index = shard_of(key);
+            exclusive_lock lock(m_shards[index]);
+            //  try_emplace_in() leaves the value untouched if the key is present.
+            auto result = try_emplace_in(m_shards[index].map, key, std::forward<V>(value));
+            if (!result.second)
+            {
+                result.first->second = merge(result.first->second, std::forward<V>(value));
+            }
+            return std::make_pair(iterator(m_shards, index, result.first), result.second);
+        }
+
+        template <typename V, typename F>
+        std::pair<iterator, bool> merge(key_type&& key, V&& value, F&& merge)
+        {
+            size_t index = shard_of(key);
+            exclusive_lock lock(m_shards[index]);
+            //  try_emplace_in() leaves the value untouched if the key is present.
+            auto result = try_emplace_in(m_shards[index].map, std::move(key), std::forward<V>(value));
+            if (!result.second)
+            {
+                result.first->second = merge(result.first->second, std::forward<V>(value));
+            }
+            return std::make_pair(iterator(m_shards, index, result.first), result.second);
+        }
+
+        //  The hint is ignored; for compatibility with the standard maps.
+        template <typename... Args>
+        iterator try_emplace(const_iterator, const key_type& key, Args&&... args)
+        {
+            return try_emplace(key, std::forward<Args>(args)...).first;
+        }
+
+        iterator find(const key_type& key)
+        {
+            size_t index = shard_of(key);
+            shared_lock lock(m_shards[index]);
+            auto it = m_shards[index].map.find(key);
+            return it == m_shards[index].map.end() ? end() : iterator(m_shards, index, it);
+        }
+
+        const_iterator find(const key_type& key) const
+        {
+            size_t index = shard_of(key);
+            shared_lock lock(m_shards[index]);
+            auto it = m_shards[index].map.find(key);
+            return it == m_shards[index].map.end() ? end() : const_iterator(m_shards, index, it);
+        }
+
+        size_t count(const key_type& key) const
+        {
+            return find(key) == end() ? 0 : 1;
+        }
+
+        //  Number of elements; only a snapshot if insertions are in progress.
+        size_t size() const
+        {
+            size_t size = 0;
+            for (size_t i = 0; i < N; ++i)
+            {
+                shared_lock lock(m_shards[i]);
+                size += m_shards[i].map.size();
+            }
+            return size;
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        //  Makes room for count elements, assuming that they are evenly spread
+        //  over the shards.
+        void reserve(size_t count)
+        {
+            for (size_t i = 0; i < N; ++i)
+            {
+                exclusive_lock lock(m_shards[i]);
+                m_shards[i].map.reserve(count / N + 1);
+            }
+        }
+
+        iterator begin()
+        {
+            iterator it(m_shards, 0, m_shards[0].map.begin());
+            it.skip_empty();
+            return it;
+        }
+
+        iterator end()
+        {
+            return iterator(m_shards, N, typename shard_type::iterator());
+        }
+
+        const_iterator begin() const
+        {
+            const_iterator it(m_shards, 0, m_shards[0].map.cbegin());
+            it.skip_empty();
+            return it;
+        }
+
+        const_iterator end() const
+        {
+            return const_iterator(m_shards, N, typename shard_type::const_iterator());
+        }
+
+        const_iterator cbegin() const
+        {
+            return begin();
+        }
+
+        const_iterator cend() const
+        {
+            return end();
+        }
+
+        //  Index of the shard holding a key.
+        size_t shard_of(const key_type& key) const
+        {
+            //  The shard maps hash the key again to find its bucket, so the bits
+            //  selecting the shard are scrambled first.
+            boost::uint64_t hash = static_cast<boost::uint64_t>(m_hash(key)) * 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(hash >> 32) % N;
+        }
+
+    private:
+        struct alignas(cache_line_size) shard : public lock_policy
+        {
+            using lock_policy::lock;
+            using lock_policy::unlock;
+            using lock_policy::lock_shared;
+            using lock_policy::unlock_shared;
+
+            shard_type map;
+        };
+
+        //  Lock policies without blocking semantics (atomic_nonblocking) are
+        //  not supported: the shard lock must always be acquired.
+        class exclusive_lock : public boost::noncopyable
+        {
+        public:
+            explicit exclusive_lock(shard& s)
+            : m_shard(s)
+            {
+                m_shard.lock();
+            }
+
+            ~exclusive_lock()
+            {
+                m_shard.unlock();
+            }
+
+        private:
+            shard& m_shard;
+        };
+
+        class shared_lock : public boost::noncopyable
+        {
+        public:
+            explicit shared_lock(const shard& s)
+            : m_shard(const_cast<shard&>(s))
+            {
+                m_shard.lock_shared();
+            }
+
+            ~shared_lock()
+            {
+                m_shard.unlock_shared();
+            }
+
+        private:
+            shard& m_shard;
+        };
+
+        //  std::unordered_map::try_emplace() is C++17; this does the same with
+        //  a lookup before the emplace, so args are only consumed on insertion.
+        template <typename Key, typename... Args>
+        static std::pair<typename shard_type::iterator, bool> try_emplace_in(shard_type& map, Key&& key, Args&&... args)
+        {
+            auto it = map.find(key);
+            if (it != map.end())
+            {
+                return std::make_pair(it, false);
+            }
+            return map.emplace(std::piecewise_construct,
+                               std::forward_as_tuple(std::forward<Key>(key)),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+        }
+
+        hasher m_hash;
+        shard m_shards[N];
+    };
+}
+
+#endif  // POLYMORPHIC_COLLECTIONS_SHARDED_MAP_HPP
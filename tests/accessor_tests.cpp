@@ -6,7 +6,10 @@
 #include <boost/utility.hpp>
 #include <array>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <vector>
+#include <boost/thread.hpp>
 #include <gtest/gtest.h>
 #include "polymorphic_collections/accessor.hpp"
 #include "test_utils.hpp"
@@ -81,3 +84,276 @@ TEST(AccessorTests, AccessorCanEncapsulateLambda)
     ASSERT_EQ(*a[1], 2);
     ASSERT_EQ(*a[2], 3);
 }
+
+TEST(AccessorTests, StaticAccessorConvertsToAccessor)
+{
+    std::map<int, int> m;
+    m[1] = 10;
+    auto a = make_static_accessor<int, int>(m);
+    ASSERT_EQ(*a[1], 10);
+    ASSERT_FALSE(a[2]);
+
+    int keys[] = { 2, 1 };
+    int* values[2];
+    ASSERT_EQ(a.get_many(keys, 2, values), 2u);
+    ASSERT_EQ(values[0], nullptr);
+    ASSERT_EQ(values[1], &m.find(1)->second);
+
+    accessor<int, const int> b = std::move(a);
+    ASSERT_EQ(&*b[1], &m[1]);
+}
+
+namespace
+{
+    //  Map whose lookups wait, for a while, until two of them run at once.
+    struct OverlappingMap : std::map<int, int>
+    {
+        boost::atomic<int> inside;
+        boost::atomic<bool> overlapped;
+
+        OverlappingMap()
+        : inside(0), overlapped(false)
+        {
+        }
+
+        iterator find(const int& key)
+        {
+            ++inside;
+            for (int i = 0; i < 1000000 && inside.load() < 2; ++i)
+            {
+                boost::this_thread::yield();
+            }
+            if (inside.load() >= 2)
+            {
+                overlapped = true;
+            }
+            --inside;
+            return std::map<int, int>::find(key);
+        }
+    };
+}
+
+TEST(AccessorTests, ReaderWriterLockAllowsConcurrentLookups)
+{
+    OverlappingMap m;
+    m[1] = 10;
+    accessor<int, int, reader_writer_lock> a = m;
+    boost::thread_group threads;
+    for (int i = 0; i < 2; ++i)
+    {
+        threads.create_thread([&]()
+        {
+            ASSERT_EQ(*a[1], 10);
+        });
+    }
+    threads.join_all();
+    ASSERT_TRUE(m.overlapped.load());
+
+    //  Functional adapters store the value they return, so their calls are
+    //  still serialized.
+    int calls = 0;
+    accessor<int, int, reader_writer_lock> b = [&] (int x) -> boost::optional<int>
+    {
+        ++calls;
+        return x;
+    };
+    ASSERT_EQ(*b[2], 2);
+    ASSERT_EQ(calls, 1);
+}
+
+TEST(AccessorTests, GetManyLooksUpBatchesOfKeys)
+{
+    std::unordered_map<int, int> u;
+    std::map<int, int> m;
+    for (int i = 0; i < 100; ++i)
+    {
+        u[i * 2] = i;
+        m[i * 2] = i;
+    }
+    std::vector<int> keys;
+    for (int i = 0; i < 50; ++i)
+    {
+        keys.push_back(i);
+    }
+    std::vector<int*> out(keys.size());
+
+    accessor<int, int, reader_writer_lock> a = u;
+    ASSERT_EQ(a.get_many(keys.data(), keys.size(), out.data()), keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        ASSERT_EQ(out[i], i % 2 ? nullptr : &u[keys[i]]);
+    }
+
+    accessor<int, int> b = m;
+    ASSERT_EQ(b.get_many(keys.data(), keys.size(), out.data()), keys.size());
+    ASSERT_EQ(out[4], &m[4]);
+    ASSERT_EQ(out[5], nullptr);
+
+    //  Functional accessors look up one key per call.
+    accessor<int, int> c = [](int key) { return key % 2 ? boost::optional<int>() : boost::optional<int>(key / 2); };
+    ASSERT_EQ(c.get_many(keys.data() + 4, 2, out.data()), 1u);
+    ASSERT_EQ(*out[0], 2);
+}
+
+TEST(AccessorTests, GetManyClearsTheBufferWhenTheLockIsBusy)
+{
+    int value = 1;
+    int* out[2] = {&value, &value};
+    size_t result = 1;
+
+    //  The lookup below holds the lock while the adapter runs, so the
+    //  nested batch cannot acquire it.
+    accessor<int, int, atomic_nonblocking> a;
+    a = [&](int key) -> boost::optional<int>
+    {
+        int keys[] = {0, 1};
+        result = a.get_many(keys, 2, out);
+        return key;
+    };
+    ASSERT_EQ(*a[3], 3);
+    ASSERT_EQ(result, 0u);
+    ASSERT_EQ(out[0], nullptr);
+    ASSERT_EQ(out[1], nullptr);
+}
+
+TEST(AccessorTests, AccessorCanAllocateFromMemoryResource)
+{
+    CountingResource resource;
+    {
+        std::map<int, int> m;
+        m[1] = 10;
+        auto a = make_accessor<int, int>(std::move(m), &resource);
+        ASSERT_EQ(a.resource(), &resource);
+        //  The map moved into the accessor, and the adapter holding it, come
+        //  from the resource.
+        ASSERT_EQ(resource.allocated, 2u);
+        ASSERT_EQ(*a[1], 10);
+        ASSERT_FALSE(a[2]);
+    }
+    ASSERT_EQ(resource.outstanding(), 0u);
+}
+
+TEST(AccessorTests, CachingAccessorEvictsLeastRecentlyUsedValues)
+{
+    int loads = 0;
+    auto load = [&](int key) -> boost::optional<std::string>
+    {
+        ++loads;
+        return key < 0 ? boost::optional<std::string>() : boost::optional<std::string>(std::to_string(key));
+    };
+    cache_statistics stats;
+    accessor<int, std::string> a = make_caching_accessor<int, std::string>(load, 2, &stats);
+
+    std::string& one = *a[1];
+    ASSERT_EQ(one, "1");
+    ASSERT_EQ(*a[2], "2");
+    ASSERT_EQ(*a[1], "1");
+    ASSERT_EQ(loads, 2);
+
+    //  2 is the least recently used value; 1 is still in the cache.
+    ASSERT_EQ(*a[3], "3");
+    ASSERT_EQ(one, "1");
+    ASSERT_EQ(*a[1], "1");
+    ASSERT_EQ(*a[2], "2");
+    ASSERT_EQ(loads, 4);
+
+    //  Missing keys are not cached.
+    ASSERT_FALSE(a[-1]);
+    ASSERT_FALSE(a[-1]);
+    ASSERT_EQ(loads, 6);
+
+    ASSERT_EQ(stats.hits, 2u);
+    ASSERT_EQ(stats.misses, 6u);
+    ASSERT_EQ(stats.evictions, 2u);
+}
+
+TEST(AccessorTests, CachingAccessorKeepsReturnedValuesAlive)
+{
+    cache_statistics stats;
+    auto a = make_caching_accessor<int, int, atomic>([](int key) { return boost::optional<int>(key * 2); }, 1, &stats);
+    int& value = *a[1];
+    ASSERT_EQ(value, 2);
+
+    //  The lookup of the other thread evicts the value held above, which
+    //  stays alive until the next lookup of this thread.
+    int other_value = 0;
+    boost::thread other([&]()
+    {
+        other_value = *a[2];
+    });
+    other.join();
+    ASSERT_EQ(other_value, 4);
+    ASSERT_EQ(stats.evictions, 1u);
+    ASSERT_EQ(value, 2);
+    ASSERT_EQ(*a[1], 2);
+}
+
+TEST(AccessorTests, CachingAccessorReleasesValuesPinnedByExitedThreads)
+{
+    std::vector<std::weak_ptr<int>> loaded;
+    auto load = [&](int key) -> boost::optional<std::shared_ptr<int>>
+    {
+        std::shared_ptr<int> value = std::make_shared<int>(key);
+        loaded.push_back(value);
+        return value;
+    };
+    auto a = make_caching_accessor<int, std::shared_ptr<int>, atomic>(load, 4);
+
+    //  Each thread pins the value it looked up, which the next threads evict.
+    for (int i = 0; i < 100; ++i)
+    {
+        boost::thread t([&, i]() { ASSERT_EQ(**a[i], i); });
+        t.join();
+    }
+    size_t alive = 0;
+    for (size_t i = 0; i < loaded.size(); ++i)
+    {
+        alive += loaded[i].expired() ? 0 : 1;
+    }
+    ASSERT_EQ(loaded.size(), 100u);
+    ASSERT_LE(alive, 4u);
+}
+
+TEST(AccessorTests, MemoizingAccessorComputesEachKeyOnce)
+{
+    boost::atomic<int> calls(0);
+    boost::atomic<bool> go(false);
+    auto compute = [&](int key) -> boost::optional<int>
+    {
+        ++calls;
+        //  Holds the first computation until every thread has asked for it.
+        while (!go)
+        {
+            boost::this_thread::yield();
+        }
+        return key < 0 ? boost::optional<int>() : boost::optional<int>(key * 10);
+    };
+    accessor<int, int> a = make_memoizing_accessor<int, int>(compute, 16);
+
+    boost::atomic<int> started(0);
+    std::vector<int*> results(8);
+    boost::thread_group threads;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        threads.create_thread([&, i]() { ++started; results[i] = &*a[7]; });
+    }
+    while (started < 8)
+    {
+        boost::this_thread::yield();
+    }
+    go = true;
+    threads.join_all();
+
+    ASSERT_EQ(calls, 1);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        ASSERT_EQ(results[i], results[0]);
+    }
+    ASSERT_EQ(*results[0], 70);
+
+    //  Missing keys are remembered too.
+    ASSERT_FALSE(a[-1]);
+    ASSERT_FALSE(a[-1]);
+    ASSERT_EQ(*a[8], 80);
+    ASSERT_EQ(calls, 3);
+}
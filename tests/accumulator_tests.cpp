@@ -5,7 +5,13 @@
 
 #include <boost/utility.hpp>
 #include <array>
+#include <deque>
+#include <list>
+#include <memory>
+#include <stdexcept>
 #include <vector>
+#include <boost/any.hpp>
+#include <boost/thread.hpp>
 #include <gtest/gtest.h>
 #include "polymorphic_collections/accumulator.hpp"
 #include "test_utils.hpp"
@@ -164,3 +170,311 @@ TEST(AccumulatorTests, AccumulatorCanSpecifyAtomicPolicy)
     std::vector<int> v;
     accumulator<int, atomic> a = v;
 }
+
+TEST(AccumulatorTests, MovedAccumulatorsReleaseTheirAdapterOnce)
+{
+    auto total = std::make_shared<int>(0);
+    {
+        accumulator<int> a = [total] (int x) { *total += x; };
+        a.add(1);
+        accumulator<int, atomic> b = std::move(a);
+        b.add(2);
+        a = std::move(b);
+        a.add(3);
+        ASSERT_EQ(total.use_count(), 2);
+    }
+    ASSERT_EQ(*total, 6);
+    ASSERT_EQ(total.use_count(), 1);
+}
+
+TEST(AccumulatorTests, StaticAccumulatorConvertsToAccumulator)
+{
+    std::vector<int> v;
+    auto a = make_static_accumulator<int>(v);
+    int one = 1;
+    a.add(0).add(one);
+    a += 2;
+
+    accumulator<int> b = std::move(a);
+    b.add(3);
+    ASSERT_EQ(v.size(), 4u);
+    ASSERT_EQ(v[3], 3);
+}
+
+TEST(AccumulatorTests, StaticAccumulatorAddsRanges)
+{
+    std::vector<int> source;
+    for (int i = 0; i < 10; ++i)
+    {
+        source.push_back(i);
+    }
+    std::list<int> list(source.begin(), source.end());
+
+    std::vector<int> v;
+    auto a = make_static_accumulator<int>(v);
+    a.add_range(source.begin(), source.end()).add_range(list.begin(), list.end());
+    auto contiguous = make_static_enumerator<int>(source);
+    auto linked = make_static_enumerator<int>(list);
+    a.add_range(contiguous).add_range(linked);
+    a.flush();
+    ASSERT_EQ(v.size(), 40u);
+    for (size_t i = 0; i < v.size(); ++i)
+    {
+        ASSERT_EQ(v[i], static_cast<int>(i % 10));
+    }
+}
+
+namespace
+{
+    template <typename P>
+    void CheckConcurrentAdds()
+    {
+        std::vector<int> v;
+        accumulator<int, P> a = v;
+        boost::thread_group threads;
+        for (int i = 0; i < 4; ++i)
+        {
+            threads.create_thread([&, i]()
+            {
+                for (int j = 0; j < 1000; ++j)
+                {
+                    a.add(i);
+                }
+            });
+        }
+        threads.join_all();
+        ASSERT_EQ(v.size(), 4000u);
+        for (int i = 0; i < 4; ++i)
+        {
+            ASSERT_EQ(std::count(v.begin(), v.end(), i), 1000);
+        }
+    }
+}
+
+TEST(AccumulatorTests, SpinningLockPoliciesSerializeCalls)
+{
+    CheckConcurrentAdds<spin_lock>();
+    CheckConcurrentAdds<ticket_lock>();
+    CheckConcurrentAdds<reader_writer_lock>();
+    ASSERT_LT(sizeof(accumulator<int, spin_lock>), sizeof(accumulator<int, atomic>));
+    ASSERT_LT(sizeof(accumulator<int, ticket_lock>), sizeof(accumulator<int, atomic>));
+}
+
+TEST(AccumulatorTests, FlatCombiningPreservesTheOrderOfEachThread)
+{
+    CheckConcurrentAdds<flat_combining<>>();
+
+    std::vector<int> v;
+    {
+        accumulator<int, flat_combining<4>> a = v;
+        boost::thread_group threads;
+        for (int i = 0; i < 8; ++i)
+        {
+            threads.create_thread([&, i]()
+            {
+                for (int j = 0; j < 1000; ++j)
+                {
+                    a.add(i * 1000 + j);
+                }
+            });
+        }
+        threads.join_all();
+    }
+    ASSERT_EQ(v.size(), 8000u);
+    std::vector<int> last(8, -1);
+    for (size_t i = 0; i < v.size(); ++i)
+    {
+        ASSERT_GT(v[i], last[v[i] / 1000]);
+        last[v[i] / 1000] = v[i];
+    }
+
+    accumulator<int, flat_combining<>> b;
+    ASSERT_THROW(b.add(0), std::overflow_error);
+}
+
+TEST(AccumulatorTests, BufferedAccumulatorMergesInBatches)
+{
+    std::vector<int> v;
+    {
+        auto a = make_buffered_accumulator<int>(v, 100);
+        a.add(0);
+        a.add(1);
+        ASSERT_TRUE(v.empty());
+        a.flush();
+        ASSERT_EQ(v.size(), 2u);
+
+        boost::thread_group threads;
+        for (int i = 1; i <= 4; ++i)
+        {
+            threads.create_thread([&, i]()
+            {
+                for (int j = 0; j < 1050; ++j)
+                {
+                    a.add(i * 10000 + j);
+                }
+            });
+        }
+        threads.join_all();
+        //  Whatever is left below the threshold is still buffered.
+        ASSERT_EQ(v.size(), 2u + 4 * 1000);
+    }
+    //  Destroying the accumulator flushes the remaining items.
+    ASSERT_EQ(v.size(), 2u + 4 * 1050);
+
+    std::vector<int> last(5, -1);
+    for (size_t i = 2; i < v.size(); ++i)
+    {
+        ASSERT_EQ(v[i] % 10000, last[v[i] / 10000] + 1);
+        last[v[i] / 10000] = v[i] % 10000;
+    }
+}
+
+//  Collection whose push_back fails once it holds limit items.
+struct LimitedSink
+{
+    typedef int value_type;
+
+    std::vector<int> items;
+    size_t limit;
+
+    void push_back(int value)
+    {
+        if (items.size() == limit)
+        {
+            throw std::length_error("sink is full");
+        }
+        items.push_back(value);
+    }
+};
+
+TEST(AccumulatorTests, BufferedAccumulatorDropsItemsOfAFailedMerge)
+{
+    LimitedSink sink;
+    sink.limit = 1;
+    {
+        auto a = make_buffered_accumulator<int>(sink, 100);
+        a.add(0).add(1).add(2);
+        ASSERT_THROW(a.flush(), std::length_error);
+        ASSERT_EQ(sink.items.size(), 1u);
+
+        //  The buffer was cleared, so the items already moved are not
+        //  appended a second time.
+        sink.limit = 100;
+        a.add(3);
+        a.flush();
+    }
+    ASSERT_EQ(sink.items.size(), 2u);
+    ASSERT_EQ(sink.items[0], 0);
+    ASSERT_EQ(sink.items[1], 3);
+}
+
+TEST(AccumulatorTests, AddRangeCopiesRangesInOneCall)
+{
+    std::vector<int> source;
+    for (int i = 0; i < 100; ++i)
+    {
+        source.push_back(i);
+    }
+    std::list<int> list(source.begin(), source.end());
+
+    std::vector<int> v;
+    accumulator<int, atomic> a = v;
+    a.add_range(source.begin(), source.end());
+    a.add_range(source.data(), source.data() + 10);
+    a.add_range(list.begin(), list.end());
+    ASSERT_EQ(v.size(), 210u);
+    ASSERT_TRUE(std::equal(source.begin(), source.end(), v.begin()));
+    ASSERT_TRUE(std::equal(source.begin(), source.begin() + 10, v.begin() + 100));
+    ASSERT_TRUE(std::equal(source.begin(), source.end(), v.begin() + 110));
+
+    //  Adapters without native support receive the items one at a time.
+    std::vector<int> w;
+    accumulator<int> b = [&](int value) { w.push_back(value); };
+    b.add_range(source.data(), source.data() + source.size());
+    ASSERT_EQ(w, source);
+}
+
+TEST(AccumulatorTests, AddRangeCanAppendAVectorToItself)
+{
+    std::vector<int> v;
+    for (int i = 0; i < 4; ++i)
+    {
+        v.push_back(i);
+    }
+    v.shrink_to_fit();
+
+    //  Both calls grow the vector, which invalidates the range.
+    accumulator<int> a = v;
+    a.add_range(v.begin(), v.end());
+    a.add_range(v.data() + 1, v.data() + 3);
+    const int expected[] = {0, 1, 2, 3, 0, 1, 2, 3, 1, 2};
+    ASSERT_EQ(v.size(), 10u);
+    ASSERT_TRUE(std::equal(v.begin(), v.end(), expected));
+}
+
+TEST(AccumulatorTests, AddRangeDrainsEnumerators)
+{
+    std::vector<int> source;
+    for (int i = 0; i < 200; ++i)
+    {
+        source.push_back(i);
+    }
+    std::list<int> list(source.begin(), source.end());
+
+    std::deque<int> d;
+    accumulator<int> a = d;
+    enumerator<const int> contiguous = source;
+    a.add_range(contiguous);
+    enumerator<int> linked = list;
+    a.add_range(linked);
+    ASSERT_FALSE(contiguous.next());
+    ASSERT_FALSE(linked.next());
+    ASSERT_EQ(d.size(), 400u);
+    ASSERT_TRUE(std::equal(source.begin(), source.end(), d.begin()));
+    ASSERT_TRUE(std::equal(source.begin(), source.end(), d.begin() + 200));
+
+    accumulator<int> empty;
+    enumerator<int> e = list;
+    ASSERT_THROW(empty.add_range(e), std::overflow_error);
+}
+
+TEST(AccumulatorTests, EmplaceConstructsItemsInTheCollection)
+{
+    std::vector<Counted> v;
+    v.reserve(4);
+    accumulator<Counted> a = v;
+    Counted::reset();
+    a.emplace(1, 2);
+    ASSERT_EQ(Counted::constructed(), 1);
+    ASSERT_EQ(Counted::copied(), 0);
+    ASSERT_EQ(Counted::moved(), 0);
+
+    Counted item(3, 4);
+    a.add(item);
+    ASSERT_EQ(Counted::copied(), 1);
+    ASSERT_EQ(Counted::moved(), 0);
+    ASSERT_EQ(v.size(), 2u);
+    ASSERT_EQ(v[0].b, 2);
+    ASSERT_EQ(v[1].a, 3);
+
+    //  Other adapters receive an item constructed beforehand.
+    std::vector<int> sums;
+    accumulator<Counted> b = [&](Counted&& c) { sums.push_back(c.a + c.b); };
+    Counted::reset();
+    b.emplace(5, 6);
+    ASSERT_EQ(Counted::constructed(), 1);
+    ASSERT_EQ(Counted::copied(), 0);
+    ASSERT_EQ(sums[0], 11);
+}
+
+TEST(AccumulatorTests, AddCopiesValuesOfTypesAcceptingAnything)
+{
+    std::vector<boost::any> v;
+    accumulator<boost::any> a = v;
+    boost::any x = 42;
+    a.add(x);
+    a.emplace(7);
+    ASSERT_EQ(v.size(), 2u);
+    ASSERT_EQ(boost::any_cast<int>(v[0]), 42);
+    ASSERT_EQ(boost::any_cast<int>(v[1]), 7);
+}
@@ -3,7 +3,14 @@
 // See accompanying LICENSE file for full license information.
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <array>
+#include <list>
 #include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/any.hpp>
+#include <boost/thread.hpp>
 #include <gtest/gtest.h>
 #include "polymorphic_collections/aggregator.hpp"
 #include "test_utils.hpp"
@@ -52,3 +59,199 @@ TEST(AggregatorTests, AggregatorCanEncapsulateLambda)
     ASSERT_STREQ(m[2].c_str(), "two");
     ASSERT_STREQ(m[3].c_str(), "three");
 }
+
+TEST(AggregatorTests, StaticAggregatorConvertsToAggregator)
+{
+    std::map<int, std::string> m;
+    auto a = make_static_aggregator<int, std::string>(m);
+    std::string one = "one";
+    a.add(1, one);
+    a.add(2, "two");
+    ASSERT_STREQ(one.c_str(), "one");
+
+    aggregator<int, std::string> b = std::move(a);
+    b.add(3, "three");
+    ASSERT_EQ(m.size(), 3u);
+    ASSERT_STREQ(m[2].c_str(), "two");
+}
+
+TEST(AggregatorTests, StaticAggregatorAddsEnumerators)
+{
+    std::vector<std::pair<int, int>> pairs;
+    pairs.push_back(std::make_pair(1, 10));
+    pairs.push_back(std::make_pair(2, 20));
+    std::list<std::pair<int, int>> more(1, std::make_pair(3, 30));
+
+    std::map<int, int> m;
+    auto a = make_static_aggregator<int, int>(m);
+    auto contiguous = make_static_enumerator<std::pair<int, int>>(pairs);
+    auto linked = make_static_enumerator<std::pair<int, int>>(more);
+    a.add_many(contiguous).add_many(linked);
+    a.flush();
+    ASSERT_EQ(m.size(), 3u);
+    ASSERT_EQ(m[1], 10);
+    ASSERT_EQ(m[3], 30);
+}
+
+TEST(AggregatorTests, AggregatorCanUseFlatCombining)
+{
+    std::map<int, std::string> m;
+    aggregator<int, std::string, flat_combining<>> a = m;
+    boost::thread_group threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.create_thread([&, i]()
+        {
+            for (int j = 0; j < 100; ++j)
+            {
+                a.add(i * 100 + j, "x");
+            }
+        });
+    }
+    threads.join_all();
+    ASSERT_EQ(m.size(), 400u);
+}
+
+TEST(AggregatorTests, TryEmplaceOnlyConstructsValuesForNewKeys)
+{
+    std::map<int, Counted> m;
+    aggregator<int, Counted> a = m;
+    Counted::reset();
+    a.try_emplace(1, 2, 3);
+    ASSERT_EQ(Counted::constructed(), 1);
+    ASSERT_EQ(Counted::moved(), 0);
+    a.try_emplace(1, 4, 5);
+    ASSERT_EQ(Counted::constructed(), 1);
+
+    Counted value(6, 7);
+    a.add(2, value);
+    ASSERT_EQ(Counted::copied(), 1);
+    ASSERT_EQ(Counted::moved(), 0);
+    ASSERT_EQ(m.size(), 2u);
+    ASSERT_EQ(m.find(1)->second.b, 3);
+    ASSERT_EQ(m.find(2)->second.a, 6);
+}
+
+TEST(AggregatorTests, AddManyInsertsBatchesOfPairs)
+{
+    std::vector<std::pair<int, int>> sorted;
+    for (int i = 0; i < 1000; ++i)
+    {
+        sorted.push_back(std::make_pair(i, i * 2));
+    }
+    std::vector<std::pair<int, int>> shuffled;
+    for (int i = 0; i < 100; ++i)
+    {
+        shuffled.push_back(std::make_pair((i * 37) % 100 + 2000, i));
+    }
+    //  Existing keys are left untouched.
+    shuffled.push_back(std::make_pair(5, -1));
+
+    std::map<int, int> m;
+    aggregator<int, int, atomic> a = m;
+    a.add_many(sorted.begin(), sorted.end());
+    a.add_many(shuffled.begin(), shuffled.end());
+    ASSERT_EQ(m.size(), 1100u);
+    ASSERT_EQ(m[5], 10);
+    ASSERT_EQ(m[999], 1998);
+    ASSERT_EQ(m[2000 + 37 % 100], 1);
+
+    std::unordered_map<int, int> u;
+    aggregator<int, int> b = u;
+    enumerator<std::pair<int, int>> e = sorted;
+    b.add_many(e);
+    ASSERT_EQ(u.size(), 1000u);
+    ASSERT_EQ(u[10], 20);
+
+    //  Other adapters receive the pairs one at a time.
+    std::map<int, int> copy;
+    std::list<std::pair<const int, int>> list(m.begin(), m.end());
+    aggregator<int, int> c = [&](int key, int value) { copy[key] = value; };
+    enumerator<std::pair<const int, int>> f = list;
+    c.add_many(f);
+    ASSERT_EQ(copy, m);
+}
+
+TEST(AggregatorTests, AggregatorCanAllocateFromMemoryResource)
+{
+    CountingResource resource;
+    {
+        std::map<int, int> m;
+        std::array<int, 8> offsets = {{ 1, 2, 3, 4, 5, 6, 7, 8 }};
+        //  The lambda is too large for the internal buffer.
+        auto a = make_aggregator<int, int>([&m, offsets](int key, int value)
+        {
+            m[key] = value + offsets[key];
+        }, &resource);
+        ASSERT_EQ(a.resource(), &resource);
+        ASSERT_EQ(resource.allocated, 1u);
+        a.add(1, 10);
+        ASSERT_EQ(m[1], 12);
+    }
+    ASSERT_EQ(resource.outstanding(), 0u);
+}
+
+TEST(AggregatorTests, MergingAggregatorCombinesDuplicateKeys)
+{
+    std::map<std::string, int> counts;
+    aggregator<std::string, int, atomic> a = make_merging_aggregator<std::string, int>(counts, std::plus<int>());
+    a.add("a", 1).add("b", 1).add("a", 1);
+    a.try_emplace("b", 2);
+    std::vector<std::pair<std::string, int>> batch;
+    batch.push_back(std::make_pair("a", 3));
+    batch.push_back(std::make_pair("c", 4));
+    a.add_many(batch.begin(), batch.end());
+    ASSERT_EQ(counts.size(), 3u);
+    ASSERT_EQ(counts["a"], 5);
+    ASSERT_EQ(counts["b"], 3);
+    ASSERT_EQ(counts["c"], 4);
+
+    std::unordered_map<int, int> maxima;
+    auto b = make_merging_aggregator<int, int>(maxima, [](int a, int b) { return std::max(a, b); });
+    b.add(1, 5).add(1, 3).add(2, 1).add(1, 7);
+    ASSERT_EQ(maxima[1], 7);
+    ASSERT_EQ(maxima[2], 1);
+}
+
+TEST(AggregatorTests, BufferedAggregatorCombinesPerThreadBeforeMerging)
+{
+    std::map<int, int> counts;
+    {
+        auto a = make_buffered_aggregator<int, int>(counts, std::plus<int>(), 50);
+        a.add(7, 1).add(7, 1);
+        ASSERT_TRUE(counts.empty());
+        a.flush();
+        ASSERT_EQ(counts[7], 2);
+
+        boost::thread_group threads;
+        for (int i = 0; i < 4; ++i)
+        {
+            threads.create_thread([&]()
+            {
+                for (int j = 0; j < 10000; ++j)
+                {
+                    a.add(j % 100, 1);
+                }
+            });
+        }
+        threads.join_all();
+    }
+    //  Destroying the aggregator flushes the remaining items.
+    ASSERT_EQ(counts.size(), 100u);
+    for (int key = 0; key < 100; ++key)
+    {
+        ASSERT_EQ(counts[key], key == 7 ? 402 : 400);
+    }
+}
+
+TEST(AggregatorTests, AddCopiesValuesOfTypesAcceptingAnything)
+{
+    std::map<int, boost::any> m;
+    aggregator<int, boost::any> a = m;
+    boost::any x = 42;
+    a.add(1, x);
+    a.try_emplace(2, 7);
+    ASSERT_EQ(m.size(), 2u);
+    ASSERT_EQ(boost::any_cast<int>(m[1]), 42);
+    ASSERT_EQ(boost::any_cast<int>(m[2]), 7);
+}
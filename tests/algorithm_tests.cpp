@@ -0,0 +1,449 @@
+//////////////////////////////////////////////////////////////////////////////// 
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <stdexcept>
+#include <vector>
+#include <gtest/gtest.h>
+#include "polymorphic_collections/algorithm.hpp"
+#include "test_utils.hpp"
+
+using namespace polymorphic_collections;
+
+namespace
+{
+    std::vector<int> MakeSequence(int count)
+    {
+        std::vector<int> v;
+        for (int i = 0; i < count; ++i)
+        {
+            v.push_back(i % 10);
+        }
+        return v;
+    }
+
+    //  Checks count, find and equal on every length and alignment around the
+    //  vector width, so that both the vectorized loop and the tail are exercised.
+    template <typename T>
+    void CheckContiguousComparisons()
+    {
+        std::vector<T> v;
+        for (int i = 0; i < 80; ++i)
+        {
+            v.push_back(static_cast<T>(i % 7));
+        }
+        for (size_t first = 0; first < 8; ++first)
+        {
+            for (size_t last = first; last <= v.size(); last += 3)
+            {
+                size_t expected = static_cast<size_t>(std::count(v.begin() + first, v.begin() + last, T(5)));
+                enumerator<T> e = make_enumerator(v.data() + first, last - first);
+                ASSERT_EQ(count(e, T(5)), expected);
+
+                enumerator<const T> f = make_enumerator(static_cast<const T*>(v.data()) + first, last - first);
+                auto found = find(f, T(5));
+                auto it = std::find(v.begin() + first, v.begin() + last, T(5));
+                ASSERT_EQ(found ? &*found : nullptr, it == v.begin() + last ? nullptr : &*it);
+
+                std::vector<T> w(v.begin() + first, v.begin() + last);
+                enumerator<T> a = make_enumerator(v.data() + first, last - first), b = w;
+                ASSERT_TRUE(equal(a, b));
+                if (!w.empty())
+                {
+                    w[(last - first) / 2] = T(100);
+                    enumerator<T> c = make_enumerator(v.data() + first, last - first), d = w;
+                    ASSERT_FALSE(equal(c, d));
+                }
+            }
+        }
+    }
+}
+
+TEST(AlgorithmTests, ForEachVisitsAllItems)
+{
+    std::vector<int> v = MakeSequence(100);
+    std::list<int> l(v.begin(), v.end());
+    enumerator<int> e = v;
+    enumerator<int> f = l;
+    int sum_v = 0, sum_l = 0;
+    for_each(e, [&] (int x) { sum_v += x; });
+    for_each(f, [&] (int x) { sum_l += x; });
+    ASSERT_EQ(sum_v, 450);
+    ASSERT_EQ(sum_l, 450);
+}
+
+TEST(AlgorithmTests, ForEachCanModifyItems)
+{
+    std::list<int> l(3, 1);
+    enumerator<int> e = l;
+    for_each(e, [] (int& x) { ++x; });
+    ASSERT_EQ(l.front(), 2);
+    ASSERT_EQ(l.back(), 2);
+}
+
+TEST(AlgorithmTests, FindReturnsReferenceToFirstMatch)
+{
+    std::vector<int> v = MakeSequence(20);
+    std::list<int> l(v.begin(), v.end());
+    enumerator<int> e = v;
+    enumerator<int> f = l;
+    auto a = find(e, 5);
+    auto b = find(f, 5);
+    ASSERT_TRUE(a);
+    ASSERT_TRUE(b);
+    ASSERT_EQ(&*a, &v[5]);
+    ASSERT_EQ(&*b, &*std::next(l.begin(), 5));
+
+    enumerator<int> g = v;
+    ASSERT_FALSE(find(g, 42));
+}
+
+TEST(AlgorithmTests, FindStopsRightAfterTheMatch)
+{
+    std::vector<int> v = MakeSequence(20);
+    std::list<int> l(v.begin(), v.end());
+    enumerator<int> e = v;
+    enumerator<int> f = l;
+    ASSERT_TRUE(find(e, 5));
+    ASSERT_TRUE(find(f, 5));
+    ASSERT_EQ(&*e.next(), &v[6]);
+    ASSERT_EQ(*f.next(), 6);
+
+    ASSERT_TRUE(find_if(e, [] (int x) { return x == 8; }));
+    ASSERT_EQ(&*e.next(), &v[9]);
+
+    ASSERT_FALSE(find(e, 42));
+    ASSERT_FALSE(e.next());
+}
+
+TEST(AlgorithmTests, FindIfUsesPredicate)
+{
+    std::list<int> l;
+    l.push_back(1);
+    l.push_back(4);
+    l.push_back(6);
+    enumerator<const int> e = l;
+    auto result = find_if(e, [] (int x) { return x % 2 == 0; });
+    ASSERT_TRUE(result);
+    ASSERT_EQ(*result, 4);
+}
+
+TEST(AlgorithmTests, CountCountsMatchingItems)
+{
+    std::vector<int> v = MakeSequence(1000);
+    std::list<int> l(v.begin(), v.end());
+    enumerator<int> e = v;
+    enumerator<int> f = l;
+    ASSERT_EQ(count(e, 3), 100);
+    ASSERT_EQ(count(f, 3), 100);
+}
+
+TEST(AlgorithmTests, CountIfCountsMatchingItems)
+{
+    std::vector<int> v = MakeSequence(1000);
+    std::list<int> l(v.begin(), v.end());
+    enumerator<int> e = v;
+    enumerator<int> f = l;
+    ASSERT_EQ(count_if(e, [] (int x) { return x < 5; }), 500);
+    ASSERT_EQ(count_if(f, [] (int x) { return x < 5; }), 500);
+}
+
+TEST(AlgorithmTests, EqualComparesContiguousAndNonContiguousSequences)
+{
+    std::vector<int> v = MakeSequence(50);
+    std::vector<int> w = v;
+    std::list<int> l(v.begin(), v.end());
+    {
+        enumerator<int> a = v, b = w;
+        ASSERT_TRUE(equal(a, b));
+    }
+    {
+        enumerator<int> a = v, b = l;
+        ASSERT_TRUE(equal(a, b));
+        enumerator<int> c = l, d = v;
+        ASSERT_TRUE(equal(c, d));
+        enumerator<int> f = l, g = l;
+        ASSERT_TRUE(equal(f, g));
+    }
+    w.back() = 42;
+    l.push_back(0);
+    {
+        enumerator<int> a = v, b = w;
+        ASSERT_FALSE(equal(a, b));
+        enumerator<int> c = v, d = l;
+        ASSERT_FALSE(equal(c, d));
+    }
+}
+
+TEST(AlgorithmTests, ContiguousComparisonsOfArithmeticTypes)
+{
+    CheckContiguousComparisons<int>();
+    CheckContiguousComparisons<unsigned int>();
+    CheckContiguousComparisons<float>();
+    CheckContiguousComparisons<double>();
+    CheckContiguousComparisons<std::int64_t>();
+    CheckContiguousComparisons<std::uint64_t>();
+    CheckContiguousComparisons<short>();
+}
+
+TEST(AlgorithmTests, ContiguousComparisonsFollowOperatorEquals)
+{
+    //  64-bit values differing in only one half, NaN which never compares
+    //  equal, and signed zeros which do.
+    std::vector<std::uint64_t> u(9, 0x100000001ull);
+    u[7] = 0x100000002ull;
+    enumerator<std::uint64_t> e = u;
+    ASSERT_EQ(count(e, 0x100000001ull), 8);
+    enumerator<std::uint64_t> f = u;
+    ASSERT_EQ(&*find(f, 0x100000002ull), &u[7]);
+
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    std::vector<double> d(9, nan);
+    std::vector<double> c = d;
+    enumerator<double> g = d;
+    ASSERT_EQ(count(g, nan), 0);
+    enumerator<double> h = d, i = c;
+    ASSERT_FALSE(equal(h, i));
+
+    std::vector<float> z(9, 0.0f);
+    enumerator<float> j = z;
+    ASSERT_EQ(count(j, -0.0f), 9);
+}
+
+TEST(AlgorithmTests, ExecutorRunsEveryIndexOnce)
+{
+    executor ex(3);
+    std::vector<int> hits(1000, 0);
+    ex.for_each_index(hits.size(), [&] (size_t i)
+    {
+        ++hits[i];
+    });
+    ASSERT_EQ(std::count(hits.begin(), hits.end(), 1), 1000);
+}
+
+TEST(AlgorithmTests, ExecutorPropagatesExceptions)
+{
+    executor ex(2);
+    ASSERT_THROW(ex.for_each_index(16, [] (size_t i)
+    {
+        if (i == 7)
+        {
+            throw std::runtime_error("task failed");
+        }
+    }), std::runtime_error);
+}
+
+TEST(AlgorithmTests, ExecutorSupportsNestedParallelism)
+{
+    executor ex(2);
+    boost::atomic<int> total(0);
+    ex.for_each_index(8, [&] (size_t)
+    {
+        ex.for_each_index(8, [&] (size_t)
+        {
+            ++total;
+        });
+    });
+    ASSERT_EQ(total.load(), 64);
+}
+
+TEST(AlgorithmTests, ParallelForEachVisitsAllItems)
+{
+    executor ex(3);
+    std::vector<int> v(10000, 1);
+    enumerator<int> e = v;
+    parallel_for_each(e, [] (int& x) { ++x; }, ex);
+    ASSERT_EQ(std::count(v.begin(), v.end(), 2), 10000);
+    ASSERT_FALSE(e.next());
+
+    std::list<int> l(100, 1);
+    enumerator<int> f = l;
+    parallel_for_each(f, [] (int& x) { ++x; }, ex);
+    ASSERT_EQ(std::count(l.begin(), l.end(), 2), 100);
+}
+
+TEST(AlgorithmTests, ParallelCountMatchesSequentialCount)
+{
+    executor ex(3);
+    std::vector<int> v = MakeSequence(10007);
+    enumerator<int, atomic> e = v;
+    ASSERT_EQ(parallel_count(e, 3, ex), 1001);
+    enumerator<int> f = v;
+    ASSERT_EQ(parallel_count_if(f, [] (int x) { return x < 5; }, ex), 5005);
+    std::list<int> l(v.begin(), v.end());
+    enumerator<int> g = l;
+    ASSERT_EQ(parallel_count(g, 3, ex), 1001);
+}
+
+TEST(AlgorithmTests, ParallelFindReturnsFirstMatchByPosition)
+{
+    executor ex(3);
+    std::vector<int> v(10000, 0);
+    v[2500] = 1;
+    v[7500] = 1;
+    v[9999] = 1;
+    enumerator<int> e = v;
+    auto result = parallel_find(e, 1, ex);
+    ASSERT_TRUE(result);
+    ASSERT_EQ(&*result, &v[2500]);
+
+    enumerator<int> f = v;
+    ASSERT_FALSE(parallel_find(f, 2, ex));
+}
+
+TEST(AlgorithmTests, ParallelEqualComparesSequences)
+{
+    executor ex(3);
+    std::vector<int> v = MakeSequence(5000);
+    std::vector<int> w = v;
+    {
+        enumerator<int> a = v, b = w;
+        ASSERT_TRUE(parallel_equal(a, b, ex));
+    }
+    {
+        std::list<int> l(v.begin(), v.end());
+        enumerator<int> a = v, b = l;
+        ASSERT_TRUE(parallel_equal(a, b, ex));
+        enumerator<int> c = l, d = v;
+        ASSERT_TRUE(parallel_equal(c, d, ex));
+    }
+    {
+        w.pop_back();
+        enumerator<int> a = v, b = w;
+        ASSERT_FALSE(parallel_equal(a, b, ex));
+        enumerator<int> c = w, d = v;
+        ASSERT_FALSE(parallel_equal(c, d, ex));
+    }
+    {
+        w.push_back(v.back());
+        w[1234] = -1;
+        enumerator<int> a = v, b = w;
+        ASSERT_FALSE(parallel_equal(a, b, ex));
+    }
+}
+
+TEST(AlgorithmTests, AlgorithmsAcceptStaticEnumerators)
+{
+    executor ex(3);
+    std::vector<int> v = MakeSequence(1000);
+    std::list<int> l(v.begin(), v.end());
+    {
+        auto e = make_static_enumerator<int>(v);
+        ASSERT_EQ(count(e, 3), 100u);
+        auto f = make_static_enumerator<int>(l);
+        ASSERT_EQ(count_if(f, [] (int x) { return x < 5; }), 500u);
+    }
+    {
+        auto e = make_static_enumerator<int>(v);
+        auto f = make_static_enumerator<int>(l);
+        ASSERT_TRUE(equal(e, f));
+    }
+    {
+        auto e = make_static_enumerator<int>(v);
+        enumerator<int> f = l;
+        ASSERT_TRUE(parallel_equal(e, f, ex));
+    }
+    {
+        auto e = make_static_enumerator<int>(v);
+        ASSERT_EQ(parallel_reduce(e, 0, ex), 4500);
+        auto f = make_static_enumerator<int>(l);
+        ASSERT_EQ(&*parallel_find(f, 9, ex), &*std::find(l.begin(), l.end(), 9));
+    }
+}
+
+TEST(AlgorithmTests, ReduceSumsItems)
+{
+    std::vector<int> v = MakeSequence(1003);
+    std::list<int> l(v.begin(), v.end());
+    enumerator<int> e = v;
+    enumerator<int> f = l;
+    ASSERT_EQ(reduce(e, 0), 4503);
+    ASSERT_EQ(reduce(f, 10, std::plus<int>()), 4513);
+
+    std::vector<double> d(1001, 0.5);
+    enumerator<const double> g = d;
+    ASSERT_DOUBLE_EQ(reduce(g, 0.0), 500.5);
+}
+
+TEST(AlgorithmTests, TransformReduceAppliesTransformToEachItem)
+{
+    std::vector<std::string> v;
+    v.push_back("one");
+    v.push_back("three");
+    enumerator<std::string> e = v;
+    size_t total = transform_reduce(e, size_t(0), std::plus<size_t>(), [] (const std::string& s)
+    {
+        return s.size();
+    });
+    ASSERT_EQ(total, 8);
+}
+
+TEST(AlgorithmTests, MinAndMaxElementFollowStandardTieBreaking)
+{
+    int ar[] = {3, 1, 4, 1, 5, 9, 2, 6, 9};
+    std::list<int> l(std::begin(ar), std::end(ar));
+    {
+        enumerator<int> e = ar, f = l;
+        ASSERT_EQ(&*min_element(e), &ar[1]);
+        ASSERT_EQ(&*min_element(f), &*std::next(l.begin(), 1));
+    }
+    {
+        enumerator<int> e = ar, f = l;
+        ASSERT_EQ(&*max_element(e), &ar[5]);
+        ASSERT_EQ(&*max_element(f), &*std::next(l.begin(), 5));
+    }
+    {
+        enumerator<int> e = ar, f = l;
+        auto a = minmax(e);
+        auto b = minmax(f);
+        ASSERT_EQ(&*a.first, &ar[1]);
+        ASSERT_EQ(&*a.second, &ar[8]);
+        ASSERT_EQ(&*b.first, &*std::next(l.begin(), 1));
+        ASSERT_EQ(&*b.second, &*std::next(l.begin(), 8));
+    }
+    {
+        enumerator<int> e;
+        ASSERT_FALSE(min_element(e));
+        ASSERT_FALSE(max_element(e));
+        ASSERT_FALSE(minmax(e).first);
+    }
+}
+
+TEST(AlgorithmTests, ParallelReduceMatchesSequentialReduce)
+{
+    executor ex(3);
+    std::vector<int> v = MakeSequence(100003);
+    enumerator<int> e = v;
+    ASSERT_EQ(parallel_reduce(e, 7, ex), 450003 + 7);
+    enumerator<int> f = v;
+    ASSERT_EQ(parallel_transform_reduce(f, 0, std::plus<int>(), [] (int x) { return x * 2; }, ex), 900006);
+}
+
+TEST(AlgorithmTests, ParallelMinMaxReturnsSameItemsAsSequentialVersions)
+{
+    executor ex(3);
+    std::vector<int> v = MakeSequence(10000);
+    v[7777] = -1;
+    v[8888] = -1;
+    v[1111] = 42;
+    v[2222] = 42;
+    {
+        enumerator<int> e = v;
+        ASSERT_EQ(&*parallel_min_element(e, ex), &v[7777]);
+        enumerator<int> f = v;
+        ASSERT_EQ(&*parallel_max_element(f, ex), &v[1111]);
+        enumerator<int> g = v;
+        auto result = parallel_minmax(g, ex);
+        ASSERT_EQ(&*result.first, &v[7777]);
+        ASSERT_EQ(&*result.second, &v[2222]);
+    }
+    {
+        std::vector<int> empty;
+        enumerator<int> e = empty;
+        ASSERT_FALSE(parallel_min_element(e, ex));
+    }
+}
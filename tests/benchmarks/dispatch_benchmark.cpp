@@ -0,0 +1,138 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Single-threaded microbenchmark of the calls which go through the function
+//  tables of the facades. Each line is the best of 7 runs of 1M operations,
+//  with everything hot in L1, so it measures the dispatch itself rather than
+//  the collections.
+//
+//  It is not part of the test suite; build it with optimizations, e.g.:
+//      g++ -std=c++17 -O2 -I. tests/benchmarks/dispatch_benchmark.cpp -lboost_thread -pthread
+//
+//  Compare against -fno-devirtualize-speculatively when numbers move: GCC can
+//  inline the single adapter type used here, which makes some calls look
+//  cheaper than they are in programs with more than one adapter type.
+//
+
+#include <boost/utility.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "polymorphic_collections/accessor.hpp"
+#include "polymorphic_collections/accumulator.hpp"
+#include "polymorphic_collections/aggregator.hpp"
+#include "polymorphic_collections/enumerator.hpp"
+
+using namespace polymorphic_collections;
+
+namespace
+{
+    const int operations = 1 << 20;
+
+    volatile long sink;
+
+    //  Returns the time of the fastest of 7 runs of func, in ns per operation.
+    template <typename F>
+    double measure(F func)
+    {
+        typedef std::chrono::steady_clock clock;
+        double best = 1e18;
+        for (int run = 0; run < 7; ++run)
+        {
+            clock::time_point start = clock::now();
+            func();
+            best = std::min(best, std::chrono::duration<double, std::nano>(clock::now() - start).count());
+        }
+        return best / operations;
+    }
+}
+
+int main()
+{
+    std::vector<int> v(operations, 1);
+    std::list<int> l(v.begin(), v.end());
+    std::unordered_map<int, int> m;
+    for (int i = 0; i < 4096; ++i)
+    {
+        m[i] = i;
+    }
+
+    std::printf("enumerator::next (vector)       %.2f ns\n", measure([&]
+    {
+        enumerator<int> e = v;
+        long sum = 0;
+        while (auto x = e.next())
+        {
+            sum += *x;
+        }
+        sink = sum;
+    }));
+
+    std::printf("enumerator::next (list)         %.2f ns\n", measure([&]
+    {
+        enumerator<int> e = l;
+        long sum = 0;
+        while (auto x = e.next())
+        {
+            sum += *x;
+        }
+        sink = sum;
+    }));
+
+    std::printf("accessor::get (unordered_map)   %.2f ns\n", measure([&]
+    {
+        accessor<int, int> a = m;
+        long sum = 0;
+        for (int i = 0; i < operations; ++i)
+        {
+            sum += *a.get(i & 4095);
+        }
+        sink = sum;
+    }));
+
+    std::vector<int> out;
+    out.reserve(operations);
+    std::printf("accumulator::add (vector)       %.2f ns\n", measure([&]
+    {
+        out.clear();
+        accumulator<int> a = out;
+        for (int i = 0; i < operations; ++i)
+        {
+            a.add(i);
+        }
+        sink = static_cast<long>(out.size());
+    }));
+
+    std::unordered_map<int, int> dst;
+    dst.reserve(8192);
+    std::printf("aggregator::add (unordered_map) %.2f ns\n", measure([&]
+    {
+        dst.clear();
+        aggregator<int, int> a = dst;
+        for (int i = 0; i < operations; ++i)
+        {
+            a.add(i & 4095, i);
+        }
+        sink = static_cast<long>(dst.size());
+    }));
+
+    std::printf("enumerator move (inline)        %.2f ns\n", measure([&]
+    {
+        enumerator<int> a = v;
+        for (int i = 0; i < operations; ++i)
+        {
+            enumerator<int> b(std::move(a));
+            a = std::move(b);
+        }
+        sink = a.next() ? 1 : 0;
+    }));
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////////// 
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <boost/utility.hpp>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include "polymorphic_collections/accessor.hpp"
+#include "polymorphic_collections/aggregator.hpp"
+#include "polymorphic_collections/bloom_filter.hpp"
+
+using namespace polymorphic_collections;
+
+TEST(BloomFilterTests, BloomFilterHasNoFalseNegatives)
+{
+    bloom_filter<int> filter(10000);
+    for (int i = 0; i < 10000; ++i)
+    {
+        filter.insert(i * 3);
+    }
+    for (int i = 0; i < 10000; ++i)
+    {
+        ASSERT_TRUE(filter.may_contain(i * 3));
+    }
+
+    int positives = 0;
+    for (int i = 0; i < 10000; ++i)
+    {
+        positives += filter.may_contain(i * 3 + 1) ? 1 : 0;
+    }
+    ASSERT_LT(positives, 300);
+
+    filter.clear();
+    ASSERT_FALSE(filter.may_contain(0));
+}
+
+TEST(BloomFilterTests, FilteredFacadesShareTheFilter)
+{
+    std::map<std::string, int> m;
+    bloom_filter<std::string> keys(100);
+
+    aggregator<std::string, int> a = make_filtered_aggregator<std::string, int>(m, keys);
+    a.add("one", 1).add("two", 2);
+    a.try_emplace("three", 3);
+    std::vector<std::pair<std::string, int>> more;
+    more.push_back(std::make_pair("four", 4));
+    more.push_back(std::make_pair("five", 5));
+    a.add_many(more.begin(), more.end());
+
+    accessor<std::string, int> b = make_filtered_accessor<std::string, int>(m, keys);
+    ASSERT_EQ(*b["one"], 1);
+    ASSERT_EQ(*b["three"], 3);
+    ASSERT_EQ(*b["five"], 5);
+
+    //  Keys rejected by the filter do not reach the source.
+    int lookups = 0;
+    auto lookup = [&](const std::string& key) -> boost::optional<int>
+    {
+        ++lookups;
+        auto it = m.find(key);
+        return it == m.end() ? boost::optional<int>() : boost::optional<int>(it->second);
+    };
+    accessor<std::string, int> c = make_filtered_accessor<std::string, int>(lookup, keys);
+    ASSERT_EQ(*c["two"], 2);
+    ASSERT_EQ(lookups, 1);
+    int missing = 0;
+    for (int i = 0; i < 100; ++i)
+    {
+        missing += c[std::to_string(i)] ? 0 : 1;
+    }
+    ASSERT_EQ(missing, 100);
+    ASSERT_LT(lookups, 10);
+}
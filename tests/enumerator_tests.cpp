@@ -4,10 +4,12 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <array>
+#include <deque>
 #include <map>
 #include <set>
 #include <list>
 #include <vector>
+#include <boost/thread.hpp>
 #include <gtest/gtest.h>
 #include "polymorphic_collections/enumerator.hpp"
 #include "test_utils.hpp"
@@ -346,6 +348,103 @@ TEST(EnumeratorTests, CanMoveEnumeratorsWithDifferentPolicies)
     enumerator<int, atomic_nonblocking> g = std::move(f);
 }
 
+TEST(EnumeratorTests, MovedEnumeratorsKeepTheirPosition)
+{
+    std::list<int> l;
+    l.push_back(0);
+    l.push_back(1);
+    l.push_back(2);
+    std::vector<int> v(l.begin(), l.end());
+    enumerator<int> e = l;
+    enumerator<int> f = std::move(v);
+    ASSERT_EQ(*e.next(), 0);
+    ASSERT_EQ(*f.next(), 0);
+    enumerator<int, atomic> g = std::move(e);
+    enumerator<int, atomic> h = std::move(f);
+    e = std::move(g);
+    f = std::move(h);
+    ASSERT_EQ(*e.next(), 1);
+    ASSERT_EQ(*f.next(), 1);
+}
+
+TEST(EnumeratorTests, StoragePolicyDeterminesFacadeLayout)
+{
+    ASSERT_EQ(sizeof(enumerator<int>), 32);
+    ASSERT_EQ((sizeof(enumerator<int, no_lock, cache_line_storage>)), cache_line_size);
+    ASSERT_EQ((boost::alignment_of<enumerator<int, no_lock, cache_line_storage>>::value), cache_line_size);
+    ASSERT_EQ(static_cast<size_t>(enumerator<int, no_lock, inline_storage<100>>::internal_storage_size), 100);
+}
+
+TEST(EnumeratorTests, CanMoveEnumeratorsWithDifferentStorage)
+{
+    std::vector<int> v;
+    v.push_back(0);
+    v.push_back(1);
+    v.push_back(2);
+    //  The embedded vector only fits in the larger buffer.
+    enumerator<int, no_lock, inline_storage<64>> e = std::move(v);
+    ASSERT_EQ(*e.next(), 0);
+    enumerator<int> f = std::move(e);
+    ASSERT_FALSE(e.next());
+    ASSERT_EQ(*f.next(), 1);
+    enumerator<int, atomic, cache_line_storage> g = std::move(f);
+    ASSERT_EQ(*g.next(), 2);
+    ASSERT_FALSE(g.next());
+}
+
+TEST(EnumeratorTests, StrictInlineStorageHoldsAdaptersWhichFit)
+{
+    int values[] = { 0, 1, 2, 3 };
+    enumerator<int, no_lock, strict_inline<2 * sizeof(int*)>> e = values;
+    enumerator<int, no_lock, strict_inline<2 * sizeof(int*)>> tail;
+    ASSERT_TRUE(e.split(tail));
+    enumerator<int, no_lock, strict_inline<4 * sizeof(int*)>> f = std::move(e);
+    ASSERT_EQ(*f.next(), 0);
+    ASSERT_EQ(*f.next(), 1);
+    ASSERT_FALSE(f.next());
+    ASSERT_EQ(*tail.next(), 2);
+
+    //  A pair of pointers does not fit in a tail with room for only one.
+    enumerator<int, no_lock, strict_inline<sizeof(int*)>> too_small;
+    enumerator<int> g = values;
+    ASSERT_FALSE(g.split(too_small));
+    ASSERT_EQ(*g.next(), 0);
+}
+
+TEST(EnumeratorTests, ResourceStorageAllocatesFromTheResource)
+{
+    CountingResource resource;
+    {
+        std::vector<int> v(3, 7);
+        auto e = make_enumerator<int>(std::move(v), &resource);
+        ASSERT_EQ(e.resource(), &resource);
+        //  The adapter, which is too large for the internal buffer, comes from
+        //  the resource.
+        ASSERT_EQ(resource.allocated, 1u);
+
+        //  Moving to an enumerator on the same resource keeps the blocks.
+        enumerator<int, no_lock, pmr_storage> f = std::move(e);
+        ASSERT_EQ(f.resource(), &resource);
+        ASSERT_EQ(*f.next(), 7);
+        ASSERT_EQ(resource.allocated, 1u);
+
+        int values[] = { 1, 2 };
+        enumerator<int, no_lock, resource_storage<sizeof(void*)>> g(values, &resource);
+        ASSERT_EQ(resource.allocated, 2u);
+
+        //  Moving to a facade on another resource relocates the adapter.
+        CountingResource other;
+        enumerator<int, no_lock, resource_storage<sizeof(void*)>> h(std::vector<int>(), &other);
+        h = std::move(g);
+        ASSERT_EQ(resource.outstanding(), 1u);
+        ASSERT_EQ(other.outstanding(), 1u);
+        ASSERT_EQ(*h.next(), 1);
+        h = enumerator<int>();
+        ASSERT_EQ(other.outstanding(), 0u);
+    }
+    ASSERT_EQ(resource.outstanding(), 0u);
+}
+
 TEST(EnumeratorTests, EnumeratorCanEmbedContainer)
 {
     std::vector<int> v;
@@ -359,3 +458,348 @@ TEST(EnumeratorTests, EnumeratorCanEmbedContainer)
     ASSERT_EQ(*e.next(), 2);
     ASSERT_FALSE(e.next());
 }
+
+TEST(EnumeratorTests, VectorsAreEmbeddedByValue)
+{
+    CountingResource resource;
+    std::vector<int> v(3, 1);
+    std::array<int, 3> a = {{ 3, 3, 3 }};
+    enumerator<int, no_lock, resource_storage<64>> ev(std::move(v), &resource);
+    ASSERT_EQ(resource.allocated, 0u);
+
+    //  The iterators of an array would not follow it when it is moved.
+    enumerator<int, no_lock, resource_storage<64>> ea(std::move(a), &resource);
+    ASSERT_EQ(resource.allocated, 1u);
+
+    //  Relocating the adapters keeps the embedded iterators valid.
+    ASSERT_EQ(*ev.next(), 1);
+    enumerator<int> fv = std::move(ev);
+    enumerator<int> fa = std::move(ea);
+    for (int i = 0; i < 2; ++i)
+    {
+        ASSERT_EQ(*fv.next(), 1);
+    }
+    ASSERT_FALSE(fv.next());
+    for (int i = 0; i < 3; ++i)
+    {
+        ASSERT_EQ(*fa.next(), 3);
+    }
+    ASSERT_FALSE(fa.next());
+}
+
+TEST(EnumeratorTests, NextNRetrievesItemsInBlocks)
+{
+    std::vector<int> v;
+    for (int i = 0; i < 5; ++i)
+    {
+        v.push_back(i);
+    }
+    enumerator<int> e = v;
+    int* block[2];
+    ASSERT_EQ(e.next_n(block, 2), 2);
+    ASSERT_EQ(*block[0], 0);
+    ASSERT_EQ(*block[1], 1);
+    ASSERT_EQ(e.next_n(block, 2), 2);
+    ASSERT_EQ(*block[0], 2);
+    ASSERT_EQ(*block[1], 3);
+    ASSERT_EQ(e.next_n(block, 2), 1);
+    ASSERT_EQ(block[0], &v[4]);
+    ASSERT_EQ(e.next_n(block, 2), 0);
+    ASSERT_FALSE(e.next());
+}
+
+TEST(EnumeratorTests, NextNCanBeMixedWithNext)
+{
+    std::list<int> l;
+    l.push_back(0);
+    l.push_back(1);
+    l.push_back(2);
+    enumerator<const int> e = std::move(l);
+    const int* block[4];
+    ASSERT_EQ(*e.next(), 0);
+    ASSERT_EQ(e.next_n(block, 4), 2);
+    ASSERT_EQ(*block[0], 1);
+    ASSERT_EQ(*block[1], 2);
+    ASSERT_EQ(e.next_n(block, 4), 0);
+}
+
+TEST(EnumeratorTests, NextNOnFunctionalEnumeratorYieldsOneItemPerCall)
+{
+    int x = 0;
+    enumerator<int> e = [&]() -> boost::optional<int>
+    {
+        if (x < 2)
+        {
+            return ++x;
+        }
+        else
+        {
+            return boost::none;
+        }
+    };
+    int* block[4];
+    ASSERT_EQ(e.next_n(block, 4), 1);
+    ASSERT_EQ(*block[0], 1);
+    ASSERT_EQ(e.next_n(block, 4), 1);
+    ASSERT_EQ(*block[0], 2);
+    ASSERT_EQ(e.next_n(block, 4), 0);
+}
+
+TEST(EnumeratorTests, NextNOnDefaultConstructedEnumeratorReturnsZero)
+{
+    enumerator<int> e;
+    int* block[4];
+    ASSERT_EQ(e.next_n(block, 4), 0);
+}
+
+TEST(EnumeratorTests, TryContiguousExposesRemainingItemsOfVector)
+{
+    std::vector<int> v;
+    v.push_back(0);
+    v.push_back(1);
+    v.push_back(2);
+    enumerator<int> e = v;
+    ASSERT_EQ(*e.next(), 0);
+    auto range = e.try_contiguous();
+    ASSERT_TRUE(range);
+    ASSERT_EQ(range->first, &v[1]);
+    ASSERT_EQ(range->second, &v[0] + 3);
+    ASSERT_FALSE(e.next());
+}
+
+TEST(EnumeratorTests, TryContiguousWorksForArraysAndPointers)
+{
+    const int ar[] = {0, 1, 2};
+    enumerator<const int> e = ar;
+    auto range = e.try_contiguous();
+    ASSERT_TRUE(range);
+    ASSERT_EQ(range->second - range->first, 3);
+
+    std::array<int, 2> a = {{0, 1}};
+    enumerator<int> f = a;
+    ASSERT_TRUE(f.try_contiguous());
+
+    enumerator<int> g = make_enumerator(a.data(), 1);
+    range = g.try_contiguous();
+    ASSERT_TRUE(range);
+    ASSERT_EQ(range->second - range->first, 1);
+}
+
+TEST(EnumeratorTests, TryContiguousWorksForEmbeddedVector)
+{
+    std::vector<int> v;
+    v.push_back(0);
+    v.push_back(1);
+    enumerator<const int> e = std::move(v);
+    auto range = e.try_contiguous();
+    ASSERT_TRUE(range);
+    ASSERT_EQ(range->second - range->first, 2);
+    ASSERT_EQ(range->first[1], 1);
+    ASSERT_FALSE(e.next());
+}
+
+TEST(EnumeratorTests, TryContiguousFailsForNonContiguousCollections)
+{
+    std::list<int> l;
+    l.push_back(0);
+    enumerator<int> e = l;
+    ASSERT_FALSE(e.try_contiguous());
+    ASSERT_EQ(*e.next(), 0);
+}
+
+TEST(EnumeratorTests, TryContiguousFailsWhenExposingBaseType)
+{
+    struct Foo
+    {
+        int value;
+        Foo(int v) : value(v) { }
+    };
+
+    struct Bar : Foo
+    {
+        int extra;
+        Bar(int v) : Foo(v), extra(0) { }
+    };
+
+    std::vector<Bar> v;
+    v.push_back(Bar(0));
+    enumerator<Foo> e = v;
+    ASSERT_FALSE(e.try_contiguous());
+    ASSERT_EQ(e.next()->value, 0);
+}
+
+TEST(EnumeratorTests, ConcurrentEnumeratorHandsOutEachItemOnce)
+{
+    std::vector<int> v(10000, 0);
+    enumerator<int> e = make_concurrent_enumerator<int>(v);
+
+    boost::thread_group threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.create_thread([&, i]()
+        {
+            if (i % 2)
+            {
+                while (auto n = e.next())
+                {
+                    ++(*n);
+                }
+            }
+            else
+            {
+                int* block[7];
+                while (size_t count = e.next_n(block, 7))
+                {
+                    for (size_t j = 0; j < count; ++j)
+                    {
+                        ++(*block[j]);
+                    }
+                }
+            }
+        });
+    }
+    threads.join_all();
+
+    ASSERT_EQ(std::count(v.begin(), v.end(), 1), 10000);
+    ASSERT_FALSE(e.next());
+}
+
+TEST(EnumeratorTests, ConcurrentEnumeratorSupportsNonContiguousRandomAccessCollections)
+{
+    std::deque<int> d;
+    d.push_back(0);
+    d.push_back(1);
+    d.push_back(2);
+    enumerator<const int> e = make_concurrent_enumerator<const int>(static_cast<const std::deque<int>&>(d));
+    ASSERT_FALSE(e.try_contiguous());
+    ASSERT_EQ(*e.next(), 0);
+    const int* block[4];
+    ASSERT_EQ(e.next_n(block, 4), 2);
+    ASSERT_EQ(*block[1], 2);
+    ASSERT_EQ(e.next_n(block, 4), 0);
+    ASSERT_FALSE(e.next());
+}
+
+TEST(EnumeratorTests, ConcurrentEnumeratorClampsHugeBlockSizes)
+{
+    int ar[] = {0, 1, 2};
+    enumerator<int> e = make_concurrent_enumerator<int>(ar);
+    ASSERT_EQ(*e.next(), 0);
+    int* block[3];
+    ASSERT_EQ(e.next_n(block, ~size_t(0)), 2);
+    ASSERT_EQ(block[0], &ar[1]);
+    ASSERT_EQ(e.next_n(block, ~size_t(0)), 0);
+    ASSERT_FALSE(e.next());
+}
+
+TEST(EnumeratorTests, ConcurrentEnumeratorCanClaimRemainderAsContiguousRange)
+{
+    int ar[] = {0, 1, 2, 3};
+    enumerator<int> e = make_concurrent_enumerator<int>(ar);
+    ASSERT_EQ(*e.next(), 0);
+    auto range = e.try_contiguous();
+    ASSERT_TRUE(range);
+    ASSERT_EQ(range->first, &ar[1]);
+    ASSERT_EQ(range->second, &ar[4]);
+    ASSERT_FALSE(e.next());
+}
+
+TEST(EnumeratorTests, SplitDividesRandomAccessRangeInHalves)
+{
+    std::vector<int> v;
+    for (int i = 0; i < 5; ++i)
+    {
+        v.push_back(i);
+    }
+    enumerator<int> e = v;
+    enumerator<int> f;
+    ASSERT_EQ(*e.next(), 0);
+    ASSERT_TRUE(e.split(f));
+    ASSERT_EQ(*e.next(), 1);
+    ASSERT_EQ(*e.next(), 2);
+    ASSERT_FALSE(e.next());
+    ASSERT_EQ(*f.next(), 3);
+    ASSERT_EQ(*f.next(), 4);
+    ASSERT_FALSE(f.next());
+}
+
+TEST(EnumeratorTests, SplitCanBeAppliedRecursively)
+{
+    std::deque<int> d(8, 0);
+    enumerator<int> a = d;
+    enumerator<int> b, c, e;
+    ASSERT_TRUE(a.split(c));
+    ASSERT_TRUE(a.split(b));
+    ASSERT_TRUE(c.split(e));
+    int* block[8];
+    ASSERT_EQ(a.next_n(block, 8), 2);
+    ASSERT_EQ(block[0], &d[0]);
+    ASSERT_EQ(b.next_n(block, 8), 2);
+    ASSERT_EQ(block[0], &d[2]);
+    ASSERT_EQ(c.next_n(block, 8), 2);
+    ASSERT_EQ(block[0], &d[4]);
+    ASSERT_EQ(e.next_n(block, 8), 2);
+    ASSERT_EQ(block[0], &d[6]);
+}
+
+TEST(EnumeratorTests, SplitOfSingleItemLeavesTailEmpty)
+{
+    int ar[] = {0};
+    enumerator<int> e = ar;
+    enumerator<int, atomic> f;
+    ASSERT_TRUE(e.split(f));
+    ASSERT_FALSE(f.next());
+    ASSERT_EQ(*e.next(), 0);
+}
+
+TEST(EnumeratorTests, SplitIsRefusedByNonRandomAccessEnumerators)
+{
+    std::list<int> l(4, 0);
+    enumerator<int> e = l;
+    enumerator<int> f;
+    ASSERT_FALSE(e.split(f));
+    ASSERT_FALSE(f.next());
+
+    enumerator<int> g = std::move(std::vector<int>(4, 0));
+    ASSERT_FALSE(g.split(f));
+}
+
+TEST(EnumeratorTests, SplitIntoItselfIsRefused)
+{
+    std::vector<int> v(4, 0);
+    enumerator<int> e = v;
+    ASSERT_FALSE(e.split(e));
+    int count = 0;
+    while (e.next())
+    {
+        ++count;
+    }
+    ASSERT_EQ(count, 4);
+}
+
+TEST(EnumeratorTests, StaticEnumeratorConvertsToEnumerator)
+{
+    std::list<int> l;
+    l.push_back(0);
+    l.push_back(1);
+    l.push_back(2);
+    auto e = make_static_enumerator<int>(l);
+    ASSERT_EQ(*e.next(), 0);
+    ASSERT_FALSE(e.try_contiguous());
+
+    //  The erased enumerator continues where the static one stopped.
+    enumerator<const int> f = std::move(e);
+    ASSERT_EQ(*f.next(), 1);
+    ASSERT_EQ(*f.next(), 2);
+    ASSERT_FALSE(f.next());
+
+    std::vector<int> v(4, 5);
+    auto g = make_static_enumerator<int>(v);
+    enumerator<int> tail;
+    ASSERT_TRUE(g.split(tail));
+    auto range = g.try_contiguous();
+    ASSERT_TRUE(range);
+    ASSERT_EQ(range->first, &v[0]);
+    ASSERT_EQ(range->second, &v[2]);
+    ASSERT_EQ(&*tail.next(), &v[2]);
+}
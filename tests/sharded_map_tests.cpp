@@ -0,0 +1,111 @@
+//////////////////////////////////////////////////////////////////////////////// 
+// Copyright (c) 2012 Robert Engeln (engeln@gmail.com)
+// See accompanying LICENSE file for full license information.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <boost/utility.hpp>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+#include "polymorphic_collections/accessor.hpp"
+#include "polymorphic_collections/aggregator.hpp"
+#include "polymorphic_collections/enumerator.hpp"
+#include "polymorphic_collections/sharded_map.hpp"
+
+using namespace polymorphic_collections;
+
+TEST(ShardedMapTests, ShardedMapCanBeUsedThroughTheFacades)
+{
+    sharded_map<int, std::string, 4> map;
+    aggregator<int, std::string> a = map;
+    a.add(1, "one").add(2, "two").add(1, "uno");
+    a.try_emplace(3, 5, 'x');
+
+    accessor<int, std::string> b = map;
+    ASSERT_EQ(*b[1], "one");
+    ASSERT_EQ(*b[3], "xxxxx");
+    ASSERT_FALSE(b[4]);
+
+    std::set<int> keys;
+    enumerator<std::pair<const int, std::string>> e = map;
+    while (auto item = e.next())
+    {
+        keys.insert(item->first);
+    }
+    ASSERT_EQ(keys, std::set<int>({ 1, 2, 3 }));
+    ASSERT_EQ(map.size(), 3u);
+}
+
+TEST(ShardedMapTests, ShardsCanBeUpdatedConcurrently)
+{
+    sharded_map<int, int> map;
+    aggregator<int, int> a = map;
+    accessor<int, int> b = map;
+    boost::atomic<int> found(0);
+
+    boost::thread_group threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.create_thread([&, i]()
+        {
+            for (int j = 0; j < 5000; ++j)
+            {
+                a.add(i * 5000 + j, j);
+                if (b[i * 5000 + j / 2])
+                {
+                    ++found;
+                }
+            }
+        });
+    }
+    threads.join_all();
+
+    ASSERT_EQ(found, 20000);
+    ASSERT_EQ(map.size(), 20000u);
+    size_t count = 0;
+    for (auto it = map.begin(); it != map.end(); ++it)
+    {
+        ASSERT_EQ(it->second, it->first % 5000);
+        ++count;
+    }
+    ASSERT_EQ(count, 20000u);
+}
+
+TEST(ShardedMapTests, MergingAggregatorsCountConcurrently)
+{
+    sharded_map<int, int, 4> map;
+    auto a = make_merging_aggregator<int, int>(map, std::plus<int>());
+    auto b = make_buffered_aggregator<int, int>(map, std::plus<int>(), 16);
+    std::vector<std::pair<int, int>> batch;
+    for (int i = 0; i < 1000; ++i)
+    {
+        batch.push_back(std::make_pair(i % 8, 1));
+    }
+
+    //  Every key is added to by all of the threads at once, one item at a
+    //  time, in batches, and through the tables of the buffered aggregator.
+    boost::thread_group threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.create_thread([&]()
+        {
+            for (int j = 0; j < 20000; ++j)
+            {
+                a.add(j % 8, 1);
+                b.add(j % 8, 1);
+            }
+            a.add_many(batch.begin(), batch.end());
+        });
+    }
+    threads.join_all();
+    b.flush();
+
+    ASSERT_EQ(map.size(), 8u);
+    for (auto it = map.begin(); it != map.end(); ++it)
+    {
+        ASSERT_EQ(it->second, 4 * (2 * 2500 + 125));
+    }
+}
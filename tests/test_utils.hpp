@@ -7,6 +7,7 @@
 #define TEST_UTILS_HPP
 
 #include <boost/utility.hpp>
+#include "polymorphic_collections/memory_resource.hpp"
 
 class NoCopyOrMove : public boost::noncopyable
 {
@@ -59,4 +60,88 @@ public:
     }
 };
 
+//  Counts the constructions, copies and moves of its instances.
+class Counted
+{
+public:
+    int a, b;
+
+    Counted(int a, int b)
+    : a(a), b(b)
+    {
+        ++constructed();
+    }
+
+    Counted(const Counted& rhs)
+    : a(rhs.a), b(rhs.b)
+    {
+        ++copied();
+    }
+
+    Counted(Counted&& rhs)
+    : a(rhs.a), b(rhs.b)
+    {
+        ++moved();
+    }
+
+    static int& constructed()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    static int& copied()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    static int& moved()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    static void reset()
+    {
+        constructed() = copied() = moved() = 0;
+    }
+};
+
+//  Memory resource which counts the blocks allocated from it.
+class CountingResource : public polymorphic_collections::memory_resource
+{
+public:
+    size_t allocated;
+    size_t deallocated;
+
+    CountingResource()
+    : allocated(0), deallocated(0)
+    {
+    }
+
+    size_t outstanding() const
+    {
+        return allocated - deallocated;
+    }
+
+private:
+    virtual void* do_allocate(size_t bytes, size_t)
+    {
+        ++allocated;
+        return ::operator new(bytes);
+    }
+
+    virtual void do_deallocate(void* ptr, size_t, size_t)
+    {
+        ++deallocated;
+        ::operator delete(ptr);
+    }
+
+    virtual bool do_is_equal(const polymorphic_collections::memory_resource& rhs) const noexcept
+    {
+        return this == &rhs;
+    }
+};
+
 #endif  // TEST_UTILS_HPP